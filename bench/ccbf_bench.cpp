@@ -0,0 +1,650 @@
+#include "bfasync.hpp"
+#include "bfbytecode.hpp"
+#include "bfcompiler.hpp"
+#include "bfembed.hpp"
+#include "bfio.hpp"
+#include "bfjit.hpp"
+#include "bflimit.hpp"
+#include "bfpacked.hpp"
+#include "bfscan.hpp"
+#include "bfsource.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "ccbf.hpp"
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef CCBF_VERSION
+#define CCBF_VERSION "unknown"
+#endif
+
+namespace {
+
+std::string read_corpus(std::string const& name) {
+  std::ifstream ifs{std::string{CCBF_CORPUS_DIR} + "/" + name};
+  return {std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+}
+
+template <typename Engine, typename... Args>
+void run_engine(benchmark::State& state, std::string const& name, size_t optims, Args... args) {
+  auto const program = read_corpus(name);
+  auto const bytecodes = compile(program, optims);
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    Engine engine{in, out, args...};
+    engine.run(bytecodes);
+    benchmark::DoNotOptimize(out.str().size());
+  }
+}
+
+void BM_VM_Mandelbrot(benchmark::State& state) {
+  run_engine<BrainFckVM>(state, "mandelbrot.bf", static_cast<size_t>(state.range(0)));
+}
+
+void BM_VM_Threaded_Mandelbrot(benchmark::State& state) {
+  run_engine<BrainFckVM>(state, "mandelbrot.bf", static_cast<size_t>(state.range(0)),
+                         BrainFckVM::dispatch_t::threaded);
+}
+
+// Same program at each cell width; the uint8_t instantiation is BrainFckVM itself.
+template <typename Cell>
+void BM_VM_Threaded_Mandelbrot_Cell(benchmark::State& state) {
+  run_engine<BasicBrainFckVM<Cell>>(state, "mandelbrot.bf", static_cast<size_t>(state.range(0)),
+                                    BrainFckVMBase::dispatch_t::threaded);
+}
+
+void BM_VM_HelloWorld(benchmark::State& state) {
+  run_engine<BrainFckVM>(state, "helloworld.bf", static_cast<size_t>(state.range(0)));
+}
+
+void BM_VM_Threaded_HelloWorld(benchmark::State& state) {
+  run_engine<BrainFckVM>(state, "helloworld.bf", static_cast<size_t>(state.range(0)),
+                         BrainFckVM::dispatch_t::threaded);
+}
+
+void BM_JIT_Mandelbrot(benchmark::State& state) {
+  if (!BrainFckJIT::supported()) {
+    state.SkipWithError("JIT backend not supported on this host");
+    return;
+  }
+  run_engine<BrainFckJIT>(state, "mandelbrot.bf", static_cast<size_t>(state.range(0)));
+}
+
+// Scan throughput: walk a 1 MiB tape of non-zero cells to the zero at the far end.
+void BM_Scan(benchmark::State& state) {
+  constexpr std::size_t size = std::size_t{1} << 20;
+  auto const stride = static_cast<std::int32_t>(state.range(0));
+  std::vector<std::uint8_t> tape(size, 1);
+  auto const start = stride > 0 ? std::size_t{0} : size - 1;
+  auto const target = stride > 0 ? size - static_cast<std::size_t>(stride) : static_cast<std::size_t>(-stride - 1);
+  tape[target] = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(bfscan::scan_zero(tape.data(), size, start, stride));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(size));
+}
+
+// Writes 255^3 copies of 'A' (about 16.6 MB).
+std::string const output_heavy_program = std::string(65, '+') + ">-[>-[>-[<<<.>>>-]<-]<-]";
+
+// Output-heavy program on the raw-descriptor path, writing to /dev/null.
+template <typename Engine>
+void run_output_heavy(benchmark::State& state) {
+  auto const bytecodes = compile(output_heavy_program, 4);
+  auto const in_fd = ::open("/dev/null", O_RDONLY);
+  auto const out_fd = ::open("/dev/null", O_WRONLY);
+  for (auto _ : state) {
+    Engine engine{in_fd, out_fd};
+    engine.run(bytecodes);
+  }
+  ::close(in_fd);
+  ::close(out_fd);
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * 255 * 255 * 255);
+}
+
+void BM_VM_OutputHeavy(benchmark::State& state) { run_output_heavy<BrainFckVM>(state); }
+
+void BM_JIT_OutputHeavy(benchmark::State& state) {
+  if (!BrainFckJIT::supported()) {
+    state.SkipWithError("JIT backend not supported on this host");
+    return;
+  }
+  run_output_heavy<BrainFckJIT>(state);
+}
+
+// Per-byte sink cost: ostream::put (what the engines used before bfio) against bfio::Output.
+void BM_Output_OStreamPut(benchmark::State& state) {
+  std::ofstream os{"/dev/null", std::ios::binary};
+  for (auto _ : state) {
+    for (int i = 0; i < 1 << 20; ++i) {
+      os.put('A');
+    }
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) << 20);
+}
+
+void BM_Output_Buffered(benchmark::State& state) {
+  auto const fd = ::open("/dev/null", O_WRONLY);
+  {
+    bfio::Output out{fd};
+    for (auto _ : state) {
+      for (int i = 0; i < 1 << 20; ++i) {
+        out.put('A');
+      }
+    }
+  }
+  ::close(fd);
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) << 20);
+}
+
+// Synthetic large source: mandelbrot.bf repeated to at least state.range(0) MiB, written once per size.
+std::string synthetic_source(std::size_t mib) {
+  auto const path = std::filesystem::temp_directory_path() / ("ccbf_bench_" + std::to_string(mib) + "MiB.bf");
+  if (!std::filesystem::exists(path) or std::filesystem::file_size(path) < (mib << 20)) {
+    auto const unit = read_corpus("mandelbrot.bf");
+    std::ofstream ofs{path, std::ios::binary};
+    for (std::size_t written = 0; written < (mib << 20); written += unit.size()) {
+      ofs << unit;
+    }
+  }
+  return path.string();
+}
+
+// Previous loading path: istreambuf_iterator copy into a std::string.
+void BM_Load_Istreambuf(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    std::ifstream ifs{path};
+    std::string const program{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+    benchmark::DoNotOptimize(program.size());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0) << 20);
+}
+
+void BM_Load_Mmap(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    MappedFile const file{path};
+    benchmark::DoNotOptimize(file.view().size());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0) << 20);
+}
+
+// Previous compile path: compile() straight over an istreambuf_iterator range.
+void BM_Compile_Istreambuf(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    std::ifstream ifs{path};
+    auto const input = rng::subrange(std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{});
+    benchmark::DoNotOptimize(compile(input, 4).size());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0) << 20);
+}
+
+void BM_Compile_Mmap(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    MappedFile const file{path};
+    benchmark::DoNotOptimize(compile(file.view(), 4).size());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0) << 20);
+}
+
+void BM_Compile_Stream(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    std::ifstream ifs{path, std::ios::binary};
+    benchmark::DoNotOptimize(compile_stream(ifs, 4).size());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0) << 20);
+}
+
+// Levels 2 and up on translated bytecode, as chained passes and as the fused single scan, for a
+// source of state.range(0) MiB at level state.range(1). Bytes/s counts source bytes.
+template <bool Fused>
+void run_optimize(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  auto const optims = static_cast<std::size_t>(state.range(1));
+  MappedFile const file{path};
+  std::vector<inst_t> translated;
+  source_map_t translated_map;
+  bfcompiler_internal::translate(file.view(), translated, true, 0, &translated_map);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto bytecodes = translated;
+    auto map = translated_map;
+    state.ResumeTiming();
+    if constexpr (Fused) {
+      bfcompiler_internal::optimize_fused(bytecodes, optims, &map);
+      benchmark::DoNotOptimize(bytecodes.size());
+    } else {
+      benchmark::DoNotOptimize(bfcompiler_internal::optimize_chained(std::move(bytecodes), optims, &map).size());
+    }
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(file.view().size()));
+}
+
+void BM_Optimize_Chained(benchmark::State& state) { run_optimize<false>(state); }
+
+void BM_Optimize_Fused(benchmark::State& state) { run_optimize<true>(state); }
+
+// Cache hit path: map a stored bytecode file instead of compiling the source.
+void BM_Load_Bytecode(benchmark::State& state) {
+  auto const path = synthetic_source(static_cast<std::size_t>(state.range(0)));
+  auto const encoding = static_cast<bfbytecode::encoding_t>(state.range(1));
+  auto const cached = std::filesystem::temp_directory_path() / "ccbf_bench_cached.ccbc";
+  {
+    MappedFile const source{path};
+    bfbytecode::header_t header;
+    header.encoding = encoding;
+    header.optims = 4;
+    header.source_size = source.view().size();
+    header.source_hash = bfbytecode::source_hash(source.view());
+    bfbytecode::write_file(cached, compile(source.view(), 4), header);
+  }
+  for (auto _ : state) {
+    bfbytecode::BytecodeFile const file{cached.string()};
+    benchmark::DoNotOptimize(file.program().size());
+  }
+  std::filesystem::remove(cached);
+}
+
+// Corpus benchmarks: each program on every engine and optimization level, and compile() itself.
+// Rates are in source instructions and output bytes, so engines and levels compare directly.
+std::vector<std::string> const corpus_programs{"helloworld.bf", "bench.bf", "hanoi.bf", "fib.bf", "mandelbrot.bf"};
+
+// compile() reports its passes on std::cout; this keeps them out of the benchmark table.
+class SilenceCout {
+ public:
+  SilenceCout() : saved_{std::cout.rdbuf(nullptr)} {}
+  ~SilenceCout() {
+    std::cout.rdbuf(saved_);
+    std::cout.clear();
+  }
+  SilenceCout(SilenceCout const&) = delete;
+  SilenceCout& operator=(SilenceCout const&) = delete;
+
+ private:
+  std::streambuf* saved_;
+};
+
+struct profile_t {
+  std::string source;
+  std::int64_t op_codes{0};      // Brainfuck instructions in the source
+  std::int64_t executed{0};      // Brainfuck instructions executed by one run
+  std::int64_t output_bytes{0};  // bytes printed by one run
+};
+
+// Count one run of the collapsed bytecode: a run of n '+' or '>' counts as n instructions. Computed
+// once per program, outside any timed region.
+profile_t const& profile(std::string const& name) {
+  static std::map<std::string, profile_t> profiles;
+  if (auto const it = profiles.find(name); it != profiles.end()) {
+    return it->second;
+  }
+  profile_t p;
+  p.source = read_corpus(name);
+  p.op_codes = rng::count_if(p.source, [](char c) { return std::string_view{"+-<>[].,"}.contains(c); });
+  auto const bytecodes = [&] {
+    SilenceCout const silence;
+    return compile(p.source, 1);
+  }();
+
+  std::vector<std::uint8_t> tape(bftape::options_t{}.size);
+  auto const size = static_cast<std::int64_t>(tape.size());
+  std::int64_t mp{0};
+  for (std::size_t pc = 0; pc < bytecodes.size(); ++pc) {
+    auto const& inst = bytecodes[pc];
+    switch (inst.opcode) {
+      case inst_t::op_code_t::mpadd:
+        mp = ((mp + inst.operand) % size + size) % size;
+        p.executed += std::abs(inst.operand);
+        break;
+      case inst_t::op_code_t::add:
+        tape[mp] = static_cast<std::uint8_t>(tape[mp] + inst.operand);
+        p.executed += std::abs(inst.operand);
+        break;
+      case inst_t::op_code_t::jmpz:
+        ++p.executed;
+        if (tape[mp] == 0) {
+          pc = static_cast<std::size_t>(inst.operand);
+        }
+        break;
+      case inst_t::op_code_t::jmpnz:
+        ++p.executed;
+        if (tape[mp] != 0) {
+          pc = static_cast<std::size_t>(inst.operand);
+        }
+        break;
+      case inst_t::op_code_t::in:
+        ++p.executed;
+        tape[mp] = 0;
+        break;
+      case inst_t::op_code_t::out:
+        ++p.executed;
+        ++p.output_bytes;
+        break;
+      default:
+        break;
+    }
+  }
+  return profiles.emplace(name, std::move(p)).first->second;
+}
+
+void set_rates(benchmark::State& state, std::int64_t instructions, std::int64_t output_bytes) {
+  state.counters["instructions"] =
+      benchmark::Counter(static_cast<double>(instructions), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["bytes_out"] = benchmark::Counter(
+      static_cast<double>(output_bytes), benchmark::Counter::kIsIterationInvariantRate, benchmark::Counter::kIs1024);
+}
+
+void BM_Corpus_Interpreter(benchmark::State& state, std::string const& name) {
+  auto const& p = profile(name);
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    BFMachine machine{in, out};
+    machine.run(p.source);
+    benchmark::DoNotOptimize(out.str().size());
+  }
+  set_rates(state, p.executed, p.output_bytes);
+}
+
+void BM_Corpus_VM(benchmark::State& state, std::string const& name) {
+  auto const& p = profile(name);
+  auto const bytecodes = [&] {
+    SilenceCout const silence;
+    return compile(p.source, static_cast<std::size_t>(state.range(0)));
+  }();
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out};
+    vm.run(bytecodes);
+    benchmark::DoNotOptimize(out.str().size());
+  }
+  set_rates(state, p.executed, p.output_bytes);
+}
+
+// Threaded VM at level 4 without (0) and with (1) superinstructions. dispatches is the number of
+// handlers run per program, counted by a profiled run outside the timed loop.
+void BM_Corpus_Superinstructions(benchmark::State& state, std::string const& name) {
+  auto const& p = profile(name);
+  auto bytecodes = [&] {
+    SilenceCout const silence;
+    return compile(p.source, 4);
+  }();
+  if (state.range(0) != 0) {
+    bfsuper::fuse(bytecodes);
+  }
+  bfprofile::Counter dispatches{bytecodes.size()};
+  {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, BrainFckVM::dispatch_t::threaded};
+    vm.run(bytecodes, dispatches);
+  }
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, BrainFckVM::dispatch_t::threaded};
+    vm.run(bytecodes);
+    benchmark::DoNotOptimize(out.str().size());
+  }
+  set_rates(state, p.executed, p.output_bytes);
+  state.counters["dispatches"] = static_cast<double>(dispatches.total());
+}
+
+// Threaded VM at level 4 without (0) and with (1) limits. The limits never trigger (unbounded fuel, a
+// distant deadline and an interrupt flag nobody sets), so the difference is the cost of the checks.
+void BM_Corpus_Limits(benchmark::State& state, std::string const& name) {
+  auto const& p = profile(name);
+  auto const bytecodes = [&] {
+    SilenceCout const silence;
+    return compile(p.source, 4);
+  }();
+  std::atomic<bool> const interrupt{false};
+  bflimit::limits_t const limits{.time = std::chrono::hours{1}, .interrupt = &interrupt};
+  std::uint64_t steps = 0;
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, BrainFckVM::dispatch_t::threaded};
+    if (state.range(0) != 0) {
+      steps = vm.run_limited(bytecodes, limits).steps;
+    } else {
+      vm.run(bytecodes);
+    }
+    benchmark::DoNotOptimize(out.str().size());
+  }
+  set_rates(state, p.executed, p.output_bytes);
+  state.counters["steps"] = static_cast<double>(steps);
+}
+
+// A loop over about state.range(0) thousand blocks of straight-line cell updates with inner loops, so the
+// bytecode of the body is several MiB and its instructions do not stay in cache between iterations.
+std::string large_program(std::size_t blocks) {
+  std::string program = "++++++++[>";
+  std::uint32_t seed = 12345;
+  auto const next = [&seed](std::uint32_t bound) {
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 16) % bound + 1;
+  };
+  for (std::size_t i = 0; i < blocks; ++i) {
+    auto const step = next(4);
+    program += std::string(step, '>') + std::string(next(9), '+') + ">" + std::string(next(5), '-') + "<";
+    program += "[->" + std::string(next(3), '+') + "<]>[-<+>]<" + std::string(step, '<');
+  }
+  return program + "<-]";
+}
+
+// The large program as inst_t (0) and packed (1), on the switch loop (0) and threaded (1). code_bytes is
+// the size of the encoding the VM reads. Cache misses need a libbenchmark built with libpfm, then
+// --benchmark_perf_counters=CYCLES,CACHE-MISSES,L1-ICACHE-LOAD-MISSES.
+void BM_Packed_Large(benchmark::State& state) {
+  auto const bytecodes = [&] {
+    SilenceCout const silence;
+    return compile(large_program(static_cast<std::size_t>(state.range(0)) * 1000), 2);
+  }();
+  bfpacked::Program const packed{bytecodes};
+  auto const packed_code = state.range(1) != 0;
+  auto const dispatch = state.range(2) != 0 ? BrainFckVM::dispatch_t::threaded : BrainFckVM::dispatch_t::switch_loop;
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, dispatch};
+    if (packed_code) {
+      vm.run(packed.view());
+    } else {
+      vm.run(bytecodes);
+    }
+    benchmark::DoNotOptimize(out.str().size());
+  }
+  state.counters["instructions"] = static_cast<double>(bytecodes.size());
+  state.counters["code_bytes"] =
+      static_cast<double>(packed_code ? packed.bytes() : bytecodes.size() * sizeof(inst_t));
+}
+
+// The code of bench.bf, embedded.
+constexpr char embedded_bench[] =
+    ">>++++++++++[-<+++++++++>]<<++++++++++++++++++++++++++[>>++++++++++[>++++++++++["
+    ">++++++++++[>++++++++++[>++++++++++[>++++++++++++++++++++[->+<]<-]<-]<-]<-]<-]>>"
+    ">>>>[-]<<<<<<<.-<-]>>++++++++++.";
+
+// bench.bf at level 2 compiled at run time (0), compiled with the C++ into bfembed::bytecode (1), both on
+// the switch VM, and unrolled into C++ loops by bfembed::run (2).
+void BM_Embed(benchmark::State& state) {
+  for (auto _ : state) {
+    std::istringstream in;
+    std::ostringstream out;
+    if (state.range(0) == 2) {
+      bfembed::run<embedded_bench>(in, out);
+    } else {
+      BrainFckVM vm{in, out};
+      if (state.range(0) == 1) {
+        vm.run(bfembed::bytecode<embedded_bench>);
+      } else {
+        SilenceCout const silence;
+        vm.run(compile(std::string_view{embedded_bench}, 2));
+      }
+    }
+    benchmark::DoNotOptimize(out.str().size());
+  }
+}
+
+// Resident memory of the process in bytes.
+std::size_t resident_bytes() {
+  std::ifstream statm{"/proc/self/statm"};
+  std::size_t pages = 0;
+  std::size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// state.range(0) echo sessions waiting on socketpairs in one event loop. Each iteration sends a byte to
+// the next session round-robin, runs the loop once and reads the echo: the time is the round trip through
+// epoll and a coroutine switch. session_bytes is the resident memory each idle session added (VM, tape,
+// buffers and coroutine frame; socket buffers are kernel memory).
+void BM_Async_Echo(benchmark::State& state) {
+  auto const count = static_cast<std::size_t>(state.range(0));
+  auto const program = [] {
+    SilenceCout const silence;
+    return compile(",[.,]", 2);
+  }();
+  std::vector<std::array<int, 2>> pairs(count);
+  std::vector<std::unique_ptr<bfasync::Session>> sessions;
+  bfasync::EventLoop loop;
+  rlimit limit{};
+  ::getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = std::min(std::max(limit.rlim_cur, static_cast<rlim_t>(2 * count + 64)), limit.rlim_max);
+  ::setrlimit(RLIMIT_NOFILE, &limit);
+  auto const before = resident_bytes();
+  for (auto& pair : pairs) {
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data()) != 0) {
+      state.SkipWithError("Not enough file descriptors for the sessions");
+      return;
+    }
+    sessions.push_back(std::make_unique<bfasync::Session>(program, pair[0], pair[0]));
+    loop.spawn(sessions.back()->run(loop));
+  }
+  auto const after = resident_bytes();
+
+  std::size_t next = 0;
+  char byte = 'x';
+  for (auto _ : state) {
+    auto const client = pairs[next][1];
+    ::write(client, &byte, 1);
+    loop.run_once();
+    benchmark::DoNotOptimize(::read(client, &byte, 1));
+    next = next + 1 == count ? 0 : next + 1;
+  }
+  state.counters["session_bytes"] = static_cast<double>(after - before) / static_cast<double>(count);
+
+  for (auto& pair : pairs) {
+    ::shutdown(pair[1], SHUT_WR);
+  }
+  loop.run();
+  for (auto& pair : pairs) {
+    ::close(pair[0]);
+    ::close(pair[1]);
+  }
+}
+
+// Compile throughput: instructions/s counts source instructions, bytes/s source bytes.
+void BM_Corpus_Compile(benchmark::State& state, std::string const& name) {
+  auto const& p = profile(name);
+  auto const optims = static_cast<std::size_t>(state.range(0));
+  SilenceCout const silence;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(compile(p.source, optims).size());
+  }
+  state.counters["instructions"] =
+      benchmark::Counter(static_cast<double>(p.op_codes), benchmark::Counter::kIsIterationInvariantRate);
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(p.source.size()));
+}
+
+void register_corpus() {
+  for (auto const& name : corpus_programs) {
+    auto const stem = std::filesystem::path{name}.stem().string();
+    benchmark::RegisterBenchmark(("BM_Corpus_Interpreter/" + stem).c_str(), BM_Corpus_Interpreter, name)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("BM_Corpus_VM/" + stem).c_str(), BM_Corpus_VM, name)
+        ->DenseRange(0, 2)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("BM_Corpus_Superinstructions/" + stem).c_str(), BM_Corpus_Superinstructions, name)
+        ->DenseRange(0, 1)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("BM_Corpus_Limits/" + stem).c_str(), BM_Corpus_Limits, name)
+        ->DenseRange(0, 1)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("BM_Corpus_Compile/" + stem).c_str(), BM_Corpus_Compile, name)
+        ->DenseRange(0, 4)
+        ->Unit(benchmark::kMicrosecond);
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_Load_Bytecode)
+    ->Args({64, static_cast<int>(bfbytecode::encoding_t::raw)})
+    ->Args({64, static_cast<int>(bfbytecode::encoding_t::varint)})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Load_Istreambuf)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Load_Mmap)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Compile_Istreambuf)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Compile_Mmap)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Compile_Stream)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Optimize_Chained)->ArgsProduct({{8}, {2, 3, 4}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Optimize_Fused)->ArgsProduct({{8}, {2, 3, 4}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_VM_OutputHeavy)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_JIT_OutputHeavy)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Output_OStreamPut);
+BENCHMARK(BM_Output_Buffered);
+BENCHMARK(BM_Scan)->Arg(1)->Arg(-1)->Arg(2)->Arg(-2)->Arg(4)->Arg(-4)->Arg(3)->Arg(-7);
+BENCHMARK(BM_VM_Mandelbrot)->Arg(2)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_VM_Threaded_Mandelbrot)->Arg(2)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_VM_Threaded_Mandelbrot_Cell, std::uint8_t)->Arg(4)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_VM_Threaded_Mandelbrot_Cell, std::uint16_t)->Arg(4)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_VM_Threaded_Mandelbrot_Cell, std::uint32_t)->Arg(4)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_VM_HelloWorld)->Arg(0)->Arg(2);
+BENCHMARK(BM_VM_Threaded_HelloWorld)->Arg(0)->Arg(2);
+BENCHMARK(BM_JIT_Mandelbrot)->Arg(0)->Arg(2)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Embed)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Async_Echo)->Arg(1)->Arg(1000)->Arg(5000);
+BENCHMARK(BM_Packed_Large)->ArgsProduct({{200}, {0, 1}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+// BENCHMARK_MAIN plus the corpus registrations and the version in the report context, so JSON
+// output (--benchmark_out=<file> --benchmark_out_format=json) identifies the build it measured.
+int main(int argc, char** argv) {
+  register_corpus();
+  benchmark::AddCustomContext("ccbf_version", CCBF_VERSION);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
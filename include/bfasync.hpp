@@ -0,0 +1,189 @@
+#pragma once
+#include "bftape.hpp"
+#include "bfvm.hpp"
+#include "bytecode.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+// Interactive sessions multiplexed on one thread: each session is a coroutine that runs its program on
+// the VM until `in` finds no input ready or `out` finds its buffer full, then waits on an epoll event
+// loop for the descriptor. Thousands of sessions share a loop; run one loop per thread for more cores.
+namespace bfasync {
+
+// Buffer size for each direction of a session: enough for a line of interactive I/O, small enough for
+// thousands of sessions.
+inline constexpr std::size_t default_buffer_size = 4096;
+
+// A coroutine started and owned by an EventLoop. It starts suspended; EventLoop::spawn runs it.
+class Task {
+ public:
+  struct promise_type {
+    std::exception_ptr error;
+
+    Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  Task(Task&& other) noexcept : handle_{std::exchange(other.handle_, {})} {}
+  Task& operator=(Task other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> release() { return std::exchange(handle_, {}); }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_{handle} {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+class EventLoop {
+ public:
+  // Throws std::runtime_error when epoll is unavailable.
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(EventLoop const&) = delete;
+  EventLoop& operator=(EventLoop const&) = delete;
+
+  struct ready_t {
+    EventLoop& loop;
+    int fd;
+    std::uint32_t events;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { loop.watch(fd, events, handle); }
+    void await_resume() const noexcept {}
+  };
+
+  // co_await loop.readable(fd): resume when fd has input, end of file or an error. One coroutine waits
+  // on a descriptor at a time.
+  ready_t readable(int fd) { return {*this, fd, in_events}; }
+  ready_t writable(int fd) { return {*this, fd, out_events}; }
+
+  // Stop watching fd, e.g. before closing it while another descriptor may reuse its number.
+  void forget(int fd);
+
+  // Take task over and run it up to its first co_await.
+  void spawn(Task task);
+
+  // Wait up to timeout_ms (-1: forever) for ready descriptors and resume their coroutines. Returns the
+  // number resumed. An exception escaping a task is rethrown here once the task is destroyed.
+  std::size_t run_once(int timeout_ms = -1);
+
+  // run_once until every task has finished.
+  void run();
+
+  // Tasks spawned and not finished.
+  std::size_t size() const { return tasks_.size(); }
+
+ private:
+  static constexpr std::uint32_t in_events = 0x001;  // EPOLLIN
+  static constexpr std::uint32_t out_events = 0x004;  // EPOLLOUT
+
+  void watch(int fd, std::uint32_t events, std::coroutine_handle<> handle);
+  // Resume handle and destroy it if it finished; returns the exception that ended it, if any.
+  std::exception_ptr resume(std::coroutine_handle<> handle);
+
+  int epoll_fd_{-1};
+  std::unordered_set<void*> tasks_;  // coroutine frames, destroyed with the loop if unfinished
+};
+
+// run() policy that pauses the VM instead of blocking on a non-blocking descriptor; take() tells which
+// direction the run waits for.
+class Suspend {
+ public:
+  enum class wait_t {
+    none,    // the run finished
+    input,
+    output,
+  };
+
+  constexpr bool count(std::size_t) const { return true; }
+  void wait_for_input() { waiting_ = wait_t::input; }
+  void wait_for_output() { waiting_ = wait_t::output; }
+
+  // What the last pause waited for, resetting it for the next run.
+  wait_t take() { return std::exchange(waiting_, wait_t::none); }
+
+ private:
+  wait_t waiting_{wait_t::none};
+};
+
+// One program run over a pair of non-blocking descriptors (which may be the same socket). The program
+// must outlive the session and the session its task.
+template <typename Cell = std::uint8_t>
+class BasicSession {
+ public:
+  BasicSession(std::span<inst_t const> program, int in_fd, int out_fd, bftape::options_t tape = {},
+               std::size_t buffer_size = default_buffer_size)
+    : program_{program}, in_fd_{in_fd}, out_fd_{out_fd},
+      vm_{in_fd, out_fd, BrainFckVMBase::dispatch_t::switch_loop, tape, buffer_size} {}
+
+  // The session as a coroutine for EventLoop::spawn. It ends when the program has finished and its
+  // output has been taken, or when the run throws (error() then holds the message).
+  Task run(EventLoop& loop) {
+    Suspend suspend;
+    try {
+      vm_.run(program_, suspend);
+      while (true) {
+        auto const waiting = suspend.take();
+        if (waiting == Suspend::wait_t::input) {
+          // the peer may wait for the whole reply before it sends more
+          while (!vm_.flush_output()) {
+            co_await loop.writable(out_fd_);
+          }
+          co_await loop.readable(in_fd_);
+        } else if (waiting == Suspend::wait_t::output) {
+          co_await loop.writable(out_fd_);
+        } else if (!vm_.flush_output()) {
+          co_await loop.writable(out_fd_);
+          continue;
+        } else {
+          break;
+        }
+        ++switches_;
+        vm_.resume(program_, suspend);
+      }
+    } catch (std::exception const& e) {
+      error_ = e.what();
+    }
+    finished_ = true;
+    loop.forget(in_fd_);
+    loop.forget(out_fd_);
+  }
+
+  bool finished() const { return finished_; }
+  std::string const& error() const { return error_; }
+
+  // Times the session was resumed after waiting for a descriptor.
+  std::uint64_t switches() const { return switches_; }
+
+ private:
+  std::span<inst_t const> program_;
+  int in_fd_;
+  int out_fd_;
+  BasicBrainFckVM<Cell> vm_;
+  std::uint64_t switches_{0};
+  bool finished_{false};
+  std::string error_;
+};
+
+using Session = BasicSession<>;
+
+} // namespace bfasync
@@ -0,0 +1,66 @@
+#pragma once
+#include "bftape.hpp"
+#include "bfvm.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Batch evaluation of many (program, input) pairs inside one process.
+namespace bfbatch {
+
+// One line of a manifest: run program on the contents of input and write what it prints to output.
+struct job_t {
+  std::filesystem::path program;
+  std::filesystem::path input;  // empty: the program reads EOF immediately
+  std::filesystem::path output;
+};
+
+// Manifest lines are "<program> <input> <output>", with "-" for no input. Blank lines and lines
+// starting with '#' are skipped; relative paths are taken relative to base.
+// Throws std::runtime_error on a malformed line.
+std::vector<job_t> parse_manifest(std::istream& is, std::filesystem::path const& base = {});
+
+// Call task(i) for every i in [0, count) on the given number of threads. Each worker owns a deque
+// of indices seeded with a contiguous block; when it runs dry it steals from the far end of the
+// others' deques. The first exception thrown by a task is rethrown after all workers finish.
+void parallel_for(std::size_t count, std::size_t threads, std::function<void(std::size_t)> const& task);
+
+struct options_t {
+  std::size_t optims{2};
+  std::size_t threads{1};
+  BrainFckVMBase::dispatch_t dispatch{BrainFckVMBase::dispatch_t::threaded};
+  bftape::options_t tape{};
+};
+
+struct summary_t {
+  std::size_t jobs{0};
+  std::size_t programs{0};  // distinct programs compiled
+  std::vector<std::string> errors;  // one "<output>: <message>" per failed job
+  double compile_seconds{0};
+  double run_seconds{0};
+
+  double jobs_per_second() const { return run_seconds > 0 ? static_cast<double>(jobs) / run_seconds : 0; }
+};
+
+// The distinct programs of a batch, compiled once and shared read-only by every job that uses them.
+struct programs_t {
+  std::map<std::filesystem::path, std::vector<inst_t>> compiled;
+  std::map<std::filesystem::path, std::string> errors;  // programs that failed to load or compile
+  double seconds{0};
+};
+
+programs_t compile_programs(std::vector<job_t> const& jobs, std::size_t optims);
+
+// Run the jobs on options.threads workers. Each job gets its own VM and tape and reads and writes
+// in-memory buffers; the output file is written when the job ends. A failing job (unreadable file,
+// pointer leaving an error-policy tape, ...) is reported in the summary and does not stop the others.
+summary_t run(std::vector<job_t> const& jobs, programs_t const& programs, options_t const& options);
+
+// compile_programs at options.optims, then run.
+summary_t run(std::vector<job_t> const& jobs, options_t const& options);
+
+} // namespace bfbatch
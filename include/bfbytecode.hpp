@@ -0,0 +1,91 @@
+#pragma once
+#include "bfsource.hpp"
+#include "bftape.hpp"
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// On-disk bytecode: a fixed 32-byte little-endian header followed by the instructions.
+//
+//   offset  size  field
+//        0     8  magic "CCBFBC\0\0"
+//        8     2  format version
+//       10     1  encoding (raw / varint)
+//       11     1  optimization level
+//       12     4  instruction count
+//       16     8  source size in bytes
+//       24     8  source hash (FNV-1a 64)
+//
+// raw stores each inst_t in its in-memory layout (opcode, a zero byte, offset, operand) so a mapped file is
+// executed in place on little-endian hosts; varint stores each instruction as an opcode byte plus zigzag
+// LEB128 operands (jump targets relative to the jump).
+//
+// A start state (bftape::initial_t, e.g. from precompute) may follow the instructions as zigzag LEB128
+// values: cell_bits, policy, tape_size, pointer, pc, base, cell count, the cells, output size, then
+// the output bytes verbatim.
+namespace bfbytecode {
+
+// Bump whenever the instruction set or the optimizer output for a level changes.
+inline constexpr std::uint16_t format_version = 4;
+inline constexpr std::size_t header_size = 32;
+
+enum class encoding_t : std::uint8_t { raw, varint };
+
+struct header_t {
+  std::uint16_t version{format_version};
+  encoding_t encoding{encoding_t::raw};
+  std::uint8_t optims{0};
+  std::uint32_t count{0};
+  std::uint64_t source_size{0};
+  std::uint64_t source_hash{0};
+};
+
+std::uint64_t source_hash(std::string_view source);
+
+// An empty initial state is not stored.
+void write(std::ostream& os, std::span<inst_t const> program, header_t header, bftape::initial_t const& initial = {});
+
+// Replaces path with bfserial::replace_file, so concurrent readers never see a partial file.
+void write_file(std::filesystem::path const& path, std::span<inst_t const> program, header_t header,
+                bftape::initial_t const& initial = {});
+
+// The start state encoding that follows the instructions, for other files that store a state.
+void append_state(std::string& out, bftape::initial_t const& initial);
+
+// Decode a state from the front of bytes and drop it from them. Throws std::runtime_error on malformed
+// input or a pc beyond max_pc.
+bftape::initial_t read_state(std::string_view& bytes, std::size_t max_pc);
+
+// Cache entry for source compiled at the given level; the name depends only on the content.
+std::filesystem::path cache_entry(std::filesystem::path const& dir, std::string_view source, std::size_t optims);
+
+// A loaded bytecode file. Raw files are used straight from the mapping; varint files are decoded once.
+// Throws std::runtime_error on malformed files (including unknown opcodes and unpaired jumps) or a
+// version mismatch.
+class BytecodeFile {
+ public:
+  explicit BytecodeFile(std::string const& path);
+
+  header_t const& header() const { return header_; }
+  std::span<inst_t const> program() const { return program_; }
+  // Stored start state; empty when the file has none.
+  bftape::initial_t const& initial() const { return initial_; }
+
+  // True when header matches this source at this level.
+  bool matches(std::string_view source, std::size_t optims) const;
+
+ private:
+  MappedFile file_;
+  header_t header_;
+  std::vector<inst_t> decoded_;
+  std::span<inst_t const> program_;
+  bftape::initial_t initial_;
+};
+
+} // namespace bfbytecode
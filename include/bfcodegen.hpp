@@ -0,0 +1,24 @@
+#pragma once
+#include "bytecode.hpp"
+#include <cstddef>
+#include <ostream>
+#include <span>
+#include <string>
+
+namespace bfcodegen {
+
+// Tape size of the generated programs, matching BrainFckVM.
+inline constexpr std::size_t default_memory_size = 30000;
+
+// Lower bytecode to a standalone C program with the same I/O behaviour as BrainFckVM.
+void emit_c(std::span<inst_t const> program, std::ostream& os, std::size_t memory_size = default_memory_size);
+
+// System C compiler: $CC when set, otherwise "cc".
+std::string default_c_compiler();
+
+// Generate C for the program and compile it into a native executable at output.
+// Returns the exit status of the C compiler (0 on success).
+int build_native(std::span<inst_t const> program, std::string const& output,
+                 std::string const& c_compiler = default_c_compiler(), bool keep_source = false);
+
+} // namespace bfcodegen
@@ -1,64 +1,364 @@
 #pragma once
+#include "bfsuper.hpp"
+#include "bftape.hpp"
 #include "bytecode.hpp"
 #include "ccbf.hpp"
 #include <algorithm>
+#include <cstdint>
+#include <iomanip>
 #include <iterator>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <utility>
 namespace rng = std::ranges;
 namespace vws = std::ranges::views;
 
 
+// Source spans of compiled instructions, kept as a struct of arrays next to the bytecode so inst_t
+// stays 8 bytes. Instruction i was built from source offsets [begin[i], end[i]): a collapsed run
+// covers the whole run, a jmpz or jmpnz its bracket, and a set, scan or mul the loop it replaced.
+// Offsets are 32 bits, like jump operands.
+struct source_map_t {
+  std::vector<std::uint32_t> begin;
+  std::vector<std::uint32_t> end;
+  std::vector<std::uint32_t> lines;  // offset at which each line after the first starts
+
+  // 1-based line and column (in bytes) of a source offset.
+  struct position_t {
+    std::size_t line{1};
+    std::size_t column{1};
+  };
+
+  constexpr std::size_t size() const { return begin.size(); }
+
+  constexpr void clear() {
+    begin.clear();
+    end.clear();
+    lines.clear();
+  }
+
+  constexpr void push_back(std::uint32_t first, std::uint32_t last) {
+    begin.push_back(first);
+    end.push_back(last);
+  }
+
+  constexpr position_t position(std::size_t offset) const {
+    auto const line = rng::upper_bound(lines, offset);
+    auto const line_begin = line == lines.begin() ? std::size_t{0} : std::size_t{*std::prev(line)};
+    return {static_cast<std::size_t>(line - lines.begin()) + 1, offset - line_begin + 1};
+  }
+};
+
 namespace bfcompiler_internal {
 
-  // Translate raw Brainfuck characters into a bytecode view.
-  auto make_compile_program_view(rng::input_range auto const& program) {
+  // Translate raw Brainfuck characters into a view of (source offset, instruction) pairs. Comments
+  // are dropped, except newlines, which come through as a nop with operand 1 so that translate can
+  // record line starts.
+  constexpr auto make_compile_program_view(rng::input_range auto const& program, std::size_t base = 0) {
   return vws::zip_transform(
-             [](auto const&, auto input) {
+             [base](auto const& index, auto input) {
+               auto const offset = static_cast<std::uint32_t>(base + index);
                switch (input) {
                  case '>':
-                   return inst_t{inst_t::op_code_t::mpadd, 1};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::mpadd, 1}};
                  case '<':
-                   return inst_t{inst_t::op_code_t::mpadd, -1};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::mpadd, -1}};
 
                  case '+':
-                   return inst_t{inst_t::op_code_t::add, 1};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::add, 1}};
 
                  case '-':
-                   return inst_t{inst_t::op_code_t::add, -1};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::add, -1}};
 
                  case '.':
-                   return inst_t{inst_t::op_code_t::out, 0};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::out, 0}};
 
                  case ',':
-                   return inst_t{inst_t::op_code_t::in, 0};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::in, 0}};
 
                  case '[':
-                   return inst_t{inst_t::op_code_t::jmpz, 0};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::jmpz, 0}};
 
                  case ']':
-                   return inst_t{inst_t::op_code_t::jmpnz, 0};
+                   return std::pair{offset, inst_t{inst_t::op_code_t::jmpnz, 0}};
+
+                 case '\n':
+                   return std::pair{offset, inst_t{inst_t::op_code_t::nop, 1}};
                }
-               return inst_t{inst_t::op_code_t::nop, 0};
+               return std::pair{offset, inst_t{inst_t::op_code_t::nop, 0}};
              },
              vws::iota(std::size_t{0}), program) |
-         vws::filter([](auto const& i) { return i.opcode != inst_t::op_code_t::nop; });
+         vws::filter([](auto const& located) {
+           return located.second.opcode != inst_t::op_code_t::nop or located.second.operand != 0;
+         });
 }
 
-// Populate jump targets by pairing brackets.
-void resolve_jumps(std::vector<inst_t>& bytecodes);
+// Append one instruction, merging it into the previous one when both belong to the same
+// run of add or mpadd instructions (the rewrite done by optimize_bytecodes_opt1). Returns true
+// when it was merged.
+constexpr bool append_collapsed(std::vector<inst_t>& bytecodes, inst_t const& inst) {
+  if (!bytecodes.empty() and bytecodes.back().opcode == inst.opcode
+      and (inst.opcode == inst_t::op_code_t::mpadd or inst.opcode == inst_t::op_code_t::add)) {
+    bytecodes.back().operand += inst.operand;
+    return true;
+  }
+  bytecodes.push_back(inst);
+  return false;
+}
+
+// Translate source characters and append them to bytecodes, collapsing runs on the fly when
+// requested so the unoptimized bytecode is never materialized. base is the source offset of the
+// first character. When map is given it receives the span of every appended instruction and the
+// line starts. Returns the number of op codes read.
+constexpr std::size_t translate(rng::input_range auto const& program, std::vector<inst_t>& bytecodes, bool collapse,
+                                std::size_t base = 0, source_map_t* map = nullptr) {
+  std::size_t op_codes{0};
+  for (auto const& [offset, inst] : make_compile_program_view(program, base)) {
+    if (inst.opcode == inst_t::op_code_t::nop) {
+      if (map != nullptr) {
+        map->lines.push_back(offset + 1);
+      }
+      continue;
+    }
+    ++op_codes;
+    auto const merged = collapse ? append_collapsed(bytecodes, inst) : (bytecodes.push_back(inst), false);
+    if (map == nullptr) {
+      continue;
+    }
+    if (merged) {
+      map->end.back() = offset + 1;
+    } else {
+      map->push_back(offset, offset + 1);
+    }
+  }
+  return op_codes;
+}
+
+// Run optimization passes 2 and up on translated bytecode and resolve jumps, with optimize_fused.
+// map, when given, holds the spans of the translated bytecode and is rewritten along with it.
+std::vector<inst_t> optimize_and_resolve(std::vector<inst_t> bytecodes, std::size_t op_codes, size_t optims,
+                                         source_map_t* map);
+
+// Report an unmatched closing bracket at source position at, or count unmatched opening brackets, the
+// outermost at source position outermost.
+[[noreturn]] void throw_unmatched_close(source_map_t::position_t at);
+[[noreturn]] void throw_unmatched_open(source_map_t::position_t outermost, std::size_t count);
+
+// Pairs the brackets of source fed in chunks and throws at the first unmatched one, by line and column,
+// with memory bounded by the nesting depth. Locates bracket errors when no source map was kept.
+class BracketChecker {
+ public:
+  void feed(rng::input_range auto const& chunk) {
+    for (char const c : chunk) {
+      if (c == '[') {
+        open_.push_back(at_);
+      } else if (c == ']') {
+        if (open_.empty()) {
+          throw_unmatched_close(at_);
+        }
+        open_.pop_back();
+      }
+      if (c == '\n') {
+        ++at_.line;
+        at_.column = 1;
+      } else {
+        ++at_.column;
+      }
+    }
+  }
+
+  void finish() const {
+    if (!open_.empty()) {
+      throw_unmatched_open(open_.front(), open_.size());
+    }
+  }
+
+ private:
+  source_map_t::position_t at_;
+  std::vector<source_map_t::position_t> open_;
+};
+
+// All of levels 2 and up and jump resolution in a single scan that writes over bytecodes, with no
+// allocation per loop. Produces the same bytecode and spans as optimize_chained; map, when it holds
+// the spans of bytecodes, is rewritten in place too.
+void optimize_fused(std::vector<inst_t>& bytecodes, std::size_t optims, source_map_t* map = nullptr);
+
+// Reference pipeline: the separate passes below, one after the other, then resolve_jumps.
+std::vector<inst_t> optimize_chained(std::vector<inst_t> bytecodes, size_t optims, source_map_t* map = nullptr);
+
+// Report an unmatched closing bracket at instruction i, or the unmatched opening brackets left in open
+// (by source position when map covers them). Not constexpr: in a constant evaluation the call itself
+// is the compile error.
+[[noreturn]] void throw_unmatched_close(source_map_t const* map, std::size_t i);
+[[noreturn]] void throw_unmatched_open(source_map_t const* map, std::vector<std::size_t> const& open);
+
+// Populate jump targets by pairing brackets. Unmatched brackets are reported by source line and
+// column when map holds the spans of bytecodes, otherwise by instruction index.
+constexpr void resolve_jumps(std::vector<inst_t>& bytecodes, source_map_t const* map = nullptr) {
+  auto const program_size = bytecodes.size();
+  std::vector<std::size_t> loop_stack;
+  auto const* const spans = map != nullptr and map->size() == program_size ? map : nullptr;
+
+  for (std::size_t i = 0; i < program_size; ++i) {
+    auto const inst = bytecodes[i];
+    if (inst.opcode == inst_t::op_code_t::jmpz) {
+      loop_stack.push_back(i);
+    } else if (inst.opcode == inst_t::op_code_t::jmpnz) {
+      if (loop_stack.empty()) {
+        throw_unmatched_close(spans, i);
+      }
+      auto const match = loop_stack.back();
+      loop_stack.pop_back();
+      bytecodes[match].operand = static_cast<std::int32_t>(i);
+      bytecodes[i].operand = static_cast<std::int32_t>(match);
+    }
+  }
+
+  if (!loop_stack.empty()) {
+    throw_unmatched_open(spans, loop_stack);
+  }
+}
+
+// The passes below rewrite map, when given, to the spans of the bytecode they return.
+
+// Install the spans rebuilt by a pass; line starts do not change.
+constexpr void replace_spans(source_map_t* map, source_map_t&& spans) {
+  if (map != nullptr) {
+    spans.lines = std::move(map->lines);
+    *map = std::move(spans);
+  }
+}
 
 // Collapse runs of pointer/memory arithmetic into single instructions.
-std::vector<inst_t> optimize_bytecodes_opt1(std::vector<inst_t> const& bytecodes);
+constexpr std::vector<inst_t> optimize_bytecodes_opt1(std::vector<inst_t> const& bytecodes,
+                                                      source_map_t* map = nullptr) {
+  constexpr auto collapsable = [](inst_t const& i) {
+    return (i.opcode == inst_t::op_code_t::mpadd) or (i.opcode == inst_t::op_code_t::add);
+  };
+  constexpr auto inst_of = [](auto const& i_k) { return std::get<0>(i_k); };
+  constexpr auto index_of = [](auto const& i_k) { return std::get<1>(i_k); };
 
-// Replace canonical zeroing loops like [-] with set instructions.
-std::vector<inst_t> optimize_bytecodes_opt2(std::vector<inst_t> const& bytecodes);
+  auto chunks = vws::zip(bytecodes, vws::iota(std::size_t{0})) |
+                vws::chunk_by([inst_of, collapsable](auto const& i, auto const& j) {
+                  return (inst_of(i).opcode == inst_of(j).opcode) and (collapsable(inst_of(i)));
+                });
+  std::vector<inst_t> bytecodes_opt;
+  source_map_t spans;
+  for (auto const chunk : chunks) {
+    bytecodes_opt.push_back(*rng::fold_left_first(
+        chunk | vws::transform(inst_of),
+        [](auto const& acum, auto const& i) { return inst_t{acum.opcode, acum.operand + i.operand}; }));
+    if (map != nullptr) {
+      spans.push_back(map->begin[index_of(chunk.front())], map->end[index_of(chunk.back())]);
+    }
+  }
+  replace_spans(map, std::move(spans));
 
+  return bytecodes_opt;
+}
+
+// Return the nesting depth for each instruction in a program.
+constexpr std::vector<std::size_t> loop_depths(std::vector<inst_t> const& prg) {
+  std::size_t depth{0};
+  auto depth_inc = [&depth](auto const& i) {
+    auto ret = depth;
+    if (i.opcode == inst_t::op_code_t::jmpz) {
+      ++depth;
+      ret = depth;
+    } else if (i.opcode == inst_t::op_code_t::jmpnz) {
+      --depth;
+    }
+    return ret;
+  };
+
+  std::vector<std::size_t> ret;
+  rng::copy(prg | vws::transform(depth_inc), std::back_inserter(ret));
+  return ret;
+}
 
-// Dump bytecode instructions with indentation reflecting loop nesting.
-inline void print_bytecodes(std::vector<inst_t> const& bytecodes, std::ostream& os = std::cout) {
+// Replace canonical zeroing loops like [-] with set instructions and [>] / [<] with scans.
+constexpr std::vector<inst_t> optimize_bytecodes_opt2(std::vector<inst_t> const& bytecodes,
+                                                      source_map_t* map = nullptr) {
+  constexpr auto chunk_by_depth = [](auto const& k_d1, auto const& k_d2) {
+    auto [_k1, d1] = k_d1;
+    auto [_k2, d2] = k_d2;
+
+    return d1 == d2;
+  };
+
+  constexpr auto reduce_loop = [](auto const&& loop) {
+    if (rng::distance(loop) == 3
+        and loop[0].opcode == inst_t::op_code_t::jmpz
+        and loop[1].opcode == inst_t::op_code_t::add and loop[1].operand == -1
+        and loop[2].opcode == inst_t::op_code_t::jmpnz
+      ) {
+      std::vector<inst_t> loop_opt;
+      loop_opt.emplace_back(inst_t{inst_t::op_code_t::set, 0});
+      return loop_opt;
+    } else if (rng::distance(loop) == 3
+        and loop[0].opcode == inst_t::op_code_t::jmpz
+        and loop[1].opcode == inst_t::op_code_t::mpadd
+        and loop[2].opcode == inst_t::op_code_t::jmpnz
+      ) {
+      std::vector<inst_t> loop_opt;
+      loop_opt.emplace_back(inst_t{inst_t::op_code_t::scan, loop[1].operand});
+      return loop_opt;
+    } else {
+      std::vector<inst_t> loop_copy(loop.begin(), loop.end());
+      return loop_copy;
+    }
+  };
+
+  // chunks of instruction indices at the same depth
+  auto chunks = vws::zip(vws::iota(std::size_t{0}), loop_depths(bytecodes)) | vws::chunk_by(chunk_by_depth);
+
+  std::vector<inst_t> bytecodes_opt;
+  source_map_t spans;
+  for (auto const chunk : chunks) {
+    auto const first = std::get<0>(chunk.front());
+    auto const last = std::get<0>(chunk.back());
+    auto const reduced = reduce_loop(chunk | vws::transform([&bytecodes](auto const& k_d) {
+                                       auto [k, _d] = k_d;
+                                       return bytecodes[k];
+                                     }));
+    rng::copy(reduced, std::back_inserter(bytecodes_opt));
+    if (map == nullptr) {
+      continue;
+    }
+    if (reduced.size() == last + 1 - first) {  // copied as is
+      for (auto k = first; k <= last; ++k) {
+        spans.push_back(map->begin[k], map->end[k]);
+      }
+    } else {
+      spans.push_back(map->begin[first], map->end[last]);
+    }
+  }
+  replace_spans(map, std::move(spans));
+
+  return bytecodes_opt;
+}
+
+// Replace balanced copy/multiply loops like [->+>++<<] with mul and set instructions.
+std::vector<inst_t> optimize_bytecodes_opt3(std::vector<inst_t> const& bytecodes, source_map_t* map = nullptr);
+
+// Turn pointer moves inside straight-line code into per-instruction memory offsets.
+std::vector<inst_t> optimize_bytecodes_opt4(std::vector<inst_t> const& bytecodes, source_map_t* map = nullptr);
+
+// Drop loops whose entry cell is provably zero, by constant propagation through straight-line code
+// from the zero tape at the start of the program. Jump operands are ignored; resolve them afterwards.
+std::vector<inst_t> optimize_bytecodes_opt5(std::vector<inst_t> const& bytecodes, source_map_t* map = nullptr);
+
+// Dump bytecode instructions with indentation reflecting loop nesting. With counts (one per
+// instruction) every line starts with its execution count; first is the index of bytecodes[0] in the
+// whole program, for printing a slice.
+inline void print_bytecodes(std::span<inst_t const> bytecodes, std::ostream& os = std::cout,
+                            std::span<std::uint64_t const> counts = {}, std::size_t first = 0) {
   auto opcode_name = [](inst_t::op_code_t opcode) -> std::string_view {
     switch (opcode) {
       case inst_t::op_code_t::nop:
@@ -77,6 +377,12 @@ inline void print_bytecodes(std::vector<inst_t> const& bytecodes, std::ostream&
         return "out";
       case inst_t::op_code_t::set:
         return "set";
+      case inst_t::op_code_t::mul:
+        return "mul";
+      case inst_t::op_code_t::scan:
+        return "scan";
+      case inst_t::op_code_t::super:
+        return "super";
     }
     return "unknown";
   };
@@ -89,11 +395,21 @@ inline void print_bytecodes(std::vector<inst_t> const& bytecodes, std::ostream&
       indent = std::max(indent - 1, 0);
     }
 
+    if (!counts.empty()) {
+      os << std::setw(14) << counts[idx] << "  ";
+    }
     for (int i = 0; i < indent; ++i) {
       os << "  ";
     }
 
-    os << '[' << idx << "] " << opcode_name(inst.opcode) << ' ' << inst.operand << '\n';
+    os << '[' << first + idx << "] " << opcode_name(bfsuper::plain(inst.opcode)) << ' ' << inst.operand;
+    if (inst.offset != 0) {
+      os << " @" << inst.offset;
+    }
+    if (bfsuper::is_super(inst.opcode)) {
+      os << " (super " << bfsuper::index(inst.opcode) << ')';
+    }
+    os << '\n';
 
     if (inst.opcode == inst_t::op_code_t::jmpz) {
       ++indent;
@@ -103,26 +419,74 @@ inline void print_bytecodes(std::vector<inst_t> const& bytecodes, std::ostream&
 
 } // namespace bfcompiler_internal
 
-// Compile a Brainfuck program into optimized bytecode.
-std::vector<inst_t> compile(rng::input_range auto const& program, size_t optims=2) {
-
-  auto compile_program = bfcompiler_internal::make_compile_program_view(program);
+// Compile a Brainfuck program into optimized bytecode (levels 0-5; see optimize_and_resolve).
+// The passes only assume that cell arithmetic wraps modulo some power of two: operands are never
+// reduced modulo 256 ([-] reaches zero, and a mul loop with a -1 counter runs value times, at any
+// width), so the same bytecode is valid for 8, 16 and 32-bit cells.
+// When map is given it receives the source spans (see source_map_t). Without it no spans are kept, and
+// an unmatched bracket is located by reading the source again, so it is still reported by line and
+// column when program can be traversed twice.
+std::vector<inst_t> compile(rng::input_range auto const& program, size_t optims=2, source_map_t* map = nullptr) {
 
+  if (map != nullptr) {
+    map->clear();
+  }
   std::vector<inst_t> bytecodes;
-  rng::copy(compile_program, std::back_inserter(bytecodes)); // for lack of rng::to()
-  std::cout << "Compiled program: " << rng::size(bytecodes) << " op codes\n";
+  auto const op_codes = bfcompiler_internal::translate(program, bytecodes, optims > 0, 0, map);
 
-  if (optims>0) {
-    bytecodes = bfcompiler_internal::optimize_bytecodes_opt1(bytecodes);
-    std::cout << "Optimization 1: " << rng::size(bytecodes) << " op codes\n";
+  if constexpr (rng::forward_range<decltype(program)>) {
+    if (map == nullptr) {
+      try {
+        return bfcompiler_internal::optimize_and_resolve(std::move(bytecodes), op_codes, optims, nullptr);
+      } catch (std::runtime_error const&) {
+        bfcompiler_internal::BracketChecker brackets;
+        brackets.feed(program);
+        brackets.finish();
+        throw;
+      }
+    }
   }
-  if (optims>1) {
-    bytecodes = bfcompiler_internal::optimize_bytecodes_opt2(bytecodes);
-    std::cout << "Optimization 2: " << rng::size(bytecodes) << " op codes\n";
+  return bfcompiler_internal::optimize_and_resolve(std::move(bytecodes), op_codes, optims, map);
+}
+
+// Evaluate the start of a compiled program on the zero tape and remove it from bytecodes (and map):
+// the returned state is where the rest of the program starts (BasicBrainFckVM::set_initial_state).
+// Evaluation stops at I/O, at a loop whose cell is not provably zero (or whose value depends on the
+// cell width), at a scan that passes a cell zero only at some widths, and before the pointer would leave
+// [0, tape_cells), so the state is valid under every tape policy and cell width.
+bftape::initial_t fold_prefix(std::vector<inst_t>& bytecodes, std::size_t tape_cells = bftape::default_size,
+                              source_map_t* map = nullptr);
+
+// Compile a program read from a stream in fixed-size chunks, so that memory use follows
+// the bytecode size rather than the source size.
+inline std::vector<inst_t> compile_stream(std::istream& is, size_t optims = 2,
+                                          std::size_t chunk_size = std::size_t{1} << 20, source_map_t* map = nullptr) {
+  if (map != nullptr) {
+    map->clear();
   }
-  //bfcompiler_internal::print_bytecodes(bytecodes);
-  bfcompiler_internal::resolve_jumps(bytecodes);
+  // without spans, brackets are checked as the source goes by: the stream cannot be read again
+  bfcompiler_internal::BracketChecker brackets;
+  std::vector<inst_t> bytecodes;
+  std::string chunk(chunk_size, '\0');
+  std::size_t op_codes{0};
+  std::size_t base{0};
 
+  while (is) {
+    is.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    auto const n = static_cast<std::size_t>(is.gcount());
+    if (n == 0) {
+      break;
+    }
+    std::string_view const text{chunk.data(), n};
+    if (map == nullptr) {
+      brackets.feed(text);
+    }
+    op_codes += bfcompiler_internal::translate(text, bytecodes, optims > 0, base, map);
+    base += n;
+  }
+  if (map == nullptr) {
+    brackets.finish();
+  }
 
-  return bytecodes;
+  return bfcompiler_internal::optimize_and_resolve(std::move(bytecodes), op_codes, optims, map);
 }
@@ -0,0 +1,236 @@
+#pragma once
+#include "bfcompiler.hpp"
+#include "bfio.hpp"
+#include "bfscan.hpp"
+#include "bfsuper.hpp"
+#include "bftape.hpp"
+#include "bytecode.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Brainfuck programs embedded in C++ and compiled with it. The source is a template argument:
+//
+//   constexpr auto& code = bfembed::bytecode<"++++++++[>++++++++<-]>+.">;  // std::array<inst_t, N>
+//   static_assert(bfembed::output<"++++++++[>++++++++<-]>+."> == "A");    // evaluated by the compiler
+//   bfembed::run<",[.,]">(std::cin, std::cout);                             // unrolled into C++ loops
+//
+// Levels 0-2 are available (translation, run collapsing, [-] and scans): the later passes are not
+// constexpr. An unmatched bracket is a compile error naming throw_unmatched_open or throw_unmatched_close.
+namespace bfembed {
+
+// A string literal as a template argument.
+template <std::size_t N>
+struct source_t {
+  constexpr source_t(char const (&text)[N]) { std::copy_n(text, N, chars); }
+
+  constexpr std::string_view view() const { return {chars, N - 1}; }
+
+  char chars[N]{};
+};
+
+// compile() for constant evaluation: the same bytecode at levels 0-2, without the report or spans.
+constexpr std::vector<inst_t> compile(std::string_view source, std::size_t optims = 2) {
+  if (optims > 2) {
+    throw std::invalid_argument("bfembed::compile supports levels 0-2");
+  }
+  std::vector<inst_t> bytecodes;
+  bfcompiler_internal::translate(source, bytecodes, optims > 0);
+  if (optims > 1) {
+    bytecodes = bfcompiler_internal::optimize_bytecodes_opt2(bytecodes);
+  }
+  bfcompiler_internal::resolve_jumps(bytecodes);
+  return bytecodes;
+}
+
+// The compiled program as an array baked into the binary; the VMs run it like compile()'s vector.
+template <source_t Source, std::size_t Optims = 2>
+inline constexpr auto bytecode = [] {
+  static_assert(Optims <= 2, "bfembed supports levels 0-2");
+  std::array<inst_t, compile(Source.view(), Optims).size()> code{};
+  std::ranges::copy(compile(Source.view(), Optims), code.begin());
+  return code;
+}();
+
+// Run an input-free program in a constant expression and return what it prints, on a zero tape of
+// tape_cells cells that wrap around like the VM's default tape. Reading input or a scan that can never
+// stop is a compile error when constant-evaluated (and std::runtime_error otherwise). Long programs may
+// need a higher -fconstexpr-ops-limit (GCC) or -fconstexpr-steps (Clang).
+template <typename Cell = std::uint8_t>
+constexpr std::string evaluate(std::span<inst_t const> program, std::size_t tape_cells = bftape::default_size) {
+  std::vector<Cell> memory(tape_cells);
+  std::string text;
+  auto const at = [tape_cells](std::size_t mp, std::ptrdiff_t delta) {
+    auto const size = static_cast<std::ptrdiff_t>(tape_cells);
+    auto const next = (static_cast<std::ptrdiff_t>(mp) + delta % size + size) % size;
+    return static_cast<std::size_t>(next);
+  };
+  std::size_t pc = 0;
+  std::size_t mp = 0;
+  // GCC caps the iterations of one constant-evaluated loop (-fconstexpr-loop-limit, 2^18 by default),
+  // so instructions run in rounds of at most 2^16.
+  while (pc < program.size()) {
+    for (std::size_t round = 0; round < (std::size_t{1} << 16) and pc < program.size(); ++round, ++pc) {
+      auto const inst = program[pc];
+      auto& cell = memory[at(mp, inst.offset)];
+      switch (bfsuper::plain(inst.opcode)) {
+        case inst_t::op_code_t::mpadd:
+          mp = at(mp, inst.operand);
+          break;
+        case inst_t::op_code_t::add:
+          cell = static_cast<Cell>(cell + static_cast<Cell>(inst.operand));
+          break;
+        case inst_t::op_code_t::jmpz:
+          if (memory[mp] == 0) {
+            pc = static_cast<std::size_t>(inst.operand);
+          }
+          break;
+        case inst_t::op_code_t::jmpnz:
+          if (memory[mp] != 0) {
+            pc = static_cast<std::size_t>(inst.operand);
+          }
+          break;
+        case inst_t::op_code_t::in:
+          throw std::runtime_error("bfembed::evaluate runs input-free programs only");
+        case inst_t::op_code_t::out:
+          text.push_back(static_cast<char>(cell));
+          break;
+        case inst_t::op_code_t::set:
+          cell = static_cast<Cell>(inst.operand);
+          break;
+        case inst_t::op_code_t::mul:
+          cell = static_cast<Cell>(cell + static_cast<std::uint32_t>(memory[mp]) *
+                                              static_cast<std::uint32_t>(inst.operand));
+          break;
+        case inst_t::op_code_t::scan:
+          for (std::size_t steps = 0; memory[mp] != 0; ++steps) {
+            if (steps == tape_cells) {
+              throw std::runtime_error("Scan never finds a zero cell");
+            }
+            mp = at(mp, inst.operand);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  return text;
+}
+
+namespace bfembed_internal {
+
+inline constexpr std::size_t top = std::numeric_limits<std::size_t>::max();
+
+// loops[i]: the jmpz of the innermost loop around instruction i (its jmpnz included), or top.
+template <std::size_t N>
+constexpr std::array<std::size_t, N> enclosing_loops(std::array<inst_t, N> const& code) {
+  std::array<std::size_t, N> loops{};
+  std::vector<std::size_t> open;
+  for (std::size_t i = 0; i < N; ++i) {
+    loops[i] = open.empty() ? top : open.back();
+    if (code[i].opcode == inst_t::op_code_t::jmpz) {
+      open.push_back(i);
+    } else if (code[i].opcode == inst_t::op_code_t::jmpnz) {
+      loops[i] = open.back();
+      open.pop_back();
+    }
+  }
+  return loops;
+}
+
+template <typename Cell>
+struct machine_t {
+  Cell* memory;
+  std::size_t mp;
+  bftape::Tape& tape;
+  bfio::Input& in;
+  bfio::Output& out;
+};
+
+// Source as C++: each loop a while statement over its body, each other instruction inlined with its
+// operands as constants.
+template <source_t Source, std::size_t Optims>
+struct Unrolled {
+  static constexpr auto const& code = bytecode<Source, Optims>;
+  static constexpr auto loops = enclosing_loops(code);
+
+  // The instructions in [First, First + sizeof...(I)) directly inside Loop, in order.
+  template <std::size_t Loop, std::size_t First, typename Cell, std::size_t... I>
+  static void block(machine_t<Cell>& m, std::index_sequence<I...>) {
+    (step<Loop, First + I>(m), ...);
+  }
+
+  template <std::size_t Loop, std::size_t I, typename Cell>
+  static void step(machine_t<Cell>& m) {
+    if constexpr (loops[I] == Loop) {
+      constexpr inst_t inst = code[I];
+      auto& memory = m.memory;
+      if constexpr (inst.opcode == inst_t::op_code_t::jmpz) {
+        constexpr auto close = static_cast<std::size_t>(inst.operand);
+        while (memory[m.mp] != 0) {
+          block<I, I + 1>(m, std::make_index_sequence<close - I - 1>{});
+        }
+      } else if constexpr (inst.opcode == inst_t::op_code_t::mpadd) {
+        m.mp = m.tape.move(m.mp, inst.operand);
+      } else if constexpr (inst.opcode == inst_t::op_code_t::add) {
+        auto& cell = memory[m.tape.move(m.mp, inst.offset)];
+        cell = static_cast<Cell>(cell + static_cast<Cell>(inst.operand));
+      } else if constexpr (inst.opcode == inst_t::op_code_t::in) {
+        auto const value = m.in.get(m.out);
+        memory[m.tape.move(m.mp, inst.offset)] = value == bfio::eof ? Cell{0} : static_cast<Cell>(value);
+      } else if constexpr (inst.opcode == inst_t::op_code_t::out) {
+        m.out.put(static_cast<std::uint8_t>(memory[m.tape.move(m.mp, inst.offset)]));
+      } else if constexpr (inst.opcode == inst_t::op_code_t::set) {
+        memory[m.tape.move(m.mp, inst.offset)] = static_cast<Cell>(inst.operand);
+      } else if constexpr (inst.opcode == inst_t::op_code_t::scan) {
+        auto const next = m.tape.template scan<Cell>(m.mp, inst.operand);
+        if (next == bfscan::npos) {
+          throw std::runtime_error("Scan never finds a zero cell");
+        }
+        m.mp = next;
+      }
+    }
+  }
+};
+
+} // namespace bfembed_internal
+
+// What an input-free program prints, computed while compiling the C++ that uses it.
+template <source_t Source, std::size_t Optims = 2>
+inline constexpr auto output_chars = [] {
+  constexpr auto const& program = bytecode<Source, Optims>;
+  static_assert(std::ranges::none_of(program, [](inst_t const& inst) { return inst.opcode == inst_t::op_code_t::in; }),
+                "bfembed::output needs an input-free program");
+  std::array<char, evaluate(program).size()> chars{};
+  std::ranges::copy(evaluate(program), chars.begin());
+  return chars;
+}();
+
+template <source_t Source, std::size_t Optims = 2>
+inline constexpr std::string_view output{output_chars<Source, Optims>.data(), output_chars<Source, Optims>.size()};
+
+// Run Source with its instructions expanded at compile time into nested C++ loops: there is no
+// bytecode and no dispatch at run time. Deeply nested or very long programs are limited by the
+// compiler's template depth; run bytecode<Source> on the VM instead.
+template <source_t Source, std::size_t Optims = 2, typename Cell = std::uint8_t>
+void run(std::istream& in, std::ostream& out, bftape::options_t options = {}) {
+  using unrolled = bfembed_internal::Unrolled<Source, Optims>;
+  bftape::Tape tape{bftape::for_cell<Cell>(options)};
+  bfio::Output buffered_out{out};
+  bfio::Input buffered_in{in};
+  bfembed_internal::machine_t<Cell> machine{tape.cells<Cell>(), 0, tape, buffered_in, buffered_out};
+  unrolled::template block<bfembed_internal::top, 0>(machine, std::make_index_sequence<unrolled::code.size()>{});
+}
+
+} // namespace bfembed
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace bfio {
+
+inline constexpr int eof = -1;
+// Returned by Input::try_get when a non-blocking descriptor has nothing to read yet.
+inline constexpr int would_block = -2;
+
+// True when fd refers to a terminal, i.e. reads on it wait for a user.
+bool is_interactive(int fd);
+
+// Buffered byte sink over a raw file descriptor or an ostream. Engines constructed from descriptors
+// write through one directly, bypassing iostreams.
+// Bytes are handed to the destination when the buffer fills, on flush() and on destruction. A
+// non-blocking descriptor takes what it can and the rest stays buffered for the next flush.
+class Output {
+ public:
+  static constexpr std::size_t buffer_size = std::size_t{1} << 16;
+
+  explicit Output(int fd, std::size_t capacity = buffer_size) : buffer_(capacity), fd_{fd} {}
+  explicit Output(std::ostream& os) : buffer_(buffer_size), os_{&os} {}
+  ~Output() { flush(); }
+
+  Output(Output const&) = delete;
+  Output& operator=(Output const&) = delete;
+
+  void put(std::uint8_t value) {
+    if (pos_ == buffer_.size()) {
+      make_room();
+    }
+    buffer_[pos_++] = static_cast<char>(value);
+  }
+
+  // Buffered like put() when it fits, otherwise handed to the destination in one call.
+  void write(std::string_view bytes);
+
+  void flush();
+
+  // True when put() has room without blocking: the buffer has space, or a flush made some.
+  bool try_reserve() { return pos_ < buffer_.size() or (flush(), pos_ < buffer_.size()); }
+
+  // Bytes buffered and not yet taken by the destination.
+  std::size_t pending() const { return pos_; }
+
+  // Bytes written so far, buffered ones included.
+  std::uint64_t written() const { return sent_ + pos_; }
+
+ private:
+  // Flush, and grow the buffer when a non-blocking descriptor took nothing (callers that must not grow
+  // it check try_reserve() first).
+  void make_room();
+  // Returns the bytes that left: all of them, except what a non-blocking descriptor refused.
+  std::size_t send(char const* data, std::size_t size);
+
+  std::vector<char> buffer_;
+  std::size_t pos_{0};
+  std::uint64_t sent_{0};  // bytes that left the buffer
+  int fd_{-1};
+  std::ostream* os_{nullptr};
+};
+
+// Buffered byte source over a raw file descriptor or an istream.
+// A tied Output is flushed before any read that may block, so prompts appear before input is awaited;
+// engines tie it for descriptors that are terminals (is_interactive).
+class Input {
+ public:
+  static constexpr std::size_t buffer_size = std::size_t{1} << 16;
+
+  // With an fd, tie_output selects whether pending output is flushed before each blocking read
+  // (use it when the input is interactive, e.g. isatty()).
+  explicit Input(int fd, bool tie_output = false, std::size_t capacity = buffer_size)
+    : buffer_(capacity), fd_{fd}, tie_output_{tie_output} {}
+  // Stream input is consumed through its streambuf one byte at a time, so nothing is read
+  // ahead of what the program asks for (the REPL shares std::cin with running programs).
+  explicit Input(std::istream& is) : buffer_(1), is_{&is} {}
+
+  Input(Input const&) = delete;
+  Input& operator=(Input const&) = delete;
+
+  // Next byte, or eof.
+  int get(Output& tie) {
+    if (pos_ == end_ and !refill(tie)) {
+      return eof;
+    }
+    return static_cast<unsigned char>(buffer_[pos_++]);
+  }
+
+  // get(), or would_block when a non-blocking descriptor has no byte ready.
+  int try_get(Output& tie) {
+    if (pos_ == end_ and !refill(tie)) {
+      return blocked_ ? would_block : eof;
+    }
+    return static_cast<unsigned char>(buffer_[pos_++]);
+  }
+
+  // Bytes returned by get() so far.
+  std::uint64_t consumed() const { return filled_ - (end_ - pos_); }
+
+  // Consume up to count bytes, e.g. the input a restored run had already read; returns how many there were.
+  std::uint64_t skip(std::uint64_t count, Output& tie);
+
+ private:
+  bool refill(Output& tie);
+
+  std::vector<char> buffer_;
+  std::size_t pos_{0};
+  std::size_t end_{0};
+  std::uint64_t filled_{0};  // bytes read into the buffer
+  int fd_{-1};
+  std::istream* is_{nullptr};
+  bool tie_output_{false};
+  bool blocked_{false};  // the last refill found a non-blocking descriptor empty
+};
+
+} // namespace bfio
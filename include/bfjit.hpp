@@ -0,0 +1,68 @@
+#pragma once
+#include "bfio.hpp"
+#include "bftape.hpp"
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace bfjit_internal {
+
+// Owns a block of mmap'd memory that holds generated machine code.
+class CodeBuffer {
+ public:
+  explicit CodeBuffer(std::vector<std::uint8_t> const& code);
+  ~CodeBuffer();
+
+  CodeBuffer(CodeBuffer const&) = delete;
+  CodeBuffer& operator=(CodeBuffer const&) = delete;
+
+  void const* entry() const { return memory_; }
+
+ private:
+  void* memory_{nullptr};
+  std::size_t size_{0};
+};
+
+// Translate bytecode into x86-64 machine code (System V calling convention).
+// The generated function has the signature void(std::uint8_t* tape, void* context)
+// and calls out_fn(context, value) / in_fn(context) for I/O.
+std::vector<std::uint8_t> emit_x86_64(std::span<inst_t const> program, std::size_t memory_size,
+                                      void const* out_fn, void const* in_fn);
+
+} // namespace bfjit_internal
+
+// Native execution engine: compiles bytecode to machine code and runs it directly.
+class BrainFckJIT {
+ public:
+  // Generated code inlines the wrap-around and byte arithmetic, so only the wrap tape policy with
+  // 8-bit cells is supported (std::runtime_error otherwise).
+  explicit BrainFckJIT(std::istream& in, std::ostream& out, bftape::options_t tape = {})
+    : tape_{checked(tape)}, out_(out), in_(in) {}
+
+  explicit BrainFckJIT(int in_fd, int out_fd, bftape::options_t tape = {})
+    : tape_{checked(tape)}, out_(out_fd), in_(in_fd, bfio::is_interactive(in_fd)) {}
+
+  // True when the host can execute code produced by this backend.
+  static bool supported();
+
+  void reset() {
+    tape_.clear();
+  }
+
+  void run(std::span<inst_t const> program);
+
+ private:
+  static bftape::options_t checked(bftape::options_t tape);
+
+  bftape::Tape tape_;
+
+  static void put_char(void* context, int value);
+  static int get_char(void* context);
+
+  bfio::Output out_;
+  bfio::Input in_;
+};
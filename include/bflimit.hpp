@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+// Execution limits for untrusted programs. Limited is a run() policy like bfprofile::Counter, but it is
+// consulted only on taken loop back-edges (and on a scan that finds no zero): code between two
+// back-edges is straight-line, so a program can only run long by taking them.
+namespace bflimit {
+
+enum class status_t {
+  completed,
+  out_of_fuel,
+  out_of_time,
+  interrupted,
+};
+
+std::string_view name(status_t status);
+
+struct limits_t {
+  // Steps the run may take. A back-edge costs the length of the loop it closes, so steps approximate
+  // the instructions executed by loops.
+  std::uint64_t fuel{std::numeric_limits<std::uint64_t>::max()};
+  std::chrono::nanoseconds time{0};  // wall clock from the start of the run; 0: none
+  std::atomic<bool> const* interrupt{nullptr};  // set from another thread or a signal handler to stop
+};
+
+struct result_t {
+  status_t status{status_t::completed};
+  std::uint64_t steps{0};
+};
+
+class Limited {
+ public:
+  // Fuel is handed to the hot path in slices of this many steps; the clock and the interrupt flag are
+  // looked at between slices, so they stop a run within about this many steps.
+  static constexpr std::uint64_t slice = std::uint64_t{1} << 16;
+
+  explicit Limited(limits_t const& limits);
+
+  constexpr bool count(std::size_t) const { return true; }
+
+  // Returned by refill to stop the run.
+  static constexpr std::uint64_t stop = std::numeric_limits<std::uint64_t>::max();
+
+  // The VM keeps the steps left in the current slice in a register, taken from left() when it starts and
+  // handed back with settle() when it stops. A back-edge of weight w takes w steps when they are left
+  // and calls refill otherwise, which returns the steps left after paying for it, or stop.
+  std::uint64_t left() const { return left_; }
+  void settle(std::uint64_t left) { left_ = left; }
+  std::uint64_t refill(std::uint64_t weight, std::uint64_t left);
+
+  // Why the run stopped, given whether it reached the end of the program.
+  result_t result(bool finished) const { return {finished ? status_t::completed : status_, steps()}; }
+
+  std::uint64_t steps() const { return steps_ + (loaded_ - left_); }
+
+ private:
+  std::uint64_t fuel_;  // not yet handed to the current slice
+  std::uint64_t loaded_{0};  // size of the current slice
+  std::uint64_t left_{0};    // steps left in it
+  std::uint64_t steps_{0};   // taken in earlier slices
+  bool timed_{false};
+  std::chrono::steady_clock::time_point deadline_;
+  std::atomic<bool> const* interrupt_;
+  status_t status_{status_t::completed};
+};
+
+} // namespace bflimit
@@ -0,0 +1,70 @@
+#pragma once
+#include "bfcompiler.hpp"
+#include "bfsuper.hpp"
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <vector>
+
+// Four-byte instructions, half the size of inst_t, so twice as many fit in a cache line:
+//
+//   bits   field
+//    0-4   opcode
+//   5-12   offset (signed)
+//  13-31   operand (signed, 19 bits); jumps store the distance to their target
+//
+// An instruction whose offset or operand does not fit is escaped: its offset field holds the escape
+// value and its operand the index of the full inst_t in a side table. Compiled programs rarely need it
+// (large counts and pointer moves, far jumps).
+namespace bfpacked {
+
+inline constexpr std::int32_t escape = -128;
+inline constexpr std::int32_t operand_min = -(1 << 18);
+inline constexpr std::int32_t operand_max = (1 << 18) - 1;
+static_assert(static_cast<unsigned>(bfsuper::last_opcode) < 32, "opcodes must fit in 5 bits");
+
+class Program {
+ public:
+  // Throws std::runtime_error when more than operand_max instructions need escaping.
+  explicit Program(std::span<inst_t const> program);
+
+  std::size_t size() const { return code_.size(); }
+
+  inst_t operator[](std::size_t i) const {
+    auto const bits = code_[i];
+    auto const offset = static_cast<std::int8_t>(bits >> 5);
+    auto const operand = static_cast<std::int32_t>(bits) >> 13;  // arithmetic: sign-extends
+    if (offset == escape) [[unlikely]] {
+      return wide_[static_cast<std::size_t>(operand)];
+    }
+    auto const op = static_cast<inst_t::op_code_t>(bits & 0x1f);
+    auto const jump = op == inst_t::op_code_t::jmpz or op == inst_t::op_code_t::jmpnz;
+    return {op, jump ? static_cast<std::int32_t>(i) + operand : operand, offset};
+  }
+
+  // The instructions as a random access range of inst_t, decoded as they are read; BasicBrainFckVM
+  // runs it like the vector it was packed from.
+  auto view() const {
+    return std::views::iota(std::size_t{0}, size()) |
+           std::views::transform([this](std::size_t i) { return (*this)[i]; });
+  }
+
+  std::vector<inst_t> unpack() const;
+
+  // Bytes of code and side table together.
+  std::size_t bytes() const { return code_.size() * sizeof(std::uint32_t) + wide_.size() * sizeof(inst_t); }
+  std::size_t escaped() const { return wide_.size(); }
+
+ private:
+  std::vector<std::uint32_t> code_;
+  std::vector<inst_t> wide_;
+};
+
+// compile() with packed output.
+inline Program compile_packed(std::ranges::input_range auto const& program, std::size_t optims = 2) {
+  return Program{compile(program, optims)};
+}
+
+} // namespace bfpacked
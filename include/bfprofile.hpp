@@ -0,0 +1,62 @@
+#pragma once
+#include "bytecode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+struct source_map_t;
+
+// Execution profiling for BasicBrainFckVM::run. The profiler is a template parameter of run(), so the
+// default Disabled policy leaves the interpreter loops exactly as they are without profiling.
+namespace bfprofile {
+
+// Policy used by run(program): the hook is empty and inlines to nothing. A policy's count(pc) returns
+// false to pause the run before instruction pc (see BasicBrainFckVM::resume).
+struct Disabled {
+  constexpr bool count(std::size_t) const { return true; }
+};
+
+// Counts executions per bytecode index.
+class Counter {
+ public:
+  explicit Counter(std::size_t program_size) : counts_(program_size, 0) {}
+
+  bool count(std::size_t pc) {
+    ++counts_[pc];
+    return true;
+  }
+
+  std::span<std::uint64_t const> counts() const { return counts_; }
+  std::uint64_t total() const;
+
+ private:
+  std::vector<std::uint64_t> counts_;
+};
+
+// One matched jmpz/jmpnz pair with its counts.
+struct loop_t {
+  std::size_t begin{0};  // bytecode index of the jmpz
+  std::size_t end{0};    // bytecode index of the matching jmpnz
+  std::size_t depth{0};  // 0 for outermost loops
+  std::size_t source_begin{0};  // source offsets of the brackets, when a source map is available
+  std::size_t source_end{0};
+  std::uint64_t entries{0};     // times the jmpz was reached
+  std::uint64_t iterations{0};  // times the jmpnz was reached, one per completed pass through the body
+  std::uint64_t executed{0};    // instructions executed inside the loop, brackets and nested loops included
+  std::uint64_t self{0};        // the part of executed that is not inside a nested loop
+};
+
+// Every loop of a resolved program, hottest first: by self count, so that a hot inner loop ranks
+// above the outer loops that contain it.
+std::vector<loop_t> loops(std::span<inst_t const> bytecodes, std::span<std::uint64_t const> counts,
+                          source_map_t const* map = nullptr);
+
+// Print the total, the top hot loops with their source offsets (and the loop text when source is
+// given), and each of those loops in the print_bytecodes layout with a count per instruction.
+void report(std::ostream& os, std::span<inst_t const> bytecodes, std::span<std::uint64_t const> counts,
+            source_map_t const* map = nullptr, std::string_view source = {}, std::size_t top = 10);
+
+} // namespace bfprofile
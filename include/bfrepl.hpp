@@ -0,0 +1,89 @@
+#pragma once
+#include "bfcompiler.hpp"
+#include "bftape.hpp"
+#include "bfvm.hpp"
+#include "bytecode.hpp"
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interactive sessions: every line runs on the tape and pointer the previous lines left.
+namespace bfrepl {
+
+// Lines are compiled at level 4, the highest one that makes no assumption about the tape a program
+// starts on (level 5 folds from a zero tape), and run on the threaded VM.
+inline constexpr std::size_t session_optims = 4;
+
+// Only the commands of a line, so lines that differ in comments or spacing share one cache entry.
+inline std::string commands(std::string_view line) {
+  std::string code;
+  for (auto const c : line) {
+    if (c == '>' or c == '<' or c == '+' or c == '-' or c == '.' or c == ',' or c == '[' or c == ']') {
+      code += c;
+    }
+  }
+  return code;
+}
+
+template <typename Cell = std::uint8_t>
+class BasicSession {
+ public:
+  static constexpr std::size_t default_cache_size = 1024;
+
+  // Input is read through the stream one byte at a time, so a program reading the terminal does not
+  // swallow the lines that follow it.
+  explicit BasicSession(std::istream& in, std::ostream& out, bftape::options_t tape = {},
+                        std::size_t cache_size = default_cache_size)
+    : vm_{in, out, BrainFckVMBase::dispatch_t::threaded, tape}, cache_size_{cache_size} {}
+
+  // Compile line, or take it from the cache, and run it. Throws std::runtime_error on unmatched
+  // brackets (nothing runs) or when the pointer leaves a non-wrapping tape (the tape keeps what the
+  // line did, the pointer goes back to where it started).
+  void run(std::string_view line) {
+    auto const& bytecodes = fragment(line);
+    if (!bytecodes.empty()) {
+      vm_.continue_with(bytecodes);
+    }
+  }
+
+  // Pointer and tape as the lines so far left them (see BasicBrainFckVM::state).
+  bftape::initial_t state() const { return vm_.state(); }
+
+  std::size_t hits() const { return hits_; }
+  std::size_t misses() const { return misses_; }
+  std::size_t cached() const { return cache_.size(); }
+
+ private:
+  std::vector<inst_t> const& fragment(std::string_view line) {
+    auto code = commands(line);
+    if (auto const it = cache_.find(code); it != cache_.end()) {
+      ++hits_;
+      return it->second;
+    }
+    ++misses_;
+    // compile() without its size report, which would land between the program's output; errors give
+    // the column in the line as typed
+    std::vector<inst_t> bytecodes;
+    source_map_t map;
+    bfcompiler_internal::translate(line, bytecodes, true, 0, &map);
+    bfcompiler_internal::optimize_fused(bytecodes, session_optims, &map);  // throws before the cache changes
+    if (cache_.size() >= cache_size_) {
+      cache_.clear();  // sessions rarely get here; starting over keeps the cache simple
+    }
+    return cache_.emplace(std::move(code), std::move(bytecodes)).first->second;
+  }
+
+  BasicBrainFckVM<Cell> vm_;
+  std::unordered_map<std::string, std::vector<inst_t>> cache_;
+  std::size_t cache_size_;
+  std::size_t hits_{0};
+  std::size_t misses_{0};
+};
+
+using Session = BasicSession<std::uint8_t>;
+
+} // namespace bfrepl
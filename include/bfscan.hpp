@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace bfscan {
+
+// Returned when no zero cell lies on the scanned orbit (the Brainfuck loop never ends).
+inline constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+// Execute [>]-style loops: step from start by stride cells, wrapping around a tape of
+// size cells, and return the first position holding zero (start itself included).
+std::size_t scan_zero(std::uint8_t const* tape, std::size_t size, std::size_t start, std::int32_t stride);
+
+// Same walk without wrapping: npos when the orbit steps outside [0, size) before reaching a zero.
+std::size_t scan_zero_linear(std::uint8_t const* tape, std::size_t size, std::size_t start, std::int32_t stride);
+
+} // namespace bfscan
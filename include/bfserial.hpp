@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// Encoding helpers shared by the on-disk formats (bytecode files, snapshots).
+namespace bfserial {
+
+template <typename T>
+void put_le(std::string& out, T value) {
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    out += static_cast<char>((static_cast<std::uint64_t>(value) >> (8 * i)) & 0xff);
+  }
+}
+
+// Reads sizeof(T) bytes from p (char or unsigned char), with no alignment requirement.
+template <typename T, typename Byte>
+T get_le(Byte const* p) {
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+  }
+  return static_cast<T>(value);
+}
+
+// FNV-1a 64: start from fnv_basis and mix in the low `bytes` bytes of each value, least significant first.
+constexpr std::uint64_t fnv_basis = 0xcbf29ce484222325ull;
+
+constexpr void fnv_mix(std::uint64_t& hash, std::uint64_t value, std::size_t bytes) {
+  for (std::size_t i = 0; i < bytes; ++i) {
+    hash = (hash ^ ((value >> (8 * i)) & 0xff)) * 0x100000001b3ull;
+  }
+}
+
+// Write bytes to a temporary file next to path and rename it into place, so readers see either the
+// previous file or the new one, never a partial write. Throws std::runtime_error when writing fails.
+void replace_file(std::filesystem::path const& path, std::string_view bytes);
+
+} // namespace bfserial
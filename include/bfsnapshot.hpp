@@ -0,0 +1,108 @@
+#pragma once
+#include "bftape.hpp"
+#include "bytecode.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Checkpoints of a running VM: the tape, pc and pointer as a start state plus how far the run had got
+// through its input and output, so a restored run reads and prints exactly what the original would have.
+//
+// On disk: a fixed 40-byte little-endian header followed by the state in the bytecode start state
+// encoding (see bfbytecode.hpp), which keeps only the range between the first and last nonzero cell.
+//
+//   offset  size  field
+//        0     8  magic "CCBFSS\0\0"
+//        8     2  format version
+//       10     6  reserved (zero)
+//       16     8  program hash
+//       24     8  input offset (bytes read)
+//       32     8  output offset (bytes written)
+namespace bfsnapshot {
+
+inline constexpr std::uint16_t format_version = 1;
+inline constexpr std::size_t header_size = 40;
+
+struct snapshot_t {
+  bftape::initial_t state;  // without output: that was written before the snapshot
+  std::uint64_t program_hash{0};
+  std::uint64_t input_offset{0};
+  std::uint64_t output_offset{0};
+};
+
+// FNV-1a 64 over the instructions with superinstructions replaced by their plain opcodes, so a snapshot
+// taken with --superinstructions restores on the plain bytecode and back.
+std::uint64_t program_hash(std::span<inst_t const> program);
+
+std::string encode(snapshot_t const& snapshot);
+
+// Throws std::runtime_error on malformed input or a version mismatch.
+snapshot_t decode(std::string_view bytes);
+
+// Replaces path with bfserial::replace_file, so a crash while writing leaves the previous checkpoint intact.
+void write_file(std::filesystem::path const& path, snapshot_t const& snapshot);
+
+// Throws std::runtime_error when the file is unreadable or malformed, or was taken from another program.
+snapshot_t read_file(std::filesystem::path const& path, std::span<inst_t const> program);
+
+// Profiler policy that pauses a run every `every` instructions, the points at which to take a snapshot.
+class Interval {
+ public:
+  explicit Interval(std::uint64_t every) : every_{every == 0 ? 1 : every}, left_{every_} {}
+
+  bool count(std::size_t) {
+    if (left_ == 0) {
+      left_ = every_;
+      return false;
+    }
+    --left_;
+    return true;
+  }
+
+ private:
+  std::uint64_t every_;
+  std::uint64_t left_;
+};
+
+// Writes snapshots to one file on a background thread, so the run only pays for copying the dirty
+// tape range. Snapshots submitted while one is being written replace each other; the newest wins.
+class Checkpointer {
+ public:
+  Checkpointer(std::filesystem::path path, std::uint64_t program_hash);
+  // Writes the pending snapshot, if any; errors are dropped here, call wait() to see them.
+  ~Checkpointer();
+
+  Checkpointer(Checkpointer const&) = delete;
+  Checkpointer& operator=(Checkpointer const&) = delete;
+
+  void submit(snapshot_t snapshot);
+
+  // Block until every submitted snapshot is on disk. Rethrows the first write error.
+  void wait();
+
+  // Snapshots written so far.
+  std::size_t written() const;
+
+ private:
+  void work(std::stop_token stop);
+
+  std::filesystem::path path_;
+  std::uint64_t program_hash_;
+  mutable std::mutex mutex_;
+  std::condition_variable_any changed_;
+  std::optional<snapshot_t> pending_;
+  bool writing_{false};
+  std::size_t written_{0};
+  std::exception_ptr error_;
+  std::jthread thread_;  // last: started once the members it uses exist
+};
+
+} // namespace bfsnapshot
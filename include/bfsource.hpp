@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file. Regular files are mmap'd so the program is handed to
+// compile() / BFMachine as one contiguous range without copying; anything that cannot be
+// mapped (pipes, /dev/stdin) is read into memory instead.
+class MappedFile {
+ public:
+  explicit MappedFile(std::string const& path);
+  ~MappedFile();
+
+  MappedFile(MappedFile const&) = delete;
+  MappedFile& operator=(MappedFile const&) = delete;
+
+  std::string_view view() const { return mapped_ != nullptr ? std::string_view{mapped_, size_} : fallback_; }
+  bool is_mapped() const { return mapped_ != nullptr; }
+
+ private:
+  char const* mapped_{nullptr};
+  std::size_t size_{0};
+  std::string fallback_;
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include "bytecode.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Superinstructions: short instruction sequences that the VMs execute with one dispatch. fuse() marks
+// an occurrence by replacing the opcode of its first instruction with op_code_t::super + k. Every
+// instruction keeps its index and operands, so jumps and resume points that land inside a sequence run
+// the remaining instructions one by one, and engines without fused handlers execute plain(opcode).
+namespace bfsuper {
+
+using op_code_t = inst_t::op_code_t;
+
+// The opcodes of one superinstruction, from which the VMs instantiate its handler.
+template <op_code_t... Ops>
+struct sequence_t {
+  static constexpr std::array<op_code_t, sizeof...(Ops)> ops{Ops...};
+};
+
+// Generated by Ngrams::select(10) over profiled runs of the test corpus at level 4 (checked by
+// SuperinstructionsCorpus.TableIsSelectedFromCorpus in ccbf_slow_tests); longest first, the order fuse()
+// tries them in.
+using table_t = std::tuple<
+    sequence_t<op_code_t::mpadd, op_code_t::mul, op_code_t::set, op_code_t::mpadd, op_code_t::jmpnz>,
+    sequence_t<op_code_t::mul, op_code_t::mul, op_code_t::set, op_code_t::mpadd, op_code_t::jmpnz>,
+    sequence_t<op_code_t::mpadd, op_code_t::mul, op_code_t::set, op_code_t::add, op_code_t::mpadd>,
+    sequence_t<op_code_t::add, op_code_t::mpadd, op_code_t::mul, op_code_t::set, op_code_t::mpadd>,
+    sequence_t<op_code_t::mpadd, op_code_t::mul, op_code_t::set, op_code_t::mpadd>,
+    sequence_t<op_code_t::add, op_code_t::add, op_code_t::mpadd>,
+    sequence_t<op_code_t::add, op_code_t::mpadd, op_code_t::jmpnz>,
+    sequence_t<op_code_t::mul, op_code_t::mul, op_code_t::set>,
+    sequence_t<op_code_t::mpadd, op_code_t::jmpz>,
+    sequence_t<op_code_t::mpadd, op_code_t::jmpnz>>;
+
+inline constexpr std::size_t count = std::tuple_size_v<table_t>;
+
+// patterns[k]: the opcodes of superinstruction k.
+inline constexpr auto patterns = []<std::size_t... K>(std::index_sequence<K...>) {
+  return std::array<std::span<op_code_t const>, count>{
+      std::span<op_code_t const>{std::tuple_element_t<K, table_t>::ops}...};
+}(std::make_index_sequence<count>{});
+
+inline constexpr auto last_opcode = static_cast<op_code_t>(static_cast<std::size_t>(op_code_t::super) + count - 1);
+
+constexpr bool is_super(op_code_t op) { return op >= op_code_t::super; }
+
+constexpr std::size_t index(op_code_t op) {
+  return static_cast<std::size_t>(op) - static_cast<std::size_t>(op_code_t::super);
+}
+
+// The opcode the first instruction of a superinstruction had before fuse(); op itself otherwise.
+constexpr op_code_t plain(op_code_t op) { return is_super(op) ? patterns[index(op)][0] : op; }
+
+// True when op may be at position i of a sequence of length n: straight-line instructions, and a jump
+// only at the end. I/O and scan stay separate: in and out as points where a run may pause (precompute,
+// a full output), scan as a loop.
+constexpr bool fusable(op_code_t op, std::size_t i, std::size_t n) {
+  switch (op) {
+    case op_code_t::mpadd:
+    case op_code_t::add:
+    case op_code_t::set:
+    case op_code_t::mul:
+      return true;
+    case op_code_t::jmpz:
+    case op_code_t::jmpnz:
+      return i + 1 == n;
+    default:
+      return false;
+  }
+}
+
+static_assert([] {
+  for (auto const pattern : patterns) {
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+      if (pattern.size() < 2 or !fusable(pattern[i], i, pattern.size())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}(), "superinstructions are fusable sequences of at least two instructions");
+
+struct ngram_t {
+  std::vector<op_code_t> ops;
+  std::uint64_t count{0};  // executions of the sequence's first instruction
+};
+
+// Sequence frequencies over a training corpus.
+class Ngrams {
+ public:
+  explicit Ngrams(std::size_t max_length = 5) : max_length_{max_length} {}
+
+  // Add every fusable sequence of 2..max_length instructions in program, weighted by counts[i] of its
+  // first instruction (a bfprofile::Counter over a run), or by 1 when counts is empty.
+  void add(std::span<inst_t const> program, std::span<std::uint64_t const> counts = {});
+
+  // The n sequences that would save the most dispatches on their own, count * (length - 1), most first.
+  std::vector<ngram_t> top(std::size_t n) const;
+
+  // Up to n sequences chosen greedily from the top candidates, each the one that saves the most
+  // dispatches on the added runs together with those chosen before it (overlapping sequences compete
+  // for the same instructions). Longest first, like table_t.
+  std::vector<std::vector<op_code_t>> select(std::size_t n, std::size_t candidates = 40) const;
+
+ private:
+  struct run_t {
+    std::vector<inst_t> program;
+    std::vector<std::uint64_t> counts;
+  };
+
+  std::size_t max_length_;
+  std::map<std::vector<op_code_t>, std::uint64_t> counts_;
+  std::vector<run_t> runs_;
+};
+
+// Mark the table sequences in program, left to right, trying them in table order at each instruction.
+// Returns the number of superinstructions.
+std::size_t fuse(std::span<inst_t> program);
+
+// fuse() with other sequences in place of the table; superinstruction k is then patterns[k].
+std::size_t fuse(std::span<inst_t> program, std::span<std::span<op_code_t const> const> patterns);
+
+// Restore the plain opcodes.
+void unfuse(std::span<inst_t> program);
+
+} // namespace bfsuper
@@ -0,0 +1,136 @@
+#pragma once
+#include "bfscan.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bftape {
+
+inline constexpr std::size_t default_size = 30000;
+// Address space reserved up front by growable tapes; pages are committed only as the program reaches them.
+inline constexpr std::size_t default_max_size = std::size_t{1} << 32;
+
+// What happens when the memory pointer leaves [0, size).
+enum class policy_t {
+  wrap,   // continue at the other end (the classic 30000-cell behaviour)
+  error,  // throw std::runtime_error
+  grow,   // extend the tape to the right; moving left of cell 0 is still an error
+};
+
+struct options_t {
+  std::size_t size{default_size};  // in cells
+  policy_t policy{policy_t::wrap};
+  std::size_t max_size{default_max_size};
+  unsigned cell_bits{8};  // 8, 16 or 32
+};
+
+// options with the cell width of an engine instantiated for Cell.
+template <typename Cell>
+constexpr options_t for_cell(options_t options) {
+  options.cell_bits = 8 * sizeof(Cell);
+  return options;
+}
+
+// State a run starts from instead of a zero tape at instruction 0. A folded prefix (fold_prefix) keeps
+// values modulo 2^32, truncated to the cell width when loaded, so one state serves every width. A
+// precomputed state (precompute) also resumes at pc after replaying output, and holds only for the
+// cell width and tape it was computed on.
+struct initial_t {
+  std::vector<std::uint32_t> cells;  // cells[i] goes to cell base + i; all other cells are zero
+  std::size_t base{0};
+  std::size_t pointer{0};
+  std::size_t pc{0};                 // instruction the run resumes at
+  std::string output{};              // bytes printed before pc, written once when the run starts
+  unsigned cell_bits{0};             // width the state was computed at; 0 for every width
+  std::size_t tape_size{0};          // with policy, the tape it was computed on; 0 for any tape it fits
+  policy_t policy{policy_t::wrap};
+
+  bool empty() const { return cells.empty() and pointer == 0 and pc == 0 and output.empty(); }
+
+  // True when a run on a tape with these options may start from this state.
+  bool applies_to(options_t const& options) const {
+    if (cell_bits != 0 and (cell_bits != options.cell_bits or tape_size != options.size or policy != options.policy)) {
+      return false;
+    }
+    auto const extent = std::max(base + cells.size(), pointer + 1);
+    return extent <= options.size or (cell_bits != 0 and policy == policy_t::grow);
+  }
+};
+
+// Parse "wrap", "error" or "grow"; throws std::runtime_error otherwise.
+policy_t parse_policy(std::string_view name);
+
+// Apply a --tape=<policy>, --tape-size=<cells> or --cell=8|16|32 command-line argument. Returns false for any other
+// argument and throws std::runtime_error on a malformed value.
+bool parse_option(std::string_view arg, options_t& options);
+
+inline constexpr char const* option_usage = "[--tape=wrap|error|grow] [--tape-size=<cells>] [--cell=8|16|32]";
+
+// Tape cells in an mmap'd region between two PROT_NONE guard areas at least as wide as the largest
+// instruction offset, so a stray access past either end faults instead of corrupting the heap.
+// The base address never changes: growable tapes reserve max_size cells and commit pages on demand.
+class Tape {
+ public:
+  explicit Tape(options_t options = {});
+  ~Tape();
+
+  Tape(Tape const&) = delete;
+  Tape& operator=(Tape const&) = delete;
+
+  std::uint8_t* data() const { return cells_; }
+  template <typename Cell>
+  Cell* cells() const {
+    return reinterpret_cast<Cell*>(cells_);
+  }
+  std::size_t size() const { return size_; }
+  policy_t policy() const { return options_.policy; }
+  options_t const& options() const { return options_; }
+
+  // Zero the tape and shrink a grown tape back to its initial size.
+  void clear();
+
+  // Cell index delta away from current. The in-range case is one unsigned compare; everything else
+  // is handled out of line according to the policy.
+  std::size_t move(std::size_t current, std::ptrdiff_t delta) {
+    auto const next = current + static_cast<std::size_t>(delta);
+    return next < size_ ? next : relocate(current, delta);
+  }
+
+  // Execute a [>]-style loop from start; bfscan::npos when it can never stop.
+  template <typename Cell = std::uint8_t>
+  std::size_t scan(std::size_t start, std::int32_t stride) {
+    if constexpr (sizeof(Cell) == 1) {
+      return scan_bytes(start, stride);
+    } else {
+      // Scalar walk: a wrapping orbit closes within size() steps, and on other tapes move() grows
+      // or throws once the walk reaches the edge.
+      auto const* const cells = this->cells<Cell>();
+      std::size_t p = start;
+      for (std::size_t steps = 0; steps <= size_ and stride != 0; ++steps) {
+        if (cells[p] == 0) {
+          return p;
+        }
+        p = move(p, stride);
+      }
+      return cells[p] == 0 ? p : bfscan::npos;
+    }
+  }
+
+ private:
+  std::size_t scan_bytes(std::size_t start, std::int32_t stride);
+  std::size_t relocate(std::size_t current, std::ptrdiff_t delta);
+  void commit(std::size_t size);
+
+  options_t options_;
+  std::uint8_t* region_{nullptr};
+  std::size_t region_size_{0};
+  std::uint8_t* cells_{nullptr};
+  std::size_t size_{0};
+  std::size_t cell_bytes_{1};
+  std::size_t committed_{0};  // bytes of cells_ that are readable and writable
+};
+
+} // namespace bftape
@@ -1,64 +1,383 @@
 #pragma once
+#include "bfio.hpp"
+#include "bflimit.hpp"
+#include "bfprofile.hpp"
+#include "bfscan.hpp"
+#include "bfsnapshot.hpp"
+#include "bfsuper.hpp"
+#include "bftape.hpp"
 #include "bytecode.hpp"
-#include <array>
+#include <algorithm>
+#include <concepts>
 #include <cstddef>
 #include <cstdint>
 #include <istream>
-#include <limits>
 #include <ostream>
 #include <ranges>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace rng = std::ranges;
 
-class BrainFckVM {
+#if defined(__GNUC__) || defined(__clang__)
+#define CCBF_HAS_COMPUTED_GOTO 1
+// Keeps the interpreter loops out of their callers, so their register allocation does not depend on
+// the call site (run() with a profiler policy made GCC inline the loop into main and lose ~20%).
+#define CCBF_NOINLINE [[gnu::noinline]]
+// Superinstruction bodies must be expanded inside the dispatch loops, where mp lives in a register.
+#define CCBF_ALWAYS_INLINE [[gnu::always_inline]]
+#else
+#define CCBF_NOINLINE
+#define CCBF_ALWAYS_INLINE
+#endif
+
+// Parts of the VM that do not depend on the cell type.
+class BrainFckVMBase {
+ public:
+  // Instruction dispatch strategy used by run().
+  enum class dispatch_t {
+    switch_loop,  // portable switch over inst_t::opcode
+    threaded,     // pre-decoded direct-threaded code with computed goto
+  };
+
+  // True when the threaded engine is compiled in; otherwise it falls back to the switch loop.
+  static constexpr bool threaded_supported() {
+#if defined(CCBF_HAS_COMPUTED_GOTO)
+    return true;
+#else
+    return false;
+#endif
+  }
+};
+
+// Bytecode VM over cells of type Cell (std::uint8_t, std::uint16_t or std::uint32_t). Cell arithmetic
+// wraps modulo the cell width; `.` writes the low byte of a cell and `,` stores a byte.
+template <typename Cell = std::uint8_t>
+class BasicBrainFckVM : public BrainFckVMBase {
+  static_assert(std::is_same_v<Cell, std::uint8_t> or std::is_same_v<Cell, std::uint16_t> or
+                    std::is_same_v<Cell, std::uint32_t>,
+                "Cell must be an 8, 16 or 32-bit unsigned integer");
+
  public:
+  explicit BasicBrainFckVM(std::istream& in, std::ostream& out, dispatch_t dispatch = dispatch_t::switch_loop,
+                           bftape::options_t tape = {})
+    : tape_{bftape::for_cell<Cell>(tape)}, pc_{0}, mp_{0}, dispatch_{dispatch}, out_(out), in_(in) {}
 
-  explicit BrainFckVM(std::istream& in, std::ostream& out)
-    : memory_{}, pc_{0}, mp_{0}, is_(in), os_(out) {}
+  // io_buffer sizes the input and output buffers, e.g. smaller for many concurrent sessions.
+  explicit BasicBrainFckVM(int in_fd, int out_fd, dispatch_t dispatch = dispatch_t::switch_loop,
+                           bftape::options_t tape = {}, std::size_t io_buffer = bfio::Output::buffer_size)
+    : tape_{bftape::for_cell<Cell>(tape)}, pc_{0}, mp_{0}, dispatch_{dispatch}, out_(out_fd, io_buffer),
+      in_(in_fd, bfio::is_interactive(in_fd), io_buffer) {}
 
   void reset() {
-    memory_.fill(0);
-    pc_ = 0;
-    mp_ = 0;
+    tape_.clear();
+    auto const extent = std::max(initial_.base + initial_.cells.size(), initial_.pointer + 1);
+    if (extent > tape_.size()) {
+      tape_.move(tape_.size() - 1, static_cast<std::ptrdiff_t>(extent - tape_.size()));  // grow to fit
+    }
+    pc_ = initial_.pc;
+    mp_ = initial_.pointer;
+    auto* const memory = tape_.cells<Cell>();
+    for (std::size_t i = 0; i < initial_.cells.size(); ++i) {
+      memory[initial_.base + i] = static_cast<Cell>(initial_.cells[i]);
+    }
   }
 
+  // Start every run from initial (a folded prefix or a precomputed state) instead of a zero tape.
+  // Throws std::runtime_error when it does not apply to this tape.
+  void set_initial_state(bftape::initial_t initial) {
+    if (!initial.applies_to(tape_.options())) {
+      throw std::runtime_error("Initial tape state does not fit a tape of " + std::to_string(tape_.options().size) +
+                               " " + std::to_string(8 * sizeof(Cell)) + "-bit cells");
+    }
+    initial_ = std::move(initial);
+  }
+
+  // Instruction the last run stopped before; the program size once it finished.
+  std::size_t pc() const { return pc_; }
+
+  // Where the last run stopped, as a start state for set_initial_state (without the output). Only the
+  // range between the first and the last nonzero cell is stored.
+  bftape::initial_t state() const {
+    bftape::initial_t state;
+    auto const* const memory = tape_.cells<Cell>();
+    auto end = tape_.size();
+    while (end > 0 and memory[end - 1] == 0) {
+      --end;
+    }
+    std::size_t begin = 0;
+    while (begin < end and memory[begin] == 0) {
+      ++begin;
+    }
+    state.cells.assign(memory + begin, memory + end);
+    state.base = begin;
+    state.pointer = mp_;
+    state.pc = pc_;
+    state.cell_bits = 8 * sizeof(Cell);
+    state.tape_size = tape_.options().size;
+    state.policy = tape_.policy();
+    return state;
+  }
+
+  // The paused run with how much of its input and output it has gone through (pending output is
+  // flushed first). Restoring it continues exactly where this run is.
+  bfsnapshot::snapshot_t snapshot() {
+    out_.flush();
+    return {state(), 0, in_.consumed() - input_start_, output_base_ + out_.written() - output_start_};
+  }
+
+  // Load a snapshot, from this run or another VM of the same cell width and tape, and skip the input it
+  // had read; resume() then continues it, printing only what comes after its output offset. Restoring one
+  // snapshot into many VMs forks runs from a warmed-up state at the cost of copying its dirty cells.
+  // Throws std::runtime_error when the state does not fit this tape.
+  void restore(bfsnapshot::snapshot_t const& snapshot) {
+    auto state = snapshot.state;
+    state.output.clear();
+    set_initial_state(std::move(state));
+    reset();
+    input_start_ = in_.consumed();
+    in_.skip(snapshot.input_offset, out_);
+    output_start_ = out_.written();
+    output_base_ = snapshot.output_offset;
+  }
+
+  // Throws std::runtime_error when the pointer leaves a non-wrapping tape.
   void run(rng::random_access_range auto program) {
+    bfprofile::Disabled profiler;
+    run(program, profiler);
+  }
+
+  // Run with a profiling policy: profiler.count(pc) is called before each instruction executes
+  // (see bfprofile::Counter), and the run pauses there when it returns false.
+  template <typename Profiler>
+  void run(rng::random_access_range auto program, Profiler& profiler) {
     reset();
+    input_start_ = in_.consumed();
+    output_start_ = out_.written();
+    output_base_ = 0;
+    if (!initial_.output.empty()) {
+      out_.write(initial_.output);
+    }
+    resume(program, profiler);
+  }
+
+  void resume(rng::random_access_range auto program) {
+    bfprofile::Disabled profiler;
+    resume(program, profiler);
+  }
+
+  // Run program from its first instruction on the tape and pointer the last run left, e.g. the next
+  // line of a REPL session. Throws like run(); the tape then keeps what program did and the pointer is
+  // put back where it started.
+  void continue_with(rng::random_access_range auto program) {
+    auto const mp = mp_;
+    pc_ = 0;
+    try {
+      resume(program);
+    } catch (...) {
+      out_.flush();
+      mp_ = mp;
+      pc_ = rng::size(program);
+      throw;
+    }
+  }
+
+  // Run under fuel, time and interrupt limits, checked only on loop back-edges. A run that stops early
+  // is paused (pc(), state() and snapshot() describe it), and resume(program, limited) with a fresh
+  // bflimit::Limited continues it.
+  bflimit::result_t run_limited(rng::random_access_range auto program, bflimit::limits_t const& limits) {
+    bflimit::Limited limited{limits};
+    run(program, limited);
+    return limited.result(pc_ == rng::size(program));
+  }
+
+  // Hand buffered output to the destination; false when a non-blocking one could not take all of it.
+  bool flush_output() {
+    out_.flush();
+    return out_.pending() == 0;
+  }
+
+  // Continue a paused or restored run at pc() with the tape as it was left.
+  template <typename Profiler>
+  void resume(rng::random_access_range auto program, Profiler& profiler) {
+    if (pc_ > rng::size(program)) {
+      throw std::runtime_error("Cannot resume at instruction " + std::to_string(pc_) + " of a " +
+                               std::to_string(rng::size(program)) + "-instruction program");
+    }
+#if defined(CCBF_HAS_COMPUTED_GOTO)
+    if (dispatch_ == dispatch_t::threaded) {
+      run_threaded(program, profiler);
+      out_.flush();
+      return;
+    }
+#endif
+    run_switch(program, profiler);
+    out_.flush();
+  }
+
+ private:
+  // Policies may limit back-edges (see bflimit::Limited): every taken loop back-edge costs the length of
+  // the loop, paid from a slice of steps the loops keep in the local left and refilled by the policy,
+  // which can return Profiler::stop to pause the run. Other policies compile to the loops without it.
+  template <typename Profiler>
+  static constexpr bool limits_back_edges = requires(Profiler& profiler) {
+    { profiler.refill(std::uint64_t{}, std::uint64_t{}) } -> std::same_as<std::uint64_t>;
+    profiler.settle(std::uint64_t{});
+  };
+
+  // Policies may wait for I/O instead of blocking (see bfasync::Suspend): an `in` that finds no input
+  // ready on a non-blocking descriptor, or an `out` that finds the buffer full and the descriptor
+  // refusing more, tells the policy and pauses the run at that instruction, to be resumed once the
+  // descriptor is ready.
+  template <typename Profiler>
+  static constexpr bool waits_for_io = requires(Profiler& profiler) {
+    profiler.wait_for_input();
+    profiler.wait_for_output();
+  };
+
+  template <typename Profiler>
+  CCBF_ALWAYS_INLINE static bool back_edge(Profiler& profiler, std::uint64_t& left, std::uint64_t weight) {
+    if constexpr (limits_back_edges<Profiler>) {
+      if (weight <= left) {
+        left -= weight;
+        return true;
+      }
+      left = profiler.refill(weight, left);  // by value, so left stays in a register
+      if (left == Profiler::stop) {
+        left = 0;
+        return false;
+      }
+      return true;
+    } else {
+      (void)profiler;
+      (void)left;
+      (void)weight;
+      return true;
+    }
+  }
+
+  // Takes the slice from the policy and hands what is left of it back when the loop returns or throws.
+  template <typename Profiler>
+  struct slice_t {
+    Profiler& profiler;
+    std::uint64_t left{0};
+
+    explicit slice_t(Profiler& p) : profiler{p} {
+      if constexpr (limits_back_edges<Profiler>) {
+        left = profiler.left();
+      }
+    }
+    ~slice_t() {
+      if constexpr (limits_back_edges<Profiler>) {
+        profiler.settle(left);
+      }
+    }
+    slice_t(slice_t const&) = delete;
+    slice_t& operator=(slice_t const&) = delete;
+  };
+
+  // The byte for an `in`: bfio::would_block, after telling the policy, when it waits for I/O and none
+  // is ready.
+  template <typename Profiler>
+  CCBF_ALWAYS_INLINE int read(Profiler& profiler) {
+    if constexpr (waits_for_io<Profiler>) {
+      auto const value = in_.try_get(out_);
+      if (value == bfio::would_block) {
+        profiler.wait_for_input();
+      }
+      return value;
+    } else {
+      (void)profiler;
+      return in_.get(out_);
+    }
+  }
+
+  template <typename Profiler>
+  CCBF_NOINLINE void run_switch(rng::random_access_range auto const& program, Profiler& profiler) {
     auto const program_size = rng::size(program);
+    auto* const memory = tape_.cells<Cell>();  // stable: growable tapes commit pages in place
+    slice_t slice{profiler};
     while (pc_ < program_size) {
+      if (!profiler.count(pc_)) {
+        return;
+      }
       inst_t const inst = program[pc_];
       switch (inst.opcode) {
         case inst_t::op_code_t::mpadd:
-          mp_ = wrap_pointer(mp_, inst.operand);
+          mp_ = tape_.move(mp_, inst.operand);
           break;
         case inst_t::op_code_t::add:
-          memory_[mp_] += static_cast<std::uint8_t>(inst.operand);
+          memory[tape_.move(mp_, inst.offset)] += static_cast<Cell>(inst.operand);
           break;
         case inst_t::op_code_t::jmpz:
-          if (memory_[mp_] == 0) {
+          if (memory[mp_] == 0) {
             pc_ = static_cast<std::size_t>(inst.operand);
           }
           break;
         case inst_t::op_code_t::jmpnz:
-          if (memory_[mp_] != 0) {
-            pc_ = static_cast<std::size_t>(inst.operand);
+          if (memory[mp_] != 0) {
+            auto const target = static_cast<std::size_t>(inst.operand);
+            if (!back_edge(profiler, slice.left, pc_ - target)) {
+              pc_ = target + 1;
+              return;
+            }
+            pc_ = target;
           }
           break;
         case inst_t::op_code_t::out:
-          os_.put(static_cast<char>(memory_[mp_]));
+          if constexpr (waits_for_io<Profiler>) {
+            if (!out_.try_reserve()) {
+              profiler.wait_for_output();
+              return;
+            }
+          }
+          out_.put(static_cast<std::uint8_t>(memory[tape_.move(mp_, inst.offset)]));
           break;          
         case inst_t::op_code_t::in: {
-          auto const value = is_.get();
-          if (value == std::istream::traits_type::eof()) {
-            memory_[mp_] = 0;
+          auto const value = read(profiler);
+          if (value == bfio::would_block) {
+            return;
+          }
+          auto const target = tape_.move(mp_, inst.offset);
+          if (value == bfio::eof) {
+            memory[target] = 0;
           } else {
-            memory_[mp_] = static_cast<std::uint8_t>(value);
+            memory[target] = static_cast<Cell>(value);
           }
           break;
         }
         case inst_t::op_code_t::set:
-          memory_[mp_] = static_cast<std::uint8_t>(inst.operand);
+          memory[tape_.move(mp_, inst.offset)] = static_cast<Cell>(inst.operand);
           break;
+        case inst_t::op_code_t::mul:
+          memory[tape_.move(mp_, inst.offset)] += product(memory[mp_], inst.operand);
+          break;
+        case inst_t::op_code_t::scan: {
+          auto const next = tape_.scan<Cell>(mp_, inst.operand);
+          if (next == bfscan::npos) {
+            if (!back_edge(profiler, slice.left, 1)) {
+              return;
+            }
+            continue;  // no zero on the orbit: the loop never terminates
+          }
+          mp_ = next;
+          break;
+        }
+        default: {
+          bool pause = false;
+          pc_ = run_super(program, memory, slice, pause, std::make_index_sequence<bfsuper::count>{});
+          if (pause) {
+            ++pc_;
+            return;
+          }
+          break;
+        }
       }
       ++pc_;
 
@@ -66,25 +385,377 @@ class BrainFckVM {
 
   }
 
- private:
-  static constexpr std::size_t memory_size = 30000;
-  std::array<std::uint8_t, memory_size> memory_{};
-  std::size_t pc_{0}; // program counter
-  std::size_t mp_{0}; // memory pointer
+#if defined(CCBF_HAS_COMPUTED_GOTO)
+  // Direct-threaded interpreter: every instruction is decoded once into its handler address, and loop
+  // instructions carry the distance to the instruction that follows their match in place of their
+  // operand, which keeps decoded instructions at 16 bytes.
+  template <typename Profiler>
+  CCBF_NOINLINE void run_threaded(rng::random_access_range auto const& program, Profiler& profiler) {
+    struct threaded_inst_t {
+      void const* handler;
+      std::int32_t operand;
+      std::int16_t offset;
+
+      threaded_inst_t const* target() const { return this + operand; }
+    };
+    static_assert(sizeof(threaded_inst_t) == 16);
+
+    // Indexed by inst_t::op_code_t.
+    static void const* const handlers[] = {
+        &&op_nop,    &&op_mpadd,  &&op_add,    &&op_jmpz,   &&op_jmpnz,  &&op_in,     &&op_out,
+        &&op_set,    &&op_mul,    &&op_scan,   &&op_super0, &&op_super1, &&op_super2, &&op_super3,
+        &&op_super4, &&op_super5, &&op_super6, &&op_super7, &&op_super8, &&op_super9,
+    };
+    static_assert(std::size(handlers) == static_cast<std::size_t>(bfsuper::last_opcode) + 1);
+
+    auto const program_size = rng::size(program);
+    std::vector<threaded_inst_t> code(program_size + 1);
+    for (std::size_t i = 0; i < program_size; ++i) {
+      inst_t const inst = program[i];
+      auto& decoded = code[i];
+      decoded.handler = handlers[static_cast<std::size_t>(inst.opcode)];
+      decoded.operand = inst.operand;
+      decoded.offset = inst.offset;
+      if (inst.opcode == inst_t::op_code_t::jmpz or inst.opcode == inst_t::op_code_t::jmpnz) {
+        decoded.operand = static_cast<std::int32_t>(static_cast<std::int64_t>(inst.operand) + 1 -
+                                                    static_cast<std::int64_t>(i));
+      }
+    }
+    code[program_size].handler = &&op_halt;
+
+    auto* const memory = tape_.cells<Cell>();
+    std::size_t mp = mp_;
+    threaded_inst_t const* ip = code.data() + pc_;
+    slice_t slice{profiler};
+    bool pause = false;  // set by a superinstruction whose back-edge the policy refused
+    auto const tick = [&] { return profiler.count(static_cast<std::size_t>(ip - code.data())); };
+    goto *ip->handler;
 
-  static std::size_t wrap_pointer(std::size_t current, std::int32_t delta) {
-    static_assert(memory_size <= static_cast<std::size_t>(std::numeric_limits<std::ptrdiff_t>::max()),
-                  "Tape size exceeds ptrdiff_t range");
-    auto const size = static_cast<std::ptrdiff_t>(memory_size);
-    auto next = static_cast<std::ptrdiff_t>(current) + static_cast<std::ptrdiff_t>(delta);
-    next %= size;
-    if (next < 0) {
-      next += size;
+  op_nop:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ++ip;
+    goto *ip->handler;
+  op_mpadd:
+    if (!tick()) {
+      goto op_pause;
+    }
+    mp = tape_.move(mp, ip->operand);
+    ++ip;
+    goto *ip->handler;
+  op_add:
+    if (!tick()) {
+      goto op_pause;
     }
-    return static_cast<std::size_t>(next);
+    memory[tape_.move(mp, ip->offset)] += static_cast<Cell>(ip->operand);
+    ++ip;
+    goto *ip->handler;
+  op_jmpz:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = (memory[mp] == 0) ? ip->target() : ip + 1;
+    goto *ip->handler;
+  op_jmpnz:
+    if (!tick()) {
+      goto op_pause;
+    }
+    if constexpr (limits_back_edges<Profiler>) {
+      if (memory[mp] != 0) {
+        auto const* const target = ip->target();
+        if (!back_edge(profiler, slice.left, static_cast<std::uint64_t>(ip - target + 1))) {
+          ip = target;
+          goto op_pause;
+        }
+        ip = target;
+      } else {
+        ++ip;
+      }
+    } else {
+      ip = (memory[mp] != 0) ? ip->target() : ip + 1;
+    }
+    goto *ip->handler;
+  op_in: {
+    if (!tick()) {
+      goto op_pause;
+    }
+    auto const value = read(profiler);
+    if (value == bfio::would_block) {
+      goto op_pause;
+    }
+    auto const target = tape_.move(mp, ip->offset);
+    memory[target] = (value == bfio::eof) ? 0 : static_cast<Cell>(value);
+    ++ip;
+    goto *ip->handler;
   }
-  
-  std::istream& is_;
-  std::ostream& os_;
+  op_out:
+    if (!tick()) {
+      goto op_pause;
+    }
+    if constexpr (waits_for_io<Profiler>) {
+      if (!out_.try_reserve()) {
+        profiler.wait_for_output();
+        goto op_pause;
+      }
+    }
+    out_.put(static_cast<std::uint8_t>(memory[tape_.move(mp, ip->offset)]));
+    ++ip;
+    goto *ip->handler;
+  op_set:
+    if (!tick()) {
+      goto op_pause;
+    }
+    memory[tape_.move(mp, ip->offset)] = static_cast<Cell>(ip->operand);
+    ++ip;
+    goto *ip->handler;
+  op_mul:
+    if (!tick()) {
+      goto op_pause;
+    }
+    memory[tape_.move(mp, ip->offset)] += product(memory[mp], ip->operand);
+    ++ip;
+    goto *ip->handler;
+  op_scan: {
+    if (!tick()) {
+      goto op_pause;
+    }
+    auto const next = tape_.scan<Cell>(mp, ip->operand);
+    if (next == bfscan::npos) {
+      if (!back_edge(profiler, slice.left, 1)) {
+        goto op_pause;
+      }
+      goto *ip->handler;  // no zero on the orbit: the loop never terminates
+    }
+    mp = next;
+    ++ip;
+    goto *ip->handler;
+  }
+  op_super0:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<0>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super1:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<1>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super2:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<2>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super3:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<3>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super4:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<4>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super5:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<5>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super6:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<6>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super7:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<7>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super8:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<8>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_super9:
+    if (!tick()) {
+      goto op_pause;
+    }
+    ip = super_next<9>(ip, mp, memory, slice, pause);
+    if (pause) {
+      goto op_pause;
+    }
+    goto *ip->handler;
+  op_halt:
+    mp_ = mp;
+    pc_ = program_size;
+    return;
+  op_pause:
+    mp_ = mp;
+    pc_ = static_cast<std::size_t>(ip - code.data());
+  }
+#endif
+
+  // One instruction of a superinstruction; inst is an inst_t or the threaded form.
+  template <inst_t::op_code_t Op>
+  CCBF_ALWAYS_INLINE void step(auto const& inst, std::size_t& mp, Cell* memory) {
+    if constexpr (Op == inst_t::op_code_t::mpadd) {
+      mp = tape_.move(mp, inst.operand);
+    } else if constexpr (Op == inst_t::op_code_t::add) {
+      memory[tape_.move(mp, inst.offset)] += static_cast<Cell>(inst.operand);
+    } else if constexpr (Op == inst_t::op_code_t::set) {
+      memory[tape_.move(mp, inst.offset)] = static_cast<Cell>(inst.operand);
+    } else if constexpr (Op == inst_t::op_code_t::mul) {
+      memory[tape_.move(mp, inst.offset)] += product(memory[mp], inst.operand);
+    }
+  }
+
+  // Execute superinstruction K on its instructions at(0), at(1), ...; true when it ends in a jump
+  // that is taken.
+  template <std::size_t K>
+  CCBF_ALWAYS_INLINE bool run_sequence(auto const& at, std::size_t& mp, Cell* memory) {
+    static constexpr auto ops = std::tuple_element_t<K, bfsuper::table_t>::ops;
+    static constexpr auto last = ops.back();
+    static constexpr auto jumps = last == inst_t::op_code_t::jmpz or last == inst_t::op_code_t::jmpnz;
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+      (step<ops[I]>(at(I), mp, memory), ...);
+    }(std::make_index_sequence<ops.size() - (jumps ? 1 : 0)>{});
+    if constexpr (last == inst_t::op_code_t::jmpz) {
+      return memory[mp] == 0;
+    } else if constexpr (last == inst_t::op_code_t::jmpnz) {
+      return memory[mp] != 0;
+    } else {
+      return false;
+    }
+  }
+
+  // Switch loop: run the superinstruction at pc_ and return the index of its last instruction, or the
+  // jump target when its jump is taken, for the ++pc_ that follows.
+  // pause is set when the sequence ends in a back-edge the policy refused.
+  template <typename Profiler, std::size_t... K>
+  std::size_t run_super(rng::random_access_range auto const& program, Cell* memory, slice_t<Profiler>& slice,
+                        bool& pause, std::index_sequence<K...>) {
+    auto const k = bfsuper::index(program[pc_].opcode);
+    auto const at = [&](std::size_t i) -> inst_t { return program[pc_ + i]; };
+    auto next = pc_;
+    auto const execute = [&]<std::size_t J>(std::integral_constant<std::size_t, J>) {
+      auto const last = pc_ + bfsuper::patterns[J].size() - 1;
+      if (!run_sequence<J>(at, mp_, memory)) {
+        next = last;
+        return;
+      }
+      next = static_cast<std::size_t>(program[last].operand);
+      if constexpr (bfsuper::patterns[J].back() == inst_t::op_code_t::jmpnz) {
+        pause = !back_edge(slice.profiler, slice.left, last - next);
+      }
+    };
+    (void)((k == K and (execute(std::integral_constant<std::size_t, K>{}), true)) or ...);
+    return next;
+  }
+
+  // Threaded: run superinstruction K at ip and return the instruction to dispatch next; pause as above,
+  // with the body start to resume at returned.
+  template <std::size_t K, typename Inst, typename Profiler>
+  CCBF_ALWAYS_INLINE Inst const* super_next(Inst const* ip, std::size_t& mp, Cell* memory, slice_t<Profiler>& slice,
+                                            bool& pause) {
+    constexpr auto size = bfsuper::patterns[K].size();
+    auto const at = [ip](std::size_t i) -> Inst const& { return ip[i]; };
+    if (!run_sequence<K>(at, mp, memory)) {
+      return ip + size;
+    }
+    auto const* const target = ip[size - 1].target();
+    if constexpr (bfsuper::patterns[K].back() == inst_t::op_code_t::jmpnz and limits_back_edges<Profiler>) {
+      pause = !back_edge(slice.profiler, slice.left, static_cast<std::uint64_t>(ip + size - target));
+    }
+    return target;
+  }
+
+  // value * factor modulo the cell width, computed in unsigned arithmetic so 16-bit cells cannot
+  // overflow int after promotion.
+  static Cell product(Cell value, std::int32_t factor) {
+    return static_cast<Cell>(static_cast<std::uint32_t>(value) * static_cast<std::uint32_t>(factor));
+  }
+
+  bftape::Tape tape_;
+  bftape::initial_t initial_;
+  std::size_t pc_{0}; // program counter
+  std::size_t mp_{0}; // memory pointer
+  dispatch_t dispatch_{dispatch_t::switch_loop};
+  // snapshot offsets: where this run started in the streams, and the output a restored run had before
+  std::uint64_t input_start_{0};
+  std::uint64_t output_start_{0};
+  std::uint64_t output_base_{0};
+
+  bfio::Output out_;
+  bfio::Input in_;
 
 };
+
+using BrainFckVM = BasicBrainFckVM<std::uint8_t>;
+
+// Partial evaluation: run program from initial until it is about to read input, finishes, or has executed
+// budget instructions, and return the state it stopped in with the output printed on the way. A run started
+// from the result writes that output once and continues where this one stopped. Throws std::runtime_error
+// when the pointer leaves a non-wrapping tape.
+template <typename Cell = std::uint8_t>
+bftape::initial_t precompute(std::span<inst_t const> program, std::uint64_t budget, bftape::options_t tape = {},
+                             bftape::initial_t initial = {}) {
+  struct until_input_t {
+    std::span<inst_t const> program;
+    std::uint64_t budget;
+
+    bool count(std::size_t pc) {
+      if (budget == 0 or program[pc].opcode == inst_t::op_code_t::in) {
+        return false;
+      }
+      --budget;
+      return true;
+    }
+  } policy{program, budget};
+
+  std::istringstream in;
+  std::ostringstream out;
+  auto const dispatch = BrainFckVMBase::threaded_supported() ? BrainFckVMBase::dispatch_t::threaded
+                                                             : BrainFckVMBase::dispatch_t::switch_loop;
+  BasicBrainFckVM<Cell> vm{in, out, dispatch, tape};
+  vm.set_initial_state(std::move(initial));
+  vm.run(program, policy);
+  auto state = vm.state();
+  state.output = std::move(out).str();
+  return state;
+}
@@ -11,9 +11,17 @@ struct inst_t {
     in,     // input 1 char at [mem]
     out,    // output 1 char at [mem]
     set,    // set [mem] = v
+    mul,    // [mem + offset] += [mem] * v
+    scan,   // move the memory pointer by v until [mem] == 0
+    super,  // super + k: first instruction of superinstruction k (see bfsuper.hpp)
   };
 
-  op_code_t opcode;
-  std::int32_t operand;
+  constexpr inst_t() = default;
+  constexpr inst_t(op_code_t op, std::int32_t value, std::int16_t off = 0)
+    : opcode{op}, offset{off}, operand{value} {}
+
+  op_code_t opcode{op_code_t::nop};
+  std::int16_t offset{0};  // memory offset relative to the pointer (fits in the padding after opcode)
+  std::int32_t operand{0};
   
 };
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <array>
+#include "bfio.hpp"
+#include "bftape.hpp"
 #include <cstddef>
 #include <cstdint>
 #include <istream>
@@ -41,15 +42,18 @@ static std::vector<std::size_t> build_jump_table(rng::input_range auto const& pr
 }
 
 
-class BFMachine {
+// Direct source interpreter over cells of type Cell (std::uint8_t, std::uint16_t or std::uint32_t).
+template <typename Cell = std::uint8_t>
+class BasicBFMachine {
  public:
-  static constexpr std::size_t memory_size = 30000;
+  explicit BasicBFMachine(std::istream& in, std::ostream& out, bftape::options_t tape = {})
+      : tape_{bftape::for_cell<Cell>(tape)}, out_(out), in_(in) {}
 
-  explicit BFMachine(std::istream& in, std::ostream& out)
-      : memory_{}, is_(in), os_(out) {}
+  explicit BasicBFMachine(int in_fd, int out_fd, bftape::options_t tape = {})
+      : tape_{bftape::for_cell<Cell>(tape)}, out_(out_fd), in_(in_fd, bfio::is_interactive(in_fd)) {}
 
   void reset() {
-    memory_.fill(0);
+    tape_.clear();
   }
 
   void run(rng::random_access_range auto const& program) {
@@ -60,41 +64,42 @@ class BFMachine {
 
     std::size_t pc{0};
     std::size_t mp{0};
+    auto* const memory = tape_.cells<Cell>();
 
     while (pc < program_size) {
       auto const inst = program[pc];
       switch (inst) {
       case '>':
-        mp = (mp + 1) % memory_size;
+        mp = tape_.move(mp, 1);
         break;
       case '<':
-        mp = (mp == 0) ? memory_size - 1 : mp - 1;
+        mp = tape_.move(mp, -1);
         break;
       case '+':
-        ++memory_[mp];
+        ++memory[mp];
         break;
       case '-':
-        --memory_[mp];
+        --memory[mp];
         break;
       case '.':
-        os_.put(static_cast<char>(memory_[mp]));
+        out_.put(static_cast<std::uint8_t>(memory[mp]));
         break;
       case ',': {
-        auto const value = is_.get();
-        if (value == std::istream::traits_type::eof()) {
-          memory_[mp] = 0;
+        auto const value = in_.get(out_);
+        if (value == bfio::eof) {
+          memory[mp] = 0;
         } else {
-          memory_[mp] = static_cast<std::uint8_t>(value);
+          memory[mp] = static_cast<Cell>(value);
         }
         break;
       }
       case '[':
-        if (memory_[mp] == 0) {
+        if (memory[mp] == 0) {
           pc = jumps[pc];
         }
         break;
       case ']':
-        if (memory_[mp] != 0) {
+        if (memory[mp] != 0) {
           pc = jumps[pc];
         }
         break;
@@ -103,11 +108,14 @@ class BFMachine {
       }
       ++pc;
     }
+    out_.flush();
   }
 
  private:
 
-  std::array<std::uint8_t, memory_size> memory_;
-  std::istream& is_;
-  std::ostream& os_;
+  bftape::Tape tape_;
+  bfio::Output out_;
+  bfio::Input in_;
 };
+
+using BFMachine = BasicBFMachine<std::uint8_t>;
@@ -0,0 +1,92 @@
+#include "bfasync.hpp"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace bfasync {
+
+static_assert(EPOLLIN == 0x001 and EPOLLOUT == 0x004);
+
+EventLoop::EventLoop() : epoll_fd_{::epoll_create1(EPOLL_CLOEXEC)} {
+  if (epoll_fd_ < 0) {
+    throw std::runtime_error(std::string{"Failed to create an epoll instance: "} + std::strerror(errno));
+  }
+}
+
+EventLoop::~EventLoop() {
+  for (auto* const frame : tasks_) {
+    std::coroutine_handle<>::from_address(frame).destroy();
+  }
+  ::close(epoll_fd_);
+}
+
+void EventLoop::watch(int fd, std::uint32_t events, std::coroutine_handle<> handle) {
+  // one-shot, so a descriptor wakes its coroutine once per co_await and can switch direction
+  epoll_event event{};
+  event.events = events | EPOLLONESHOT;
+  event.data.ptr = handle.address();
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0) {
+    return;
+  }
+  if (errno != ENOENT or ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    throw std::runtime_error("Failed to watch descriptor " + std::to_string(fd) + ": " + std::strerror(errno));
+  }
+}
+
+void EventLoop::forget(int fd) {
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::spawn(Task task) {
+  auto const handle = task.release();
+  tasks_.insert(handle.address());
+  if (auto const error = resume(handle)) {
+    std::rethrow_exception(error);
+  }
+}
+
+std::exception_ptr EventLoop::resume(std::coroutine_handle<> handle) {
+  handle.resume();
+  if (!handle.done()) {
+    return nullptr;
+  }
+  auto const error = std::coroutine_handle<Task::promise_type>::from_address(handle.address()).promise().error;
+  tasks_.erase(handle.address());
+  handle.destroy();
+  return error;
+}
+
+std::size_t EventLoop::run_once(int timeout_ms) {
+  std::array<epoll_event, 64> events;
+  auto const n = ::epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), timeout_ms);
+  if (n < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    throw std::runtime_error(std::string{"epoll_wait failed: "} + std::strerror(errno));
+  }
+  // every ready coroutine runs before an error is reported: their one-shot events have been consumed
+  std::exception_ptr first_error;
+  for (int i = 0; i < n; ++i) {
+    auto const error = resume(std::coroutine_handle<>::from_address(events[static_cast<std::size_t>(i)].data.ptr));
+    if (error and !first_error) {
+      first_error = error;
+    }
+  }
+  if (first_error) {
+    std::rethrow_exception(first_error);
+  }
+  return static_cast<std::size_t>(n);
+}
+
+void EventLoop::run() {
+  while (!tasks_.empty()) {
+    run_once();
+  }
+}
+
+} // namespace bfasync
@@ -0,0 +1,207 @@
+#include "bfbatch.hpp"
+#include "bfcompiler.hpp"
+#include "bfsource.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace bfbatch {
+
+namespace {
+
+// A worker's share of the indices. The owner pops from the back, thieves take from the front.
+struct work_queue_t {
+  std::mutex mutex;
+  std::deque<std::size_t> indices;
+
+  std::optional<std::size_t> pop_back() {
+    std::lock_guard const lock{mutex};
+    if (indices.empty()) {
+      return std::nullopt;
+    }
+    auto const index = indices.back();
+    indices.pop_back();
+    return index;
+  }
+
+  std::optional<std::size_t> steal() {
+    std::lock_guard const lock{mutex};
+    if (indices.empty()) {
+      return std::nullopt;
+    }
+    auto const index = indices.front();
+    indices.pop_front();
+    return index;
+  }
+};
+
+std::string read_input(std::filesystem::path const& path) {
+  if (path.empty()) {
+    return {};
+  }
+  MappedFile const file{path.string()};
+  return std::string{file.view()};
+}
+
+template <typename Cell>
+std::string execute(std::span<inst_t const> program, std::string const& input, options_t const& options) {
+  std::istringstream in{input};
+  std::ostringstream out;
+  {
+    BasicBrainFckVM<Cell> vm{in, out, options.dispatch, options.tape};
+    vm.run(program);
+  }
+  return std::move(out).str();
+}
+
+} // namespace
+
+std::vector<job_t> parse_manifest(std::istream& is, std::filesystem::path const& base) {
+  std::vector<job_t> jobs;
+  auto const resolve = [&](std::string const& path) {
+    std::filesystem::path const p{path};
+    return p.is_relative() ? base / p : p;
+  };
+
+  std::string line;
+  for (std::size_t number = 1; std::getline(is, line); ++number) {
+    std::istringstream fields{line};
+    std::string program;
+    std::string input;
+    std::string output;
+    std::string extra;
+    if (!(fields >> program) or program.starts_with('#')) {
+      continue;
+    }
+    if (!(fields >> input >> output) or (fields >> extra)) {
+      throw std::runtime_error("Malformed manifest line " + std::to_string(number) + ": " + line);
+    }
+    jobs.push_back({resolve(program), input == "-" ? std::filesystem::path{} : resolve(input), resolve(output)});
+  }
+  return jobs;
+}
+
+void parallel_for(std::size_t count, std::size_t threads, std::function<void(std::size_t)> const& task) {
+  threads = std::max<std::size_t>(1, std::min(threads, count));
+  std::vector<work_queue_t> queues(threads);
+  for (std::size_t w = 0; w < threads; ++w) {
+    for (auto i = count * w / threads; i < count * (w + 1) / threads; ++i) {
+      queues[w].indices.push_back(i);
+    }
+  }
+
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto const worker = [&](std::size_t self) {
+    while (true) {
+      auto index = queues[self].pop_back();
+      for (std::size_t k = 1; !index and k < threads; ++k) {
+        index = queues[(self + k) % threads].steal();
+      }
+      if (!index) {
+        return;  // no task is ever added after the start, so empty queues mean we are done
+      }
+      try {
+        task(*index);
+      } catch (...) {
+        std::lock_guard const lock{error_mutex};
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  std::vector<std::jthread> pool;
+  pool.reserve(threads - 1);
+  for (std::size_t w = 1; w < threads; ++w) {
+    pool.emplace_back(worker, w);
+  }
+  worker(0);
+  pool.clear();  // join
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+programs_t compile_programs(std::vector<job_t> const& jobs, std::size_t optims) {
+  auto const start = std::chrono::steady_clock::now();
+  programs_t programs;
+  for (auto const& job : jobs) {
+    if (programs.compiled.contains(job.program) or programs.errors.contains(job.program)) {
+      continue;
+    }
+    try {
+      MappedFile const source{job.program.string()};
+      programs.compiled.emplace(job.program, compile(source.view(), optims));
+    } catch (std::runtime_error const& e) {
+      programs.errors.emplace(job.program, e.what());
+    }
+  }
+  programs.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return programs;
+}
+
+summary_t run(std::vector<job_t> const& jobs, options_t const& options) {
+  return run(jobs, compile_programs(jobs, options.optims), options);
+}
+
+summary_t run(std::vector<job_t> const& jobs, programs_t const& programs, options_t const& options) {
+  using clock = std::chrono::steady_clock;
+  summary_t summary;
+  summary.jobs = jobs.size();
+  summary.programs = programs.compiled.size();
+  summary.compile_seconds = programs.seconds;
+
+  std::vector<std::string> errors(jobs.size());
+  auto const run_start = clock::now();
+  parallel_for(jobs.size(), options.threads, [&](std::size_t i) {
+    auto const& job = jobs[i];
+    try {
+      if (auto const failed = programs.errors.find(job.program); failed != programs.errors.end()) {
+        throw std::runtime_error(failed->second);
+      }
+      auto const& program = programs.compiled.at(job.program);
+      auto const input = read_input(job.input);
+      std::string output;
+      switch (options.tape.cell_bits) {
+        case 16:
+          output = execute<std::uint16_t>(program, input, options);
+          break;
+        case 32:
+          output = execute<std::uint32_t>(program, input, options);
+          break;
+        default:
+          output = execute<std::uint8_t>(program, input, options);
+          break;
+      }
+      std::ofstream ofs{job.output, std::ios::binary | std::ios::trunc};
+      if (!ofs.write(output.data(), static_cast<std::streamsize>(output.size()))) {
+        throw std::runtime_error("Failed to write file: " + job.output.string());
+      }
+    } catch (std::runtime_error const& e) {
+      errors[i] = job.output.string() + ": " + e.what();
+    }
+  });
+  summary.run_seconds = std::chrono::duration<double>(clock::now() - run_start).count();
+
+  for (auto& error : errors) {
+    if (!error.empty()) {
+      summary.errors.push_back(std::move(error));
+    }
+  }
+  return summary;
+}
+
+} // namespace bfbatch
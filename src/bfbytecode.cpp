@@ -0,0 +1,299 @@
+#include "bfbytecode.hpp"
+#include "bfserial.hpp"
+#include "bfsuper.hpp"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+namespace bfbytecode {
+
+namespace {
+
+// The raw encoding is inst_t's little-endian layout, padding zeroed, so a mapped file runs in place.
+static_assert(sizeof(inst_t) == 8 and std::is_trivially_copyable_v<inst_t>, "raw encoding is the layout of inst_t");
+static_assert(offsetof(inst_t, opcode) == 0 and offsetof(inst_t, offset) == 2 and offsetof(inst_t, operand) == 4,
+              "raw encoding is the layout of inst_t");
+
+constexpr std::array<char, 8> magic{'C', 'C', 'B', 'F', 'B', 'C', '\0', '\0'};
+constexpr auto last_opcode = bfsuper::last_opcode;
+
+// Varint opcode byte: low 6 bits opcode, then flags for the operands that follow.
+constexpr std::uint8_t has_offset = 0x80;
+constexpr std::uint8_t has_operand = 0x40;
+
+using bfserial::get_le;
+using bfserial::put_le;
+
+void put_varint(std::string& out, std::int64_t value) {
+  auto zigzag = (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+  while (zigzag >= 0x80) {
+    out += static_cast<char>((zigzag & 0x7f) | 0x80);
+    zigzag >>= 7;
+  }
+  out += static_cast<char>(zigzag);
+}
+
+std::int64_t get_varint(unsigned char const*& p, unsigned char const* end) {
+  std::uint64_t zigzag = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (p == end) {
+      throw std::runtime_error("Truncated bytecode file");
+    }
+    auto const byte = *p++;
+    zigzag |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+    }
+  }
+  throw std::runtime_error("Malformed varint in bytecode file");
+}
+
+bool is_jump(inst_t::op_code_t op) {
+  return op == inst_t::op_code_t::jmpz or op == inst_t::op_code_t::jmpnz;
+}
+
+// Decodes count instructions and advances p past them.
+std::vector<inst_t> decode_varint(unsigned char const*& p, unsigned char const* end, std::uint32_t count) {
+  std::vector<inst_t> program;
+  program.reserve(count);
+  for (std::uint32_t ip = 0; ip < count; ++ip) {
+    if (p == end) {
+      throw std::runtime_error("Truncated bytecode file");
+    }
+    auto const tag = *p++;
+    auto const op = static_cast<inst_t::op_code_t>(tag & 0x3f);
+    if (op > last_opcode) {
+      throw std::runtime_error("Unknown opcode in bytecode file");
+    }
+    auto const offset = (tag & has_offset) != 0 ? get_varint(p, end) : 0;
+    auto operand = (tag & has_operand) != 0 ? get_varint(p, end) : 0;
+    if (is_jump(op)) {
+      operand += ip;
+    }
+    program.emplace_back(op, static_cast<std::int32_t>(operand), static_cast<std::int16_t>(offset));
+  }
+  return program;
+}
+
+// Sizes are checked against the bytes left so a corrupt count cannot allocate without bound.
+std::size_t get_size(unsigned char const*& p, unsigned char const* end) {
+  auto const value = get_varint(p, end);
+  if (value < 0 or static_cast<std::uint64_t>(value) > static_cast<std::uint64_t>(end - p)) {
+    throw std::runtime_error("Malformed start state");
+  }
+  return static_cast<std::size_t>(value);
+}
+
+// The engines index handler tables by opcode and follow jumps without bounds checks, so a loaded program
+// must hold known opcodes, jumps paired with each other, and superinstructions followed by their pattern.
+void validate(std::span<inst_t const> program) {
+  auto const jump = [&](std::size_t ip, inst_t::op_code_t expected) {
+    auto const target = program[ip].operand;
+    return target >= 0 and static_cast<std::size_t>(target) < program.size() and
+           bfsuper::plain(program[static_cast<std::size_t>(target)].opcode) == expected and
+           program[static_cast<std::size_t>(target)].operand == static_cast<std::int64_t>(ip);
+  };
+  for (std::size_t ip = 0; ip < program.size(); ++ip) {
+    auto const op = program[ip].opcode;
+    if (op > last_opcode) {
+      throw std::runtime_error("Unknown opcode in bytecode file");
+    }
+    if (bfsuper::is_super(op)) {
+      auto const pattern = bfsuper::patterns[bfsuper::index(op)];
+      if (program.size() - ip < pattern.size()) {
+        throw std::runtime_error("Truncated superinstruction in bytecode file");
+      }
+      for (std::size_t k = 1; k < pattern.size(); ++k) {
+        if (program[ip + k].opcode != pattern[k]) {
+          throw std::runtime_error("Malformed superinstruction in bytecode file");
+        }
+      }
+    }
+    auto const plain = bfsuper::plain(op);
+    if ((plain == inst_t::op_code_t::jmpz and
+         (program[ip].operand <= static_cast<std::int64_t>(ip) or !jump(ip, inst_t::op_code_t::jmpnz))) or
+        (plain == inst_t::op_code_t::jmpnz and
+         (program[ip].operand >= static_cast<std::int64_t>(ip) or !jump(ip, inst_t::op_code_t::jmpz)))) {
+      throw std::runtime_error("Unmatched jump in bytecode file");
+    }
+  }
+}
+
+std::string hex(std::uint64_t value) {
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+  return buffer;
+}
+
+} // namespace
+
+std::uint64_t source_hash(std::string_view source) {
+  auto hash = bfserial::fnv_basis;
+  for (auto const c : source) {
+    bfserial::fnv_mix(hash, static_cast<unsigned char>(c), 1);
+  }
+  return hash;
+}
+
+void append_state(std::string& out, bftape::initial_t const& initial) {
+  put_varint(out, initial.cell_bits);
+  put_varint(out, static_cast<std::int64_t>(initial.policy));
+  put_varint(out, static_cast<std::int64_t>(initial.tape_size));
+  put_varint(out, static_cast<std::int64_t>(initial.pointer));
+  put_varint(out, static_cast<std::int64_t>(initial.pc));
+  put_varint(out, static_cast<std::int64_t>(initial.base));
+  put_varint(out, static_cast<std::int64_t>(initial.cells.size()));
+  for (auto const cell : initial.cells) {
+    put_varint(out, cell);
+  }
+  put_varint(out, static_cast<std::int64_t>(initial.output.size()));
+  out += initial.output;
+}
+
+bftape::initial_t read_state(std::string_view& bytes, std::size_t max_pc) {
+  auto const* const begin = reinterpret_cast<unsigned char const*>(bytes.data());
+  auto const* const end = begin + bytes.size();
+  auto const* p = begin;
+  bftape::initial_t initial;
+  initial.cell_bits = static_cast<unsigned>(get_varint(p, end));
+  auto const policy = get_varint(p, end);
+  initial.tape_size = static_cast<std::size_t>(get_varint(p, end));
+  initial.pointer = static_cast<std::size_t>(get_varint(p, end));
+  initial.pc = static_cast<std::size_t>(get_varint(p, end));
+  initial.base = static_cast<std::size_t>(get_varint(p, end));
+  if (policy < 0 or policy > static_cast<std::int64_t>(bftape::policy_t::grow) or initial.pc > max_pc) {
+    throw std::runtime_error("Malformed start state");
+  }
+  initial.policy = static_cast<bftape::policy_t>(policy);
+  initial.cells.resize(get_size(p, end));
+  for (auto& cell : initial.cells) {
+    cell = static_cast<std::uint32_t>(get_varint(p, end));
+  }
+  auto const output = get_size(p, end);
+  initial.output.assign(reinterpret_cast<char const*>(p), output);
+  bytes.remove_prefix(static_cast<std::size_t>(p - begin) + output);
+  return initial;
+}
+
+namespace {
+
+std::string encode(std::span<inst_t const> program, header_t header, bftape::initial_t const& initial) {
+  header.version = format_version;
+  header.count = static_cast<std::uint32_t>(program.size());
+
+  std::string out{magic.data(), magic.size()};
+  put_le(out, header.version);
+  put_le(out, static_cast<std::uint8_t>(header.encoding));
+  put_le(out, header.optims);
+  put_le(out, header.count);
+  put_le(out, header.source_size);
+  put_le(out, header.source_hash);
+
+  if (header.encoding == encoding_t::raw) {
+    for (auto const& inst : program) {
+      put_le(out, static_cast<std::uint8_t>(inst.opcode));
+      put_le(out, std::uint8_t{0});
+      put_le(out, static_cast<std::uint16_t>(inst.offset));
+      put_le(out, static_cast<std::uint32_t>(inst.operand));
+    }
+  } else {
+    for (std::size_t ip = 0; ip < program.size(); ++ip) {
+      auto const& inst = program[ip];
+      std::int64_t const operand = is_jump(inst.opcode) ? std::int64_t{inst.operand} - static_cast<std::int64_t>(ip)
+                                                        : inst.operand;
+      out += static_cast<char>(static_cast<std::uint8_t>(inst.opcode) | (inst.offset != 0 ? has_offset : 0) |
+                               (operand != 0 ? has_operand : 0));
+      if (inst.offset != 0) {
+        put_varint(out, inst.offset);
+      }
+      if (operand != 0) {
+        put_varint(out, operand);
+      }
+    }
+  }
+  if (!initial.empty()) {
+    append_state(out, initial);
+  }
+  return out;
+}
+
+} // namespace
+
+void write(std::ostream& os, std::span<inst_t const> program, header_t header, bftape::initial_t const& initial) {
+  auto const bytes = encode(program, header, initial);
+  os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+void write_file(std::filesystem::path const& path, std::span<inst_t const> program, header_t header,
+                bftape::initial_t const& initial) {
+  bfserial::replace_file(path, encode(program, header, initial));
+}
+
+std::filesystem::path cache_entry(std::filesystem::path const& dir, std::string_view source, std::size_t optims) {
+  return dir / (hex(source_hash(source)) + "-" + std::to_string(source.size()) + "-O" + std::to_string(optims) +
+                ".ccbc");
+}
+
+BytecodeFile::BytecodeFile(std::string const& path) : file_{path} {
+  auto const bytes = file_.view();
+  auto const* p = reinterpret_cast<unsigned char const*>(bytes.data());
+  if (bytes.size() < header_size or std::memcmp(p, magic.data(), magic.size()) != 0) {
+    throw std::runtime_error("Not a bytecode file: " + path);
+  }
+  header_.version = get_le<std::uint16_t>(p + 8);
+  header_.encoding = static_cast<encoding_t>(p[10]);
+  header_.optims = p[11];
+  header_.count = get_le<std::uint32_t>(p + 12);
+  header_.source_size = get_le<std::uint64_t>(p + 16);
+  header_.source_hash = get_le<std::uint64_t>(p + 24);
+  if (header_.version != format_version) {
+    throw std::runtime_error("Unsupported bytecode version " + std::to_string(header_.version) + ": " + path);
+  }
+
+  auto const* payload = p + header_size;
+  auto const* const end = p + bytes.size();
+  if (header_.encoding == encoding_t::raw) {
+    auto const program_size = std::size_t{header_.count} * sizeof(inst_t);
+    if (static_cast<std::size_t>(end - payload) < program_size) {
+      throw std::runtime_error("Truncated bytecode file: " + path);
+    }
+    if (std::endian::native == std::endian::little and
+        reinterpret_cast<std::uintptr_t>(payload) % alignof(inst_t) == 0) {
+      program_ = {reinterpret_cast<inst_t const*>(payload), header_.count};
+    } else {
+      decoded_.reserve(header_.count);
+      for (auto const* q = payload; q != payload + program_size; q += sizeof(inst_t)) {
+        decoded_.emplace_back(static_cast<inst_t::op_code_t>(q[0]), get_le<std::int32_t>(q + 4),
+                              get_le<std::int16_t>(q + 2));
+      }
+      program_ = decoded_;
+    }
+    payload += program_size;
+  } else if (header_.encoding == encoding_t::varint) {
+    decoded_ = decode_varint(payload, end, header_.count);
+    program_ = decoded_;
+  } else {
+    throw std::runtime_error("Unknown bytecode encoding: " + path);
+  }
+  validate(program_);
+  if (payload != end) {
+    std::string_view rest{reinterpret_cast<char const*>(payload), static_cast<std::size_t>(end - payload)};
+    initial_ = read_state(rest, header_.count);
+    if (!rest.empty()) {
+      throw std::runtime_error("Trailing data in bytecode file: " + path);
+    }
+  }
+}
+
+bool BytecodeFile::matches(std::string_view source, std::size_t optims) const {
+  return header_.optims == optims and header_.source_size == source.size() and
+         header_.source_hash == source_hash(source);
+}
+
+} // namespace bfbytecode
@@ -0,0 +1,79 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bytecode.hpp"
+#include "bfcodegen.hpp"
+#include "bfcompiler.hpp"
+#include "bfsource.hpp"
+
+namespace {
+
+void print_usage(char const* argv0) {
+  std::cout << "Usage " << argv0 << " [-o <output>] [--emit-c] [--cc=<compiler>] <file> optimization level [0-4] \n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+  std::string output;
+  std::string c_compiler = bfcodegen::default_c_compiler();
+  bool emit_only = false;
+  std::vector<std::string_view> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg{argv[i]};
+    if (arg == "-o" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (arg == "--emit-c") {
+      emit_only = true;
+    } else if (arg.starts_with("--cc=")) {
+      c_compiler = std::string{arg.substr(5)};
+    } else if (arg.starts_with("-")) {
+      std::cerr << "Unknown option: " << arg << '\n';
+      print_usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  if (positional.size() != 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (output.empty()) {
+    auto const stem = std::filesystem::path{positional[0]}.stem().string();
+    output = emit_only ? stem + ".c" : stem;
+  }
+
+  std::vector<inst_t> bytecodes;
+  try {
+    MappedFile const source{std::string{positional[0]}};
+    bytecodes = compile(source.view(), std::atoi(std::string{positional[1]}.c_str()));
+  } catch (std::runtime_error const& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  if (emit_only) {
+    std::ofstream ofs{output};
+    if (!ofs.is_open()) {
+      std::cerr << "Failed to write file: " << output << '\n';
+      return 1;
+    }
+    bfcodegen::emit_c(bytecodes, ofs);
+    return 0;
+  }
+
+  if (bfcodegen::build_native(bytecodes, output, c_compiler) != 0) {
+    std::cerr << "C compiler failed: " << c_compiler << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include "bfcodegen.hpp"
+#include "bfsuper.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace bfcodegen {
+
+namespace {
+
+// Runtime shared by every generated program: wrapping tape access, zero scans and input that flushes
+// pending output first only when stdin is a terminal (a prompt must show before the read waits).
+constexpr char const* c_prelude = R"(#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static uint8_t tape[TAPE_SIZE];
+static int interactive;
+
+static size_t wrap(ptrdiff_t p) {
+  p %= (ptrdiff_t)TAPE_SIZE;
+  return (size_t)(p < 0 ? p + (ptrdiff_t)TAPE_SIZE : p);
+}
+
+static size_t at(size_t mp, ptrdiff_t offset) {
+  size_t next = mp + (size_t)offset;
+  return next < TAPE_SIZE ? next : wrap((ptrdiff_t)mp + offset);
+}
+
+static size_t scan(size_t mp, ptrdiff_t stride) {
+  while (tape[mp]) {
+    mp = at(mp, stride);
+  }
+  return mp;
+}
+
+static void in(size_t p) {
+  int c;
+  if (interactive) {
+    fflush(stdout);
+  }
+  c = getchar();
+  tape[p] = (uint8_t)(c == EOF ? 0 : c);
+}
+
+int main(void) {
+  size_t mp = 0;
+  interactive = isatty(0);
+)";
+
+// Wrap a path for /bin/sh.
+std::string shell_quote(std::string const& s) {
+  std::string quoted{"'"};
+  for (auto const c : s) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += '\'';
+  return quoted;
+}
+
+} // namespace
+
+void emit_c(std::span<inst_t const> program, std::ostream& os, std::size_t memory_size) {
+  os << "#define TAPE_SIZE " << memory_size << "u\n" << c_prelude;
+
+  int indent = 1;
+  auto const line = [&]() -> std::ostream& {
+    for (int i = 0; i < indent; ++i) {
+      os << "  ";
+    }
+    return os;
+  };
+  auto const cell = [](std::int16_t offset) {
+    return offset == 0 ? std::string{"tape[mp]"} : "tape[at(mp, " + std::to_string(offset) + ")]";
+  };
+
+  for (auto const& inst : program) {
+    switch (bfsuper::plain(inst.opcode)) {  // the C compiler does its own fusing
+      case inst_t::op_code_t::nop:
+      case inst_t::op_code_t::super:  // not returned by plain()
+        break;
+      case inst_t::op_code_t::mpadd:
+        line() << "mp = at(mp, " << inst.operand << ");\n";
+        break;
+      case inst_t::op_code_t::add:
+        line() << cell(inst.offset) << " += (uint8_t)" << inst.operand << ";\n";
+        break;
+      case inst_t::op_code_t::set:
+        line() << cell(inst.offset) << " = (uint8_t)" << inst.operand << ";\n";
+        break;
+      case inst_t::op_code_t::mul:
+        // unsigned, like the VM's product(): tape[mp] * operand may not fit in an int
+        line() << cell(inst.offset) << " += (uint8_t)((uint32_t)tape[mp] * (uint32_t)(" << inst.operand << "));\n";
+        break;
+      case inst_t::op_code_t::scan:
+        line() << "mp = scan(mp, " << inst.operand << ");\n";
+        break;
+      case inst_t::op_code_t::jmpz:
+        line() << "while (tape[mp]) {\n";
+        ++indent;
+        break;
+      case inst_t::op_code_t::jmpnz:
+        if (indent == 1) {
+          throw std::runtime_error("Unmatched closing bracket in Brainfuck program");
+        }
+        --indent;
+        line() << "}\n";
+        break;
+      case inst_t::op_code_t::out:
+        line() << "putchar(" << cell(inst.offset) << ");\n";
+        break;
+      case inst_t::op_code_t::in:
+        line() << "in(" << (inst.offset == 0 ? std::string{"mp"} : "at(mp, " + std::to_string(inst.offset) + ")")
+               << ");\n";
+        break;
+    }
+  }
+  if (indent != 1) {
+    throw std::runtime_error("Unmatched opening bracket in Brainfuck program");
+  }
+
+  os << "  fflush(stdout);\n  return 0;\n}\n";
+}
+
+std::string default_c_compiler() {
+  auto const* cc = std::getenv("CC");
+  return (cc != nullptr && *cc != '\0') ? std::string{cc} : std::string{"cc"};
+}
+
+int build_native(std::span<inst_t const> program, std::string const& output, std::string const& c_compiler,
+                 bool keep_source) {
+  auto const source = output + ".c";
+  {
+    std::ofstream ofs{source};
+    if (!ofs.is_open()) {
+      throw std::runtime_error("Failed to write " + source);
+    }
+    emit_c(program, ofs);
+  }
+
+  auto const command = c_compiler + " -O2 -o " + shell_quote(output) + " " + shell_quote(source);
+  auto const status = std::system(command.c_str());
+
+  if (!keep_source) {
+    std::remove(source.c_str());
+  }
+  return status;
+}
+
+} // namespace bfcodegen
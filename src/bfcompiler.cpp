@@ -1,8 +1,15 @@
 #include "bfcompiler.hpp"
+#include <algorithm>
 #include <iterator>
+#include <limits>
+#include <map>
 #include <ranges>
 #include <numeric>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <tuple>
 #include <iostream>
 #include <vector>
 
@@ -11,120 +18,652 @@ namespace rng = std::ranges;
 
 namespace bfcompiler_internal {
 
-// Annotate matching bracket offsets across the bytecode stream.
-void resolve_jumps(std::vector<inst_t>& bytecodes) {
-  auto const program_size = bytecodes.size();
-  std::vector<std::size_t> loop_stack;
+namespace {
 
-  for (std::size_t i = 0; i < program_size; ++i) {
-    auto const inst = bytecodes[i];
-    if (inst.opcode == inst_t::op_code_t::jmpz) {
-      loop_stack.push_back(i);
-    } else if (inst.opcode == inst_t::op_code_t::jmpnz) {
-      if (loop_stack.empty()) {
-        std::cerr << "Unmatched closing bracket at instruction " << i << '\n';
-        throw std::runtime_error("Unmatched closing bracket in Brainfuck program");
-      }
-      auto const match = loop_stack.back();
-      loop_stack.pop_back();
-      bytecodes[match].operand = i;
-      bytecodes[i].operand = match;
+std::string describe(source_map_t::position_t at) {
+  return "line " + std::to_string(at.line) + ", column " + std::to_string(at.column);
+}
+
+// Where instruction i came from, for diagnostics: its source line and column when map covers it.
+std::string describe(source_map_t const* map, std::size_t i) {
+  if (map == nullptr or i >= map->size()) {
+    return "instruction " + std::to_string(i);
+  }
+  return describe(map->position(map->begin[i]));
+}
+
+[[noreturn]] void throw_opening_at(std::string const& where, std::size_t count) {
+  auto message = "Unmatched opening bracket at " + where;
+  if (count > 1) {
+    message += " (" + std::to_string(count) + " unmatched)";
+  }
+  throw std::runtime_error(message);
+}
+
+} // namespace
+
+void throw_unmatched_close(source_map_t const* map, std::size_t i) {
+  throw std::runtime_error("Unmatched closing bracket at " + describe(map, i));
+}
+
+void throw_unmatched_open(source_map_t const* map, std::vector<std::size_t> const& open) {
+  // the outermost one: every bracket opened after it may be matched by the closing brackets present
+  throw_opening_at(describe(map, open.front()), open.size());
+}
+
+void throw_unmatched_close(source_map_t::position_t at) {
+  throw std::runtime_error("Unmatched closing bracket at " + describe(at));
+}
+
+void throw_unmatched_open(source_map_t::position_t outermost, std::size_t count) {
+  throw_opening_at(describe(outermost), count);
+}
+
+std::vector<inst_t> optimize_and_resolve(std::vector<inst_t> bytecodes, std::size_t op_codes, size_t optims,
+                                         source_map_t* map) {
+  std::cout << "Compiled program: " << op_codes << " op codes\n";
+
+  if (optims>0) {
+    // runs were already collapsed while translating
+    std::cout << "Optimization 1: " << rng::size(bytecodes) << " op codes\n";
+  }
+  optimize_fused(bytecodes, optims, map);
+  if (optims>1) {
+    std::cout << "Optimization " << std::min<std::size_t>(optims, 4) << ": " << rng::size(bytecodes) << " op codes\n";
+  }
+  if (optims>4) {
+    bytecodes = optimize_bytecodes_opt5(bytecodes, map);
+    resolve_jumps(bytecodes, map);
+    std::cout << "Optimization 5: " << rng::size(bytecodes) << " op codes\n";
+  }
+  //print_bytecodes(bytecodes);
+
+  return bytecodes;
+}
+
+std::vector<inst_t> optimize_chained(std::vector<inst_t> bytecodes, size_t optims, source_map_t* map) {
+  if (optims>1) {
+    bytecodes = optimize_bytecodes_opt2(bytecodes, map);
+  }
+  if (optims>2) {
+    bytecodes = optimize_bytecodes_opt3(bytecodes, map);
+  }
+  if (optims>3) {
+    bytecodes = optimize_bytecodes_opt4(bytecodes, map);
+  }
+  resolve_jumps(bytecodes, map);
+
+  return bytecodes;
+}
+
+//// Third optimization
+// Rewrite balanced multiply loops like [->+>++<<] into
+// mem[mp+1] += mem[mp]*1; mem[mp+2] += mem[mp]*2; mem[mp] = 0
+namespace {
+
+// Try to turn an innermost loop body (brackets excluded) into mul/set instructions.
+bool reduce_multiply_loop(std::span<inst_t const> body, std::vector<inst_t>& out) {
+  std::map<std::int32_t, std::int32_t> deltas;  // offset -> total added per iteration
+  std::int32_t offset{0};
+
+  for (auto const& inst : body) {
+    if (inst.opcode == inst_t::op_code_t::mpadd) {
+      offset += inst.operand;
+    } else if (inst.opcode == inst_t::op_code_t::add) {
+      deltas[offset] += inst.operand;
+    } else {
+      return false;  // I/O, set or anything else: keep the loop
+    }
+    if (offset < std::numeric_limits<std::int16_t>::min() or offset > std::numeric_limits<std::int16_t>::max()) {
+      return false;
     }
   }
 
-  if (!loop_stack.empty()) {
-    for (auto const unmatched_index : loop_stack) {
-      std::cerr << "Unmatched opening bracket at instruction " << unmatched_index << '\n';
+  if (offset != 0 or deltas[0] != -1) {
+    return false;
+  }
+
+  for (auto const& [target, factor] : deltas) {
+    if (target != 0 and factor != 0) {
+      out.emplace_back(inst_t::op_code_t::mul, factor, static_cast<std::int16_t>(target));
     }
-    throw std::runtime_error("Unmatched opening bracket in Brainfuck program");
   }
+  out.emplace_back(inst_t::op_code_t::set, 0);
+  return true;
 }
 
+} // namespace
 
-////// First optimization
-// Merge consecutive pointer/memory arithmetic instructions.
-std::vector<inst_t> optimize_bytecodes_opt1(std::vector<inst_t> const& bytecodes) {
+std::vector<inst_t> optimize_bytecodes_opt3(std::vector<inst_t> const& bytecodes, source_map_t* map) {
+  static auto constexpr is_bracket = [](inst_t const& i) {
+    return i.opcode == inst_t::op_code_t::jmpz or i.opcode == inst_t::op_code_t::jmpnz;
+  };
 
-  static auto constexpr collapsable = [](inst_t const &i) { return (i.opcode == inst_t::op_code_t::mpadd) or (i.opcode == inst_t::op_code_t::add); };
+  std::vector<inst_t> bytecodes_opt;
+  bytecodes_opt.reserve(bytecodes.size());
+  source_map_t spans;
+  auto const span_of = [&](auto first, auto last) {
+    if (map != nullptr) {
+      spans.push_back(map->begin[static_cast<std::size_t>(first - bytecodes.begin())],
+                      map->end[static_cast<std::size_t>(last - bytecodes.begin())]);
+    }
+  };
+
+  auto it = bytecodes.begin();
+  while (it != bytecodes.end()) {
+    if (it->opcode == inst_t::op_code_t::jmpz) {
+      // innermost loop: the next bracket closes this one
+      auto const close = rng::find_if(std::next(it), bytecodes.end(), is_bracket);
+      auto const emitted = bytecodes_opt.size();
+      if (close != bytecodes.end() and close->opcode == inst_t::op_code_t::jmpnz
+          and reduce_multiply_loop(std::span{std::next(it), close}, bytecodes_opt)) {
+        for (auto k = emitted; k < bytecodes_opt.size(); ++k) {
+          span_of(it, close);
+        }
+        it = std::next(close);
+        continue;
+      }
+    }
+    bytecodes_opt.push_back(*it);
+    span_of(it, it);
+    ++it;
+  }
+  replace_spans(map, std::move(spans));
+
+  return bytecodes_opt;
+}
 
-  auto opt_view = bytecodes |
-             vws::chunk_by([](auto const& i, auto const& j) { return (i.opcode == j.opcode) and (collapsable(i)); }) |
-             vws::transform([](auto chunk) {
-               return *rng::fold_left_first(
-                 chunk, [](auto const& acum, auto const& i) { return inst_t{acum.opcode, acum.operand + i.operand}; });
-                 });
+//// Fourth optimization
+// Fold pointer moves into memory offsets: >+>++<<- becomes add@1 1, add@2 2, add@0 -1
+// with a single mpadd flushed before each jump, mul and the end of the program.
+std::vector<inst_t> optimize_bytecodes_opt4(std::vector<inst_t> const& bytecodes, source_map_t* map) {
   std::vector<inst_t> bytecodes_opt;
-  rng::copy(opt_view, std::back_inserter(bytecodes_opt));  // for lack of rng::to()
+  bytecodes_opt.reserve(bytecodes.size());
+  source_map_t spans;
+
+  std::int32_t pending{0};  // pointer movement not yet emitted
+  std::uint32_t pending_begin{0};  // and the source it came from
+  std::uint32_t pending_end{0};
+
+  auto const flush = [&]() {
+    if (pending != 0) {
+      bytecodes_opt.emplace_back(inst_t::op_code_t::mpadd, pending);
+      if (map != nullptr) {
+        spans.push_back(pending_begin, pending_end);
+      }
+      pending = 0;
+    }
+  };
+
+  for (std::size_t i = 0; i < bytecodes.size(); ++i) {
+    auto const& inst = bytecodes[i];
+    auto const begin = map != nullptr ? map->begin[i] : 0;
+    auto const end = map != nullptr ? map->end[i] : 0;
+    switch (inst.opcode) {
+      case inst_t::op_code_t::mpadd:
+        if (pending == 0) {
+          pending_begin = begin;
+        }
+        pending += inst.operand;
+        pending_end = end;
+        break;
+
+      case inst_t::op_code_t::add:
+      case inst_t::op_code_t::set:
+      case inst_t::op_code_t::in:
+      case inst_t::op_code_t::out: {
+        if (pending < std::numeric_limits<std::int16_t>::min() or pending > std::numeric_limits<std::int16_t>::max()) {
+          flush();
+        }
+        auto const offset = static_cast<std::int16_t>(pending);
+        if (!bytecodes_opt.empty() and bytecodes_opt.back().offset == offset
+            and inst.opcode == inst_t::op_code_t::add
+            and (bytecodes_opt.back().opcode == inst_t::op_code_t::add
+                 or bytecodes_opt.back().opcode == inst_t::op_code_t::set)) {
+          bytecodes_opt.back().operand += inst.operand;  // add after add/set on the same cell
+          if (map != nullptr) {
+            spans.end.back() = end;
+          }
+        } else {
+          bytecodes_opt.emplace_back(inst.opcode, inst.operand, offset);
+          if (map != nullptr) {
+            spans.push_back(begin, end);
+          }
+        }
+        break;
+      }
+
+      case inst_t::op_code_t::nop:
+        break;
+
+      default:  // jumps and mul address the cell under the pointer
+        flush();
+        bytecodes_opt.push_back(inst);
+        if (map != nullptr) {
+          spans.push_back(begin, end);
+        }
+        break;
+    }
+  }
+  flush();
+  replace_spans(map, std::move(spans));
 
   return bytecodes_opt;
-  
 }
 
+//// Fused optimization
+// Levels 2-4 and jump resolution in one scan over the collapsed bytecode, writing the result over
+// its input. A loop is rewritten by the first pass of the chain that would rewrite it, and the
+// instructions that come out go through the level 4 pointer folding on their way to the output.
+namespace {
 
+// Output side of the fused pass: folds pointer moves (level 4) and resolves jumps as instructions
+// are written. Every instruction written consumed at least one input instruction, and a pending
+// pointer move always consumed one, so writes never overtake the read position.
+class fused_writer_t {
+ public:
+  fused_writer_t(std::vector<inst_t>& code, source_map_t* map, bool fold) : code_{code}, map_{map}, fold_{fold} {}
 
-// Return the nesting depth for each instruction in a program.
-std::vector<size_t> loop_depths(std::vector<inst_t> const &prg) {
+  // Level 4 rewrite, as optimize_bytecodes_opt4.
+  void emit(inst_t const& inst, std::uint32_t begin, std::uint32_t end) {
+    if (!fold_) {
+      put(inst, begin, end);
+      return;
+    }
+    switch (inst.opcode) {
+      case inst_t::op_code_t::mpadd:
+        if (pending_ == 0) {
+          pending_begin_ = begin;
+        }
+        pending_ += inst.operand;
+        pending_end_ = end;
+        break;
 
-  
-  size_t depth{0};
-  auto depth_inc = [&depth](auto const& i) {
-    auto ret = depth;
-    if (i.opcode == inst_t::op_code_t::jmpz) {
-      ++depth;
-      ret = depth;
-    } else if (i.opcode == inst_t::op_code_t::jmpnz) {
-      --depth;
+      case inst_t::op_code_t::add:
+      case inst_t::op_code_t::set:
+      case inst_t::op_code_t::in:
+      case inst_t::op_code_t::out: {
+        if (pending_ < std::numeric_limits<std::int16_t>::min() or pending_ > std::numeric_limits<std::int16_t>::max()) {
+          flush();
+        }
+        auto const offset = static_cast<std::int16_t>(pending_);
+        if (w_ > 0 and code_[w_ - 1].offset == offset and inst.opcode == inst_t::op_code_t::add
+            and (code_[w_ - 1].opcode == inst_t::op_code_t::add or code_[w_ - 1].opcode == inst_t::op_code_t::set)) {
+          code_[w_ - 1].operand += inst.operand;  // add after add/set on the same cell
+          if (map_ != nullptr) {
+            map_->end[w_ - 1] = end;
+          }
+        } else {
+          put(inst_t{inst.opcode, inst.operand, offset}, begin, end);
+        }
+        break;
+      }
+
+      case inst_t::op_code_t::nop:
+        break;
+
+      default:  // jumps and mul address the cell under the pointer
+        flush();
+        put(inst, begin, end);
+        break;
     }
-    return ret;
-  };
+  }
+
+  // Flush the pointer, check that every loop was closed and trim the buffers to the output.
+  void finish() {
+    flush();
+    if (!open_.empty()) {
+      throw_unmatched_open(map_, open_);
+    }
+    code_.resize(w_);
+    if (map_ != nullptr) {
+      map_->begin.resize(w_);
+      map_->end.resize(w_);
+    }
+  }
+
+ private:
+  void flush() {
+    if (pending_ != 0) {
+      put(inst_t{inst_t::op_code_t::mpadd, pending_}, pending_begin_, pending_end_);
+      pending_ = 0;
+    }
+  }
+
+  void put(inst_t const& inst, std::uint32_t begin, std::uint32_t end) {
+    code_[w_] = inst;
+    if (map_ != nullptr) {
+      map_->begin[w_] = begin;
+      map_->end[w_] = end;
+    }
+    if (inst.opcode == inst_t::op_code_t::jmpz) {
+      open_.push_back(w_);
+    } else if (inst.opcode == inst_t::op_code_t::jmpnz) {
+      if (open_.empty()) {
+        throw_unmatched_close(map_, w_);
+      }
+      auto const match = open_.back();
+      open_.pop_back();
+      code_[match].operand = static_cast<std::int32_t>(w_);
+      code_[w_].operand = static_cast<std::int32_t>(match);
+    }
+    ++w_;
+  }
 
-  std::vector<size_t> ret;
+  std::vector<inst_t>& code_;
+  source_map_t* map_;
+  bool fold_;
+  std::size_t w_{0};  // write position
+  std::int32_t pending_{0};  // pointer movement not yet written
+  std::uint32_t pending_begin_{0};
+  std::uint32_t pending_end_{0};
+  std::vector<std::size_t> open_;  // write positions of the open loops
+};
 
-  rng::copy( prg | vws::transform(depth_inc), std::back_inserter(ret));
+} // namespace
 
-  return ret;
+void optimize_fused(std::vector<inst_t>& bytecodes, std::size_t optims, source_map_t* map) {
+  auto* const spans = map != nullptr and map->size() == bytecodes.size() ? map : nullptr;
+  auto const begin_of = [spans](std::size_t i) { return spans != nullptr ? spans->begin[i] : 0; };
+  auto const end_of = [spans](std::size_t i) { return spans != nullptr ? spans->end[i] : 0; };
 
+  fused_writer_t out{bytecodes, spans, optims > 3};
+  std::vector<std::pair<std::int32_t, std::int32_t>> deltas;  // level 3 scratch, reused by every loop
+  auto const size = bytecodes.size();
+  auto previous = inst_t::op_code_t::nop;  // opcode of the last instruction read
+
+  std::size_t r{0};
+  while (r < size) {
+    auto const inst = bytecodes[r];
+    if (inst.opcode == inst_t::op_code_t::jmpz and optims > 1) {
+      // Level 2: [-] and [>]. Like optimize_bytecodes_opt2, which works on chunks of equal depth, leave
+      // the loop alone when it follows or precedes another loop at the same depth.
+      if (r + 2 < size and bytecodes[r + 2].opcode == inst_t::op_code_t::jmpnz
+          and previous != inst_t::op_code_t::jmpnz
+          and (r + 3 == size or bytecodes[r + 3].opcode != inst_t::op_code_t::jmpz)) {
+        auto const body = bytecodes[r + 1];
+        if (body.opcode == inst_t::op_code_t::add and body.operand == -1) {
+          out.emit(inst_t{inst_t::op_code_t::set, 0}, begin_of(r), end_of(r + 2));
+          previous = inst_t::op_code_t::jmpnz;
+          r += 3;
+          continue;
+        }
+        if (body.opcode == inst_t::op_code_t::mpadd) {
+          out.emit(inst_t{inst_t::op_code_t::scan, body.operand}, begin_of(r), end_of(r + 2));
+          previous = inst_t::op_code_t::jmpnz;
+          r += 3;
+          continue;
+        }
+      }
+
+      // Level 3: balanced multiply loops, as reduce_multiply_loop.
+      if (optims > 2) {
+        deltas.clear();
+        std::int32_t offset{0};
+        auto close = r + 1;
+        for (; close < size; ++close) {
+          auto const& body = bytecodes[close];
+          if (body.opcode == inst_t::op_code_t::mpadd) {
+            offset += body.operand;
+            if (offset < std::numeric_limits<std::int16_t>::min() or offset > std::numeric_limits<std::int16_t>::max()) {
+              break;
+            }
+          } else if (body.opcode == inst_t::op_code_t::add) {
+            deltas.emplace_back(offset, body.operand);
+          } else {
+            break;
+          }
+        }
+        if (close < size and bytecodes[close].opcode == inst_t::op_code_t::jmpnz and offset == 0) {
+          rng::sort(deltas, {}, &std::pair<std::int32_t, std::int32_t>::first);
+          std::int32_t counter{0};  // total added to the loop cell per iteration
+          for (auto const& [target, delta] : deltas) {
+            if (target == 0) {
+              counter += delta;
+            }
+          }
+          if (counter == -1) {
+            auto const loop_begin = begin_of(r);
+            auto const loop_end = end_of(close);
+            for (std::size_t k = 0; k < deltas.size();) {
+              auto const target = deltas[k].first;
+              std::int32_t factor{0};
+              for (; k < deltas.size() and deltas[k].first == target; ++k) {
+                factor += deltas[k].second;
+              }
+              if (target != 0 and factor != 0) {
+                out.emit(inst_t{inst_t::op_code_t::mul, factor, static_cast<std::int16_t>(target)}, loop_begin, loop_end);
+              }
+            }
+            out.emit(inst_t{inst_t::op_code_t::set, 0}, loop_begin, loop_end);
+            previous = inst_t::op_code_t::jmpnz;
+            r = close + 1;
+            continue;
+          }
+        }
+      }
+    }
+
+    out.emit(inst, begin_of(r), end_of(r));
+    previous = inst.opcode;
+    ++r;
+  }
+  out.finish();
 }
 
-  
-//// Second optimization
-// look for optimizable loops like [-] -> mem[mp] = 0
-std::vector<inst_t> optimize_bytecodes_opt2(std::vector<inst_t> const & bytecodes) {
+//// Fifth optimization
+// Constant propagation: drop loops like the second one in [-][.] that can never run.
+namespace {
 
-  auto constexpr chunk_by_depth = [](auto const& i_d, auto const& j_d) {
-    auto [_i1, d1] = i_d;
-    auto [_i2, d2] = j_d;
+// Cell values known within straight-line code, keyed by offset from the pointer at the start of the
+// block. Values are modulo 2^32; a cell counts as zero only when it is zero at every cell width.
+class known_cells_t {
+ public:
+  // At the start of the program every cell is zero.
+  known_cells_t() : zero_default_{true} {}
 
-    return d1 == d2;
-  };
+  std::optional<std::uint32_t> get(std::int32_t offset) const {
+    auto const it = cells_.find(base_ + offset);
+    if (it != cells_.end()) {
+      return it->second;
+    }
+    return zero_default_ ? std::optional<std::uint32_t>{0} : std::nullopt;
+  }
 
-  auto constexpr reduce_loop = [](auto const&& loop) {
-    if (rng::distance(loop) == 3
-        and loop[0].opcode == inst_t::op_code_t::jmpz
-        and loop[1].opcode == inst_t::op_code_t::add and loop[1].operand == -1
-        and loop[2].opcode == inst_t::op_code_t::jmpnz
-      ) {
-      std::vector<inst_t> loop_opt;
-      loop_opt.emplace_back(inst_t{inst_t::op_code_t::set, 0});
-      return loop_opt;
+  void put(std::int32_t offset, std::optional<std::uint32_t> value) {
+    if (value or zero_default_) {
+      cells_[base_ + offset] = value;
     } else {
-      std::vector<inst_t> loop_copy(loop.begin(), loop.end());
-      return loop_copy;
+      cells_.erase(base_ + offset);
     }
-  };
-  
-  auto opt_view = vws::join(vws::zip(bytecodes, loop_depths(bytecodes))
-                        | vws::chunk_by(chunk_by_depth)
-                        | vws::transform([](auto const &&chunk) { return chunk
-                              | vws::transform([] (auto const &i_d) { auto [i,_d] = i_d; return i;}); })
-                        | vws::transform(reduce_loop)
-    );
+  }
+
+  void move(std::int32_t delta) { base_ += delta; }
+
+  // Nothing is known, except possibly that the cell under the pointer is zero.
+  void forget(bool current_is_zero) {
+    cells_.clear();
+    zero_default_ = false;
+    base_ = 0;
+    if (current_is_zero) {
+      cells_[0] = 0;
+    }
+  }
 
+ private:
+  std::map<std::int64_t, std::optional<std::uint32_t>> cells_;  // nullopt: unknown
+  bool zero_default_;  // cells not in cells_ are zero
+  std::int64_t base_{0};
+};
+
+// Index of the jmpnz matching the jmpz at open, by nesting depth; size when it is unmatched.
+std::size_t matching_close(std::vector<inst_t> const& bytecodes, std::size_t open) {
+  std::size_t depth{0};
+  for (auto i = open; i < bytecodes.size(); ++i) {
+    if (bytecodes[i].opcode == inst_t::op_code_t::jmpz) {
+      ++depth;
+    } else if (bytecodes[i].opcode == inst_t::op_code_t::jmpnz and --depth == 0) {
+      return i;
+    }
+  }
+  return bytecodes.size();
+}
+
+} // namespace
+
+std::vector<inst_t> optimize_bytecodes_opt5(std::vector<inst_t> const& bytecodes, source_map_t* map) {
   std::vector<inst_t> bytecodes_opt;
-  rng::copy(opt_view, std::back_inserter(bytecodes_opt));  // for lack of rng::to()
+  bytecodes_opt.reserve(bytecodes.size());
+  source_map_t spans;
+  known_cells_t known;
+
+  for (std::size_t i = 0; i < bytecodes.size(); ++i) {
+    auto const& inst = bytecodes[i];
+    if (bfsuper::is_super(inst.opcode)) {
+      known.forget(true);  // fused code is not optimized further
+      bytecodes_opt.push_back(inst);
+      if (map != nullptr) {
+        spans.push_back(map->begin[i], map->end[i]);
+      }
+      continue;
+    }
+    switch (inst.opcode) {
+      case inst_t::op_code_t::mpadd:
+        known.move(inst.operand);
+        break;
+      case inst_t::op_code_t::add:
+        if (auto const value = known.get(inst.offset)) {
+          known.put(inst.offset, *value + static_cast<std::uint32_t>(inst.operand));
+        }
+        break;
+      case inst_t::op_code_t::set:
+        known.put(inst.offset, static_cast<std::uint32_t>(inst.operand));
+        break;
+      case inst_t::op_code_t::mul: {
+        auto const source = known.get(0);
+        auto const target = known.get(inst.offset);
+        if (source and target) {
+          known.put(inst.offset, *target + *source * static_cast<std::uint32_t>(inst.operand));
+        } else if (!source or *source != 0) {
+          known.put(inst.offset, std::nullopt);
+        }
+        break;
+      }
+      case inst_t::op_code_t::in:
+        known.put(inst.offset, std::nullopt);
+        break;
+      case inst_t::op_code_t::scan:
+        known.forget(true);
+        break;
+      case inst_t::op_code_t::jmpz:
+        if (known.get(0) == std::uint32_t{0}) {
+          auto const close = matching_close(bytecodes, i);
+          if (close < bytecodes.size()) {
+            i = close;  // never entered: the state after it is the state before it
+            continue;
+          }
+        }
+        known.forget(false);  // the body is also reached from its jmpnz
+        break;
+      case inst_t::op_code_t::jmpnz:
+        known.forget(true);
+        break;
+      case inst_t::op_code_t::out:
+      case inst_t::op_code_t::nop:
+      case inst_t::op_code_t::super:  // handled above, with every other fused opcode
+        break;
+    }
+    bytecodes_opt.push_back(inst);
+    if (map != nullptr) {
+      spans.push_back(map->begin[i], map->end[i]);
+    }
+  }
+  replace_spans(map, std::move(spans));
 
   return bytecodes_opt;
-  
-}  
+}
 
 } // namespace bfcompiler_internal
+
+bftape::initial_t fold_prefix(std::vector<inst_t>& bytecodes, std::size_t tape_cells, source_map_t* map) {
+  bftape::initial_t state;
+  auto& cells = state.cells;
+  std::size_t pointer{0};
+  // Cell pointer + offset when it lies on the tape.
+  auto const cell = [&](std::int64_t offset) -> std::optional<std::size_t> {
+    auto const index = static_cast<std::int64_t>(pointer) + offset;
+    if (index < 0 or index >= static_cast<std::int64_t>(tape_cells)) {
+      return std::nullopt;
+    }
+    if (static_cast<std::size_t>(index) >= cells.size()) {
+      cells.resize(static_cast<std::size_t>(index) + 1, 0);
+    }
+    return static_cast<std::size_t>(index);
+  };
+
+  std::size_t pc{0};
+  for (; pc < bytecodes.size(); ++pc) {
+    auto const& inst = bytecodes[pc];
+    if (inst.opcode == inst_t::op_code_t::mpadd) {
+      auto const next = cell(inst.operand);
+      if (!next) {
+        break;
+      }
+      pointer = *next;
+    } else if (inst.opcode == inst_t::op_code_t::add or inst.opcode == inst_t::op_code_t::set) {
+      auto const target = cell(inst.offset);
+      if (!target) {
+        break;
+      }
+      auto const operand = static_cast<std::uint32_t>(inst.operand);
+      cells[*target] = inst.opcode == inst_t::op_code_t::add ? cells[*target] + operand : operand;
+    } else if (inst.opcode == inst_t::op_code_t::mul) {
+      auto const target = cell(inst.offset);
+      auto const source = cell(0);
+      if (!target or !source) {
+        break;
+      }
+      cells[*target] += cells[*source] * static_cast<std::uint32_t>(inst.operand);
+    } else if (inst.opcode == inst_t::op_code_t::scan) {
+      // cells past the end of cells are zero, so the walk stops within cells.size() steps or leaves the tape
+      auto p = static_cast<std::int64_t>(pointer);
+      auto narrow_zero = false;
+      while (p >= 0 and p < static_cast<std::int64_t>(cells.size()) and cells[static_cast<std::size_t>(p)] != 0
+             and inst.operand != 0) {
+        if ((cells[static_cast<std::size_t>(p)] & 0xFF) == 0) {
+          narrow_zero = true;  // 8-bit (or 16-bit) cells stop here
+          break;
+        }
+        p += inst.operand;
+      }
+      if (narrow_zero or p < 0 or p >= static_cast<std::int64_t>(tape_cells)
+          or (p < static_cast<std::int64_t>(cells.size()) and cells[static_cast<std::size_t>(p)] != 0)) {
+        break;  // stops only at some widths, leaves the tape, or a scan of stride 0 that never stops
+      }
+      pointer = static_cast<std::size_t>(p);
+    } else if (inst.opcode == inst_t::op_code_t::jmpz) {
+      auto const current = cell(0);
+      if (!current or cells[*current] != 0) {
+        break;  // the loop runs, or its cell is zero only at some widths
+      }
+      pc = static_cast<std::size_t>(inst.operand);  // resolved: the matching jmpnz
+    } else if (inst.opcode != inst_t::op_code_t::nop) {
+      break;  // I/O
+    }
+  }
+
+  // The prefix is made of whole loops, so the rest of the program is balanced on its own.
+  auto const mapped = map != nullptr and map->size() == bytecodes.size();
+  bytecodes.erase(bytecodes.begin(), bytecodes.begin() + static_cast<std::ptrdiff_t>(pc));
+  if (mapped) {
+    map->begin.erase(map->begin.begin(), map->begin.begin() + static_cast<std::ptrdiff_t>(pc));
+    map->end.erase(map->end.begin(), map->end.begin() + static_cast<std::ptrdiff_t>(pc));
+  }
+  bfcompiler_internal::resolve_jumps(bytecodes, mapped ? map : nullptr);
+
+  while (!cells.empty() and cells.back() == 0) {
+    cells.pop_back();
+  }
+  state.pointer = pointer;
+  return state;
+}
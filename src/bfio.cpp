@@ -0,0 +1,133 @@
+#include "bfio.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+namespace bfio {
+
+void Output::flush() {
+  if (pos_ == 0) {
+    if (os_ != nullptr) {
+      os_->flush();
+    }
+    return;
+  }
+  auto const sent = send(buffer_.data(), pos_);
+  std::copy(buffer_.begin() + static_cast<std::ptrdiff_t>(sent), buffer_.begin() + static_cast<std::ptrdiff_t>(pos_),
+            buffer_.begin());
+  pos_ -= sent;
+}
+
+void Output::make_room() {
+  flush();
+  if (pos_ == buffer_.size()) {
+    buffer_.resize(std::max<std::size_t>(2 * buffer_.size(), 1));
+  }
+}
+
+void Output::write(std::string_view bytes) {
+  if (bytes.size() < buffer_.size() - pos_) {
+    std::copy(bytes.begin(), bytes.end(), buffer_.begin() + static_cast<std::ptrdiff_t>(pos_));
+    pos_ += bytes.size();
+    return;
+  }
+  flush();
+  auto const sent = pos_ == 0 ? send(bytes.data(), bytes.size()) : 0;
+  if (sent < bytes.size()) {
+    // a non-blocking destination is full: keep the rest, growing the buffer if it does not fit
+    auto const rest = bytes.substr(sent);
+    buffer_.resize(std::max(buffer_.size(), pos_ + rest.size()));
+    std::copy(rest.begin(), rest.end(), buffer_.begin() + static_cast<std::ptrdiff_t>(pos_));
+    pos_ += rest.size();
+  }
+}
+
+std::size_t Output::send(char const* data, std::size_t size) {
+  if (os_ != nullptr) {
+    sent_ += size;
+    os_->write(data, static_cast<std::streamsize>(size));
+    os_->flush();
+    return size;
+  }
+  std::size_t written{0};
+  while (written < size) {
+    auto const n = ::write(fd_, data + written, size - written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN or errno == EWOULDBLOCK) {
+        break;  // non-blocking and full: the caller keeps the rest
+      }
+      written = size;  // the destination is gone (e.g. closed pipe): drop the output like a failed ostream
+      break;
+    }
+    written += static_cast<std::size_t>(n);
+  }
+  sent_ += written;
+  return written;
+}
+
+bool Input::refill(Output& tie) {
+  pos_ = 0;
+  end_ = 0;
+  blocked_ = false;
+
+  if (is_ != nullptr) {
+    auto* const buf = is_->rdbuf();
+    if (buf == nullptr) {
+      return false;
+    }
+    if (buf->in_avail() <= 0) {
+      tie.flush();  // next read may block
+    }
+    auto const value = buf->sbumpc();
+    if (value == std::istream::traits_type::eof()) {
+      is_->setstate(std::ios::eofbit);
+      return false;
+    }
+    buffer_[0] = std::istream::traits_type::to_char_type(value);
+    end_ = 1;
+    ++filled_;
+    return true;
+  }
+
+  if (tie_output_) {
+    tie.flush();
+  }
+  while (true) {
+    auto const n = ::read(fd_, buffer_.data(), buffer_.size());
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+      blocked_ = true;
+      return false;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    end_ = static_cast<std::size_t>(n);
+    filled_ += end_;
+    return true;
+  }
+}
+
+std::uint64_t Input::skip(std::uint64_t count, Output& tie) {
+  std::uint64_t skipped = 0;
+  while (skipped < count) {
+    if (pos_ == end_ and !refill(tie)) {
+      break;
+    }
+    auto const n = std::min<std::uint64_t>(count - skipped, end_ - pos_);
+    pos_ += static_cast<std::size_t>(n);
+    skipped += n;
+  }
+  return skipped;
+}
+
+bool is_interactive(int fd) {
+  return ::isatty(fd) != 0;
+}
+
+} // namespace bfio
@@ -0,0 +1,335 @@
+#include "bfjit.hpp"
+#include "bfscan.hpp"
+#include "bfsuper.hpp"
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define CCBF_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace bfjit_internal {
+
+namespace {
+
+// Little-endian byte emitter with the handful of x86-64 encodings the backend needs.
+// Register assignment: r12 = tape base, rbx = memory pointer (index), r13 = I/O context.
+class Emitter {
+ public:
+  std::vector<std::uint8_t> code;
+
+  void bytes(std::initializer_list<std::uint8_t> b) { code.insert(code.end(), b); }
+
+  void imm32(std::int32_t v) {
+    auto const u = static_cast<std::uint32_t>(v);
+    for (int i = 0; i < 4; ++i) {
+      code.push_back(static_cast<std::uint8_t>(u >> (8 * i)));
+    }
+  }
+
+  void imm64(std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+      code.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+  }
+
+  void patch32(std::size_t at, std::int32_t v) {
+    auto const u = static_cast<std::uint32_t>(v);
+    for (int i = 0; i < 4; ++i) {
+      code[at + i] = static_cast<std::uint8_t>(u >> (8 * i));
+    }
+  }
+
+  static constexpr std::uint8_t rbx_index = 3;
+  static constexpr std::uint8_t rcx_index = 1;
+
+  // ModRM/SIB suffix addressing byte [r12 + index] with the given reg field.
+  void cell_operand(std::uint8_t reg, std::uint8_t index = rbx_index) {
+    bytes({static_cast<std::uint8_t>(0x04 | (reg << 3)), static_cast<std::uint8_t>(0x04 | (index << 3))});
+  }
+
+  // Load (mp + offset) mod size into ecx for offsets already reduced into [0, size) and
+  // return the register to index the tape with (rbx itself for offset 0).
+  std::uint8_t cell_index(std::int32_t offset, std::int32_t size) {
+    if (offset == 0) {
+      return rbx_index;
+    }
+    bytes({0x8D, 0x8B});  // lea ecx, [rbx + offset]
+    imm32(offset);
+    bytes({0x8D, 0x91});  // lea edx, [rcx - size]
+    imm32(-size);
+    bytes({0x81, 0xF9});  // cmp ecx, imm32
+    imm32(size);
+    bytes({0x0F, 0x43, 0xCA});  // cmovae ecx, edx
+    return rcx_index;
+  }
+
+  void prologue() {
+    bytes({0x53});              // push rbx
+    bytes({0x41, 0x54});        // push r12
+    bytes({0x41, 0x55});        // push r13
+    bytes({0x49, 0x89, 0xFC});  // mov r12, rdi
+    bytes({0x49, 0x89, 0xF5});  // mov r13, rsi
+    bytes({0x31, 0xDB});        // xor ebx, ebx
+  }
+
+  void epilogue() {
+    bytes({0x41, 0x5D});  // pop r13
+    bytes({0x41, 0x5C});  // pop r12
+    bytes({0x5B});        // pop rbx
+    bytes({0xC3});        // ret
+  }
+
+  // mp = (mp + delta) mod size, with delta already reduced into [1, size).
+  void move_pointer(std::int32_t delta, std::int32_t size) {
+    bytes({0x81, 0xC3});  // add ebx, imm32
+    imm32(delta);
+    bytes({0x8D, 0x83});  // lea eax, [rbx - size]
+    imm32(-size);
+    bytes({0x81, 0xFB});  // cmp ebx, imm32
+    imm32(size);
+    bytes({0x0F, 0x43, 0xD8});  // cmovae ebx, eax
+  }
+
+  void add_cell(std::uint8_t value, std::uint8_t index) {
+    bytes({0x41, 0x80});  // add byte [r12 + index], imm8
+    cell_operand(0, index);
+    bytes({value});
+  }
+
+  void set_cell(std::uint8_t value, std::uint8_t index) {
+    bytes({0x41, 0xC6});  // mov byte [r12 + index], imm8
+    cell_operand(0, index);
+    bytes({value});
+  }
+
+  // [mp + offset] += [mp] * factor, with offset already reduced into [0, size).
+  void multiply_add(std::int32_t offset, std::int32_t factor, std::int32_t size) {
+    bytes({0x41, 0x0F, 0xB6});  // movzx eax, byte [r12 + rbx]
+    cell_operand(0);
+    bytes({0x69, 0xC0});  // imul eax, eax, imm32
+    imm32(factor);
+    auto const index = cell_index(offset, size);
+    bytes({0x41, 0x00});  // add byte [r12 + index], al
+    cell_operand(0, index);
+  }
+
+  // mp = scan_zero(tape, size, mp, stride), re-issued forever if the orbit has no zero.
+  void scan(std::int32_t stride, std::int32_t size) {
+    auto const again = code.size();
+    bytes({0x4C, 0x89, 0xE7});  // mov rdi, r12
+    bytes({0xBE});              // mov esi, imm32
+    imm32(size);
+    bytes({0x89, 0xDA});  // mov edx, ebx
+    bytes({0xB9});        // mov ecx, imm32
+    imm32(stride);
+    bytes({0x48, 0xB8});  // mov rax, imm64
+    imm64(reinterpret_cast<std::uintptr_t>(&bfscan::scan_zero));
+    bytes({0xFF, 0xD0});  // call rax
+    bytes({0x48, 0x3D});  // cmp rax, imm32
+    imm32(size);
+    auto const retry = jump_if(0x83);  // jae again
+    patch32(retry, static_cast<std::int32_t>(again) - static_cast<std::int32_t>(retry + 4));
+    bytes({0x89, 0xC3});  // mov ebx, eax
+  }
+
+  void test_cell() {
+    bytes({0x41, 0x80});  // cmp byte [r12 + rbx], 0
+    cell_operand(7);
+    bytes({0x00});
+  }
+
+  // Emit jcc rel32 and return the offset of its displacement field.
+  std::size_t jump_if(std::uint8_t condition) {
+    bytes({0x0F, condition});
+    auto const at = code.size();
+    imm32(0);
+    return at;
+  }
+
+  void call(void const* fn) {
+    bytes({0x4C, 0x89, 0xEF});  // mov rdi, r13
+    bytes({0x48, 0xB8});        // mov rax, imm64
+    imm64(reinterpret_cast<std::uintptr_t>(fn));
+    bytes({0xFF, 0xD0});  // call rax
+  }
+
+  void output_cell(void const* fn, std::uint8_t index) {
+    bytes({0x41, 0x0F, 0xB6});  // movzx esi, byte [r12 + index]
+    cell_operand(6, index);
+    call(fn);
+  }
+
+  // The tape address is computed after the call, which clobbers rcx/rdx.
+  void input_cell(void const* fn, std::int32_t offset, std::int32_t size) {
+    call(fn);
+    auto const index = cell_index(offset, size);
+    bytes({0x41, 0x88});  // mov byte [r12 + index], al
+    cell_operand(0, index);
+  }
+};
+
+constexpr std::uint8_t jz_opcode = 0x84;
+constexpr std::uint8_t jnz_opcode = 0x85;
+
+} // namespace
+
+std::vector<std::uint8_t> emit_x86_64(std::span<inst_t const> program, std::size_t memory_size,
+                                      void const* out_fn, void const* in_fn) {
+  auto const size = static_cast<std::int32_t>(memory_size);
+  auto const reduce = [size](std::int32_t value) { return ((value % size) + size) % size; };
+  Emitter em;
+  // For every open loop: displacement of its forward jump and the address of the loop body.
+  std::vector<std::pair<std::size_t, std::size_t>> loop_stack;
+
+  em.prologue();
+  for (auto const& inst : program) {
+    switch (bfsuper::plain(inst.opcode)) {  // native code needs no superinstructions
+      case inst_t::op_code_t::nop:
+      case inst_t::op_code_t::super:  // not returned by plain()
+        break;
+      case inst_t::op_code_t::mpadd: {
+        auto const delta = reduce(inst.operand);
+        if (delta != 0) {
+          em.move_pointer(delta, size);
+        }
+        break;
+      }
+      case inst_t::op_code_t::add:
+        if (static_cast<std::uint8_t>(inst.operand) != 0) {
+          em.add_cell(static_cast<std::uint8_t>(inst.operand), em.cell_index(reduce(inst.offset), size));
+        }
+        break;
+      case inst_t::op_code_t::set:
+        em.set_cell(static_cast<std::uint8_t>(inst.operand), em.cell_index(reduce(inst.offset), size));
+        break;
+      case inst_t::op_code_t::mul:
+        if (static_cast<std::uint8_t>(inst.operand) != 0) {
+          em.multiply_add(reduce(inst.offset), inst.operand, size);
+        }
+        break;
+      case inst_t::op_code_t::scan:
+        em.scan(inst.operand, size);
+        break;
+      case inst_t::op_code_t::jmpz: {
+        em.test_cell();
+        auto const forward = em.jump_if(jz_opcode);
+        loop_stack.emplace_back(forward, em.code.size());
+        break;
+      }
+      case inst_t::op_code_t::jmpnz: {
+        if (loop_stack.empty()) {
+          throw std::runtime_error("Unmatched closing bracket in Brainfuck program");
+        }
+        auto const [forward, body] = loop_stack.back();
+        loop_stack.pop_back();
+        em.test_cell();
+        auto const backward = em.jump_if(jnz_opcode);
+        auto const end = em.code.size();
+        em.patch32(backward, static_cast<std::int32_t>(body) - static_cast<std::int32_t>(end));
+        em.patch32(forward, static_cast<std::int32_t>(end) - static_cast<std::int32_t>(forward + 4));
+        break;
+      }
+      case inst_t::op_code_t::out:
+        em.output_cell(out_fn, em.cell_index(reduce(inst.offset), size));
+        break;
+      case inst_t::op_code_t::in:
+        em.input_cell(in_fn, reduce(inst.offset), size);
+        break;
+    }
+  }
+  if (!loop_stack.empty()) {
+    throw std::runtime_error("Unmatched opening bracket in Brainfuck program");
+  }
+  em.epilogue();
+
+  return std::move(em.code);
+}
+
+#if defined(CCBF_JIT_X86_64)
+
+CodeBuffer::CodeBuffer(std::vector<std::uint8_t> const& code) {
+  auto const page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  size_ = ((code.size() + page - 1) / page) * page;
+  memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory_ == MAP_FAILED) {
+    memory_ = nullptr;
+    throw std::runtime_error("Failed to allocate JIT code buffer");
+  }
+  std::memcpy(memory_, code.data(), code.size());
+  if (mprotect(memory_, size_, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory_, size_);
+    memory_ = nullptr;
+    throw std::runtime_error("Failed to make JIT code buffer executable");
+  }
+}
+
+CodeBuffer::~CodeBuffer() {
+  if (memory_ != nullptr) {
+    munmap(memory_, size_);
+  }
+}
+
+#else
+
+CodeBuffer::CodeBuffer(std::vector<std::uint8_t> const&) {
+  throw std::runtime_error("JIT backend requires an x86-64 POSIX host");
+}
+
+CodeBuffer::~CodeBuffer() = default;
+
+#endif
+
+} // namespace bfjit_internal
+
+bool BrainFckJIT::supported() {
+#if defined(CCBF_JIT_X86_64)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bftape::options_t BrainFckJIT::checked(bftape::options_t tape) {
+  if (tape.policy != bftape::policy_t::wrap) {
+    throw std::runtime_error("JIT engine supports only the wrap tape policy");
+  }
+  if (tape.cell_bits != 8) {
+    throw std::runtime_error("JIT engine supports only 8-bit cells");
+  }
+  if (tape.size > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max())) {
+    throw std::runtime_error("JIT engine supports tapes of at most 2^31 - 1 cells");
+  }
+  return tape;
+}
+
+void BrainFckJIT::put_char(void* context, int value) {
+  static_cast<BrainFckJIT*>(context)->out_.put(static_cast<std::uint8_t>(value));
+}
+
+int BrainFckJIT::get_char(void* context) {
+  auto* const self = static_cast<BrainFckJIT*>(context);
+  auto const value = self->in_.get(self->out_);
+  if (value == bfio::eof) {
+    return 0;
+  }
+  return value;
+}
+
+void BrainFckJIT::run(std::span<inst_t const> program) {
+  reset();
+  auto const code = bfjit_internal::emit_x86_64(program, tape_.size(), reinterpret_cast<void const*>(&put_char),
+                                                reinterpret_cast<void const*>(&get_char));
+  bfjit_internal::CodeBuffer const buffer{code};
+
+  using entry_t = void (*)(std::uint8_t*, void*);
+  auto const entry = reinterpret_cast<entry_t>(const_cast<void*>(buffer.entry()));
+  entry(tape_.data(), this);
+  out_.flush();
+}
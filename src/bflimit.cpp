@@ -0,0 +1,49 @@
+#include "bflimit.hpp"
+#include <algorithm>
+
+namespace bflimit {
+
+std::string_view name(status_t status) {
+  switch (status) {
+    case status_t::completed:
+      return "completed";
+    case status_t::out_of_fuel:
+      return "out of fuel";
+    case status_t::out_of_time:
+      return "out of time";
+    case status_t::interrupted:
+      return "interrupted";
+  }
+  return "unknown";
+}
+
+Limited::Limited(limits_t const& limits)
+  : fuel_{limits.fuel}, timed_{limits.time.count() > 0},
+    deadline_{std::chrono::steady_clock::now() +
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(limits.time)},
+    interrupt_{limits.interrupt} {}
+
+std::uint64_t Limited::refill(std::uint64_t weight, std::uint64_t left) {
+  // close the current slice, returning what it has left to the pool
+  steps_ += loaded_ - left;
+  fuel_ += left;
+  loaded_ = left_ = 0;
+  if (interrupt_ != nullptr and interrupt_->load(std::memory_order_relaxed)) {
+    status_ = status_t::interrupted;
+    return stop;
+  }
+  if (timed_ and std::chrono::steady_clock::now() >= deadline_) {
+    status_ = status_t::out_of_time;
+    return stop;
+  }
+  if (fuel_ < weight) {
+    status_ = status_t::out_of_fuel;
+    return stop;
+  }
+  loaded_ = std::max(weight, std::min(fuel_, slice));
+  fuel_ -= loaded_;
+  left_ = loaded_ - weight;
+  return left_;
+}
+
+} // namespace bflimit
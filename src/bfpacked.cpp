@@ -0,0 +1,38 @@
+#include "bfpacked.hpp"
+#include <stdexcept>
+
+namespace bfpacked {
+
+Program::Program(std::span<inst_t const> program) {
+  code_.reserve(program.size());
+  for (std::size_t i = 0; i < program.size(); ++i) {
+    auto const& inst = program[i];
+    auto const jump = inst.opcode == inst_t::op_code_t::jmpz or inst.opcode == inst_t::op_code_t::jmpnz;
+    auto const operand = jump ? std::int64_t{inst.operand} - static_cast<std::int64_t>(i) : inst.operand;
+    auto const fits = inst.offset > escape and inst.offset <= 127 and operand >= operand_min and operand <= operand_max;
+    std::uint32_t bits = static_cast<std::uint32_t>(inst.opcode);
+    if (fits) {
+      bits |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(inst.offset)) << 5;
+      bits |= static_cast<std::uint32_t>(operand) << 13;
+    } else {
+      if (wide_.size() > static_cast<std::size_t>(operand_max)) {
+        throw std::runtime_error("Too many wide instructions to pack");
+      }
+      bits |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(escape)) << 5;
+      bits |= static_cast<std::uint32_t>(wide_.size()) << 13;
+      wide_.push_back(inst);
+    }
+    code_.push_back(bits);
+  }
+}
+
+std::vector<inst_t> Program::unpack() const {
+  std::vector<inst_t> program;
+  program.reserve(size());
+  for (std::size_t i = 0; i < size(); ++i) {
+    program.push_back((*this)[i]);
+  }
+  return program;
+}
+
+} // namespace bfpacked
@@ -0,0 +1,135 @@
+#include "bfprofile.hpp"
+#include "bfcompiler.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace bfprofile {
+
+namespace {
+
+// Lines of print_bytecodes layout shown per hot loop; outer loops can span the whole program.
+constexpr std::size_t layout_lines = 60;
+// Source characters shown per loop in the hot loop table.
+constexpr std::size_t excerpt_length = 40;
+
+std::string excerpt(std::string_view source, std::size_t begin, std::size_t end) {
+  std::string text;
+  for (auto i = begin; i <= end and i < source.size() and text.size() < excerpt_length; ++i) {
+    if (std::string_view{"+-<>[].,"}.contains(source[i])) {
+      text += source[i];
+    }
+  }
+  if (text.size() == excerpt_length and end + 1 - begin > excerpt_length) {
+    text += "...";
+  }
+  return text;
+}
+
+} // namespace
+
+std::uint64_t Counter::total() const {
+  return std::accumulate(counts_.begin(), counts_.end(), std::uint64_t{0});
+}
+
+std::vector<loop_t> loops(std::span<inst_t const> bytecodes, std::span<std::uint64_t const> counts,
+                          source_map_t const* map) {
+  std::vector<std::uint64_t> prefix(bytecodes.size() + 1, 0);
+  for (std::size_t i = 0; i < bytecodes.size(); ++i) {
+    prefix[i + 1] = prefix[i] + (i < counts.size() ? counts[i] : 0);
+  }
+  auto const count = [&](std::size_t i) { return i < counts.size() ? counts[i] : 0; };
+  auto const mapped = map != nullptr and map->size() == bytecodes.size();
+
+  struct open_t {
+    std::size_t begin;
+    std::uint64_t nested;  // executed by the loops directly inside
+  };
+  std::vector<loop_t> result;
+  std::vector<open_t> open;
+  for (std::size_t i = 0; i < bytecodes.size(); ++i) {
+    if (bytecodes[i].opcode == inst_t::op_code_t::jmpz) {
+      open.push_back({i, 0});
+    } else if (bytecodes[i].opcode == inst_t::op_code_t::jmpnz and !open.empty()) {
+      loop_t loop;
+      loop.begin = open.back().begin;
+      loop.end = i;
+      loop.entries = count(loop.begin);
+      loop.iterations = count(loop.end);
+      loop.executed = prefix[loop.end + 1] - prefix[loop.begin];
+      loop.self = loop.executed - open.back().nested;
+      open.pop_back();
+      loop.depth = open.size();
+      if (!open.empty()) {
+        open.back().nested += loop.executed;
+      }
+      if (mapped) {
+        loop.source_begin = map->begin[loop.begin];
+        loop.source_end = map->begin[loop.end];
+      }
+      result.push_back(loop);
+    }
+  }
+
+  std::ranges::stable_sort(result, [](loop_t const& a, loop_t const& b) { return a.self > b.self; });
+  return result;
+}
+
+void report(std::ostream& os, std::span<inst_t const> bytecodes, std::span<std::uint64_t const> counts,
+            source_map_t const* map, std::string_view source, std::size_t top) {
+  if (counts.size() != bytecodes.size()) {
+    throw std::runtime_error("Profile counts do not match the program");
+  }
+  auto const total = std::accumulate(counts.begin(), counts.end(), std::uint64_t{0});
+  auto const all = loops(bytecodes, counts, map);
+  auto const shown = std::min(top, all.size());
+  auto const mapped = map != nullptr and map->size() == bytecodes.size();
+
+  os << "Profile: " << total << " instructions executed in " << bytecodes.size() << " bytecodes, " << all.size()
+     << " loops\n";
+  if (shown == 0) {
+    return;
+  }
+
+  os << "Hot loops:\n"
+     << "   #            self   share      executed    iterations       entries  depth  bytecode";
+  if (mapped) {
+    os << "       source";
+  }
+  os << '\n';
+  for (std::size_t k = 0; k < shown; ++k) {
+    auto const& loop = all[k];
+    auto const share = total == 0 ? 0.0 : 100.0 * static_cast<double>(loop.self) / static_cast<double>(total);
+    os << std::setw(4) << k + 1 << std::setw(16) << loop.self << std::setw(7) << std::fixed << std::setprecision(1)
+       << share << '%' << std::setw(14) << loop.executed << std::setw(14) << loop.iterations << std::setw(14)
+       << loop.entries << std::setw(7) << loop.depth << "  " << std::setw(6) << loop.begin << '-' << std::left
+       << std::setw(6) << loop.end << std::right;
+    if (mapped) {
+      os << "  " << loop.source_begin << '-' << loop.source_end;
+      if (!source.empty()) {
+        os << "  " << excerpt(source, loop.source_begin, loop.source_end);
+      }
+    }
+    os << '\n';
+  }
+
+  for (std::size_t k = 0; k < shown; ++k) {
+    auto const& loop = all[k];
+    auto const length = loop.end + 1 - loop.begin;
+    auto const lines = std::min(length, layout_lines);
+    os << "\nLoop " << k + 1 << " (bytecode " << loop.begin << '-' << loop.end;
+    if (mapped) {
+      auto const [line, column] = map->position(loop.source_begin);
+      os << ", source offset " << loop.source_begin << ", line " << line << ", column " << column;
+    }
+    os << "):\n";
+    bfcompiler_internal::print_bytecodes(bytecodes.subspan(loop.begin, lines), os, counts.subspan(loop.begin, lines), loop.begin);
+    if (lines < length) {
+      os << "  ... " << length - lines << " more\n";
+    }
+  }
+}
+
+} // namespace bfprofile
@@ -0,0 +1,141 @@
+#include "bfscan.hpp"
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bfscan {
+
+namespace {
+
+#if defined(__SSE2__)
+constexpr std::size_t lanes = 16;
+
+// Strides that divide the vector width keep the same lane pattern in every block.
+constexpr bool vectorizable(std::size_t stride) { return lanes % stride == 0; }
+
+// Bits set for the lanes of a 16-byte block that lie on the orbit, starting at lane `first`.
+constexpr std::uint32_t lane_mask(std::size_t stride, std::size_t first) {
+  std::uint32_t mask{0};
+  for (std::size_t lane = first; lane < lanes; lane += stride) {
+    mask |= std::uint32_t{1} << lane;
+  }
+  return mask;
+}
+
+// One bit per byte of tape[at, at + 16) that is zero.
+std::uint32_t zero_lanes(std::uint8_t const* tape, std::size_t at) {
+  auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(tape + at));
+  return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())));
+}
+#endif
+
+// Visit p, p + stride, ... below size. On a miss, last is set to the final position visited.
+std::size_t forward_segment(std::uint8_t const* tape, std::size_t size, std::size_t p, std::size_t stride,
+                            std::size_t& last) {
+  if (stride == 1) {
+    // glibc's memchr already dispatches to SSE2/AVX2/EVEX at runtime
+    auto const* hit = static_cast<std::uint8_t const*>(std::memchr(tape + p, 0, size - p));
+    if (hit != nullptr) {
+      return static_cast<std::size_t>(hit - tape);
+    }
+    last = size - 1;
+    return npos;
+  }
+#if defined(__SSE2__)
+  if (vectorizable(stride)) {
+    auto const mask = lane_mask(stride, 0);
+    for (; p + lanes <= size; p += lanes) {
+      auto const hits = zero_lanes(tape, p) & mask;
+      if (hits != 0) {
+        return p + static_cast<std::size_t>(std::countr_zero(hits));
+      }
+    }
+  }
+#endif
+  for (; p < size; p += stride) {
+    if (tape[p] == 0) {
+      return p;
+    }
+  }
+  last = p - stride;
+  return npos;
+}
+
+// Visit p, p - stride, ... down to 0. On a miss, last is set to the final position visited.
+std::size_t backward_segment(std::uint8_t const* tape, std::size_t p, std::size_t stride, std::size_t& last) {
+  auto q = static_cast<std::ptrdiff_t>(p);
+  auto const step = static_cast<std::ptrdiff_t>(stride);
+#if defined(__SSE2__)
+  if (vectorizable(stride)) {
+    // lane 15 holds q, so the orbit occupies lanes 15, 15 - stride, ...
+    auto const mask = lane_mask(stride, (lanes - 1) % stride);
+    for (; q >= static_cast<std::ptrdiff_t>(lanes - 1); q -= static_cast<std::ptrdiff_t>(lanes)) {
+      auto const base = static_cast<std::size_t>(q) - (lanes - 1);
+      auto const hits = zero_lanes(tape, base) & mask;
+      if (hits != 0) {
+        return base + (31 - static_cast<std::size_t>(std::countl_zero(hits)));
+      }
+    }
+  }
+#endif
+  for (; q >= 0; q -= step) {
+    if (tape[q] == 0) {
+      return static_cast<std::size_t>(q);
+    }
+  }
+  last = static_cast<std::size_t>(q + step);
+  return npos;
+}
+
+} // namespace
+
+std::size_t scan_zero(std::uint8_t const* tape, std::size_t size, std::size_t start, std::int32_t stride) {
+  if (tape[start] == 0) {
+    return start;
+  }
+
+  // Every stride is a forward step modulo size; take the shorter direction.
+  auto const n = static_cast<std::int64_t>(size);
+  auto const forward = static_cast<std::size_t>(((stride % n) + n) % n);
+  if (forward == 0) {
+    return npos;
+  }
+  bool const backward = forward > size / 2;
+  auto const step = backward ? size - forward : forward;
+
+  // The orbit has at most size positions, so covering that many without a zero means none exists.
+  std::size_t visited{0};
+  std::size_t p = start;
+  while (visited < size) {
+    std::size_t last{0};
+    auto const hit = backward ? backward_segment(tape, p, step, last) : forward_segment(tape, size, p, step, last);
+    if (hit != npos) {
+      return hit;
+    }
+    if (backward) {
+      visited += (p - last) / step + 1;
+      p = last + size - step;
+    } else {
+      visited += (last - p) / step + 1;
+      p = last + step - size;
+    }
+  }
+  return npos;
+}
+
+std::size_t scan_zero_linear(std::uint8_t const* tape, std::size_t size, std::size_t start, std::int32_t stride) {
+  if (tape[start] == 0) {
+    return start;
+  }
+  if (stride == 0) {
+    return npos;
+  }
+  std::size_t last{0};
+  auto const step = static_cast<std::size_t>(stride < 0 ? -static_cast<std::int64_t>(stride) : stride);
+  return stride < 0 ? backward_segment(tape, start, step, last) : forward_segment(tape, size, start, step, last);
+}
+
+} // namespace bfscan
@@ -0,0 +1,20 @@
+#include "bfserial.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace bfserial {
+
+void replace_file(std::filesystem::path const& path, std::string_view bytes) {
+  auto tmp = path;
+  tmp += ".tmp." + std::to_string(::getpid());
+  {
+    std::ofstream ofs{tmp, std::ios::binary | std::ios::trunc};
+    if (!ofs.is_open() or !ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size())).flush()) {
+      throw std::runtime_error("Failed to write file: " + tmp.string());
+    }
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+} // namespace bfserial
@@ -0,0 +1,142 @@
+#include "bfsnapshot.hpp"
+#include "bfbytecode.hpp"
+#include "bfserial.hpp"
+#include "bfsuper.hpp"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace bfsnapshot {
+
+namespace {
+
+constexpr std::array<char, 8> magic{'C', 'C', 'B', 'F', 'S', 'S', '\0', '\0'};
+
+using bfserial::get_le;
+using bfserial::put_le;
+
+} // namespace
+
+std::uint64_t program_hash(std::span<inst_t const> program) {
+  auto hash = bfserial::fnv_basis;
+  for (auto const& inst : program) {
+    bfserial::fnv_mix(hash, static_cast<std::uint8_t>(bfsuper::plain(inst.opcode)), 1);
+    bfserial::fnv_mix(hash, static_cast<std::uint16_t>(inst.offset), 2);
+    bfserial::fnv_mix(hash, static_cast<std::uint32_t>(inst.operand), 4);
+  }
+  return hash;
+}
+
+std::string encode(snapshot_t const& snapshot) {
+  std::string out{magic.data(), magic.size()};
+  put_le(out, format_version);
+  out.append(6, '\0');
+  put_le(out, snapshot.program_hash);
+  put_le(out, snapshot.input_offset);
+  put_le(out, snapshot.output_offset);
+  bfbytecode::append_state(out, snapshot.state);
+  return out;
+}
+
+snapshot_t decode(std::string_view bytes) {
+  if (bytes.size() < header_size or std::memcmp(bytes.data(), magic.data(), magic.size()) != 0) {
+    throw std::runtime_error("Not a snapshot");
+  }
+  if (auto const version = get_le<std::uint16_t>(bytes.data() + 8); version != format_version) {
+    throw std::runtime_error("Unsupported snapshot version " + std::to_string(version));
+  }
+  snapshot_t snapshot;
+  snapshot.program_hash = get_le<std::uint64_t>(bytes.data() + 16);
+  snapshot.input_offset = get_le<std::uint64_t>(bytes.data() + 24);
+  snapshot.output_offset = get_le<std::uint64_t>(bytes.data() + 32);
+  bytes.remove_prefix(header_size);
+  // the pc is checked against the program in read_file
+  snapshot.state = bfbytecode::read_state(bytes, std::numeric_limits<std::size_t>::max());
+  if (!bytes.empty()) {
+    throw std::runtime_error("Trailing data in snapshot");
+  }
+  return snapshot;
+}
+
+void write_file(std::filesystem::path const& path, snapshot_t const& snapshot) {
+  bfserial::replace_file(path, encode(snapshot));
+}
+
+snapshot_t read_file(std::filesystem::path const& path, std::span<inst_t const> program) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs.is_open()) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  std::string const bytes{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  auto snapshot = decode(bytes);
+  if (snapshot.program_hash != program_hash(program)) {
+    throw std::runtime_error("Snapshot " + path.string() + " was taken from a different program");
+  }
+  if (snapshot.state.pc > program.size()) {
+    throw std::runtime_error("Malformed snapshot: " + path.string());
+  }
+  return snapshot;
+}
+
+Checkpointer::Checkpointer(std::filesystem::path path, std::uint64_t program_hash)
+  : path_{std::move(path)}, program_hash_{program_hash}, thread_{[this](std::stop_token stop) { work(stop); }} {}
+
+Checkpointer::~Checkpointer() {
+  thread_.request_stop();  // the worker drains pending_ before it returns
+}
+
+void Checkpointer::submit(snapshot_t snapshot) {
+  snapshot.program_hash = program_hash_;
+  {
+    std::lock_guard const lock{mutex_};
+    pending_ = std::move(snapshot);
+  }
+  changed_.notify_all();
+}
+
+void Checkpointer::wait() {
+  std::unique_lock lock{mutex_};
+  changed_.wait(lock, [&] { return !pending_ and !writing_; });
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+std::size_t Checkpointer::written() const {
+  std::lock_guard const lock{mutex_};
+  return written_;
+}
+
+void Checkpointer::work(std::stop_token stop) {
+  std::unique_lock lock{mutex_};
+  while (true) {
+    changed_.wait(lock, stop, [&] { return pending_.has_value(); });
+    if (!pending_) {
+      return;  // stop requested with nothing left to write
+    }
+    auto snapshot = std::move(*pending_);
+    pending_.reset();
+    writing_ = true;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      write_file(path_, snapshot);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    writing_ = false;
+    if (error and !error_) {
+      error_ = error;
+    } else if (!error) {
+      ++written_;
+    }
+    changed_.notify_all();
+  }
+}
+
+} // namespace bfsnapshot
@@ -0,0 +1,53 @@
+#include "bfsource.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(std::string const& path) {
+  auto const fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file: " + path + ": " + std::strerror(errno));
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) == 0 and S_ISREG(st.st_mode) and st.st_size > 0) {
+    size_ = static_cast<std::size_t>(st.st_size);
+    auto* const mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      ::madvise(mapped, size_, MADV_SEQUENTIAL);
+      mapped_ = static_cast<char const*>(mapped);
+      ::close(fd);
+      return;
+    }
+    size_ = 0;
+  }
+
+  char buffer[1 << 16];
+  while (true) {
+    auto const n = ::read(fd, buffer, sizeof(buffer));
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      auto const error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), "Failed to read file: " + path);
+    }
+    if (n == 0) {
+      break;
+    }
+    fallback_.append(buffer, static_cast<std::size_t>(n));
+  }
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (mapped_ != nullptr) {
+    ::munmap(const_cast<char*>(mapped_), size_);
+  }
+}
@@ -0,0 +1,116 @@
+#include "bfsuper.hpp"
+#include <algorithm>
+#include <ranges>
+
+namespace rng = std::ranges;
+
+namespace bfsuper {
+
+void Ngrams::add(std::span<inst_t const> program, std::span<std::uint64_t const> counts) {
+  runs_.push_back({{program.begin(), program.end()}, {counts.begin(), counts.end()}});
+  std::vector<op_code_t> ops;
+  for (std::size_t i = 0; i < program.size(); ++i) {
+    auto const weight = counts.empty() ? 1 : counts[i];
+    if (weight == 0) {
+      continue;
+    }
+    ops.clear();
+    for (std::size_t n = 1; n <= max_length_ and i + n <= program.size(); ++n) {
+      auto const op = plain(program[i + n - 1].opcode);
+      // A prefix ending in a jump cannot be extended.
+      if (!fusable(op, n - 1, n) or (n > 1 and !fusable(ops.back(), n - 2, n))) {
+        break;
+      }
+      ops.push_back(op);
+      if (n > 1) {
+        counts_[ops] += weight;
+      }
+    }
+  }
+}
+
+std::vector<ngram_t> Ngrams::top(std::size_t n) const {
+  std::vector<ngram_t> ngrams;
+  ngrams.reserve(counts_.size());
+  for (auto const& [ops, count] : counts_) {
+    ngrams.push_back({ops, count});
+  }
+  auto const saved = [](ngram_t const& ngram) { return ngram.count * (ngram.ops.size() - 1); };
+  rng::stable_sort(ngrams, [&](auto const& a, auto const& b) { return saved(a) > saved(b); });
+  ngrams.resize(std::min(n, ngrams.size()));
+  return ngrams;
+}
+
+std::vector<std::vector<op_code_t>> Ngrams::select(std::size_t n, std::size_t candidates) const {
+  auto const longest_first = [](auto const& a, auto const& b) { return a.size() > b.size(); };
+  // Dispatches saved by fusing with table: every fused occurrence runs length - 1 fewer.
+  auto const saved = [&](std::vector<std::vector<op_code_t>> const& table) {
+    std::vector<std::span<op_code_t const>> patterns{table.begin(), table.end()};
+    std::uint64_t total = 0;
+    for (auto const& run : runs_) {
+      auto program = run.program;
+      fuse(program, patterns);
+      for (std::size_t i = 0; i < program.size(); ++i) {
+        if (is_super(program[i].opcode)) {
+          total += (run.counts.empty() ? 1 : run.counts[i]) * (patterns[index(program[i].opcode)].size() - 1);
+        }
+      }
+    }
+    return total;
+  };
+
+  auto pool = top(candidates);
+  std::vector<std::vector<op_code_t>> table;
+  std::uint64_t best = 0;
+  while (table.size() < n) {
+    std::vector<std::vector<op_code_t>> chosen;
+    for (auto const& candidate : pool) {
+      if (rng::find(table, candidate.ops) != table.end()) {
+        continue;
+      }
+      auto trial = table;
+      trial.push_back(candidate.ops);
+      rng::stable_sort(trial, longest_first);
+      if (auto const total = saved(trial); total > best) {
+        best = total;
+        chosen = std::move(trial);
+      }
+    }
+    if (chosen.empty()) {
+      break;
+    }
+    table = std::move(chosen);
+  }
+  return table;
+}
+
+std::size_t fuse(std::span<inst_t> program) { return fuse(program, patterns); }
+
+std::size_t fuse(std::span<inst_t> program, std::span<std::span<op_code_t const> const> patterns) {
+  std::size_t fused = 0;
+  for (std::size_t i = 0; i < program.size();) {
+    auto const match = rng::find_if(patterns, [&](auto const pattern) {
+      return i + pattern.size() <= program.size() and
+             rng::equal(pattern, program.subspan(i, pattern.size()), {}, {}, [](inst_t const& inst) {
+               return inst.opcode;
+             });
+    });
+    if (match == patterns.end()) {
+      ++i;
+      continue;
+    }
+    auto const k = static_cast<std::size_t>(match - patterns.begin());
+    program[i].opcode = static_cast<op_code_t>(static_cast<std::size_t>(op_code_t::super) + k);
+    i += match->size();
+    ++fused;
+  }
+  return fused;
+}
+
+void unfuse(std::span<inst_t> program) {
+  for (auto& inst : program) {
+    inst.opcode = plain(inst.opcode);
+  }
+}
+
+} // namespace bfsuper
@@ -0,0 +1,174 @@
+#include "bftape.hpp"
+#include "bfscan.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace bftape {
+
+namespace {
+
+// Cells per guard area: covers every int16 instruction offset plus a vector load past the last cell.
+constexpr std::size_t guard_cells = std::size_t{1} << 16;
+// Below this a memset is cheaper than dropping and re-faulting the pages.
+constexpr std::size_t memset_limit = std::size_t{1} << 16;
+
+std::size_t page_size() {
+  static auto const size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+std::size_t round_up(std::size_t bytes) {
+  auto const page = page_size();
+  return (bytes + page - 1) / page * page;
+}
+
+} // namespace
+
+policy_t parse_policy(std::string_view name) {
+  if (name == "wrap") {
+    return policy_t::wrap;
+  }
+  if (name == "error") {
+    return policy_t::error;
+  }
+  if (name == "grow") {
+    return policy_t::grow;
+  }
+  throw std::runtime_error("Unknown tape policy: " + std::string{name});
+}
+
+bool parse_option(std::string_view arg, options_t& options) {
+  if (arg.starts_with("--tape=")) {
+    options.policy = parse_policy(arg.substr(7));
+    return true;
+  }
+  if (arg.starts_with("--tape-size=")) {
+    auto const value = arg.substr(12);
+    std::size_t size{0};
+    auto const [end, ec] = std::from_chars(value.data(), value.data() + value.size(), size);
+    if (ec != std::errc{} or end != value.data() + value.size() or size == 0) {
+      throw std::runtime_error("Invalid tape size: " + std::string{value});
+    }
+    options.size = size;
+    return true;
+  }
+  if (arg.starts_with("--cell=")) {
+    auto const value = arg.substr(7);
+    if (value != "8" and value != "16" and value != "32") {
+      throw std::runtime_error("Unsupported cell width: " + std::string{value});
+    }
+    options.cell_bits = static_cast<unsigned>(std::stoul(std::string{value}));
+    return true;
+  }
+  return false;
+}
+
+Tape::Tape(options_t options) : options_{options} {
+  if (options_.size == 0) {
+    throw std::runtime_error("Tape size must be positive");
+  }
+  if (options_.cell_bits != 8 and options_.cell_bits != 16 and options_.cell_bits != 32) {
+    throw std::runtime_error("Unsupported cell width: " + std::to_string(options_.cell_bits));
+  }
+  cell_bytes_ = options_.cell_bits / 8;
+  auto const cells = options_.policy == policy_t::grow ? std::max(options_.size, options_.max_size) : options_.size;
+  auto const capacity = round_up(cells * cell_bytes_);
+  auto const guard = round_up(guard_cells * cell_bytes_);
+  region_size_ = guard + capacity + guard;
+  auto* const region =
+      ::mmap(nullptr, region_size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED) {
+    throw std::runtime_error("Failed to reserve " + std::to_string(capacity) + " bytes of tape");
+  }
+  region_ = static_cast<std::uint8_t*>(region);
+  cells_ = region_ + guard;
+  commit(options_.size);
+  size_ = options_.size;
+}
+
+Tape::~Tape() {
+  ::munmap(region_, region_size_);
+}
+
+void Tape::commit(std::size_t size) {
+  auto const bytes = round_up(size * cell_bytes_);
+  if (bytes <= committed_) {
+    return;
+  }
+  if (::mprotect(cells_ + committed_, bytes - committed_, PROT_READ | PROT_WRITE) != 0) {
+    throw std::runtime_error("Failed to grow tape to " + std::to_string(size) + " cells");
+  }
+  committed_ = bytes;
+}
+
+void Tape::clear() {
+  auto const initial = round_up(options_.size * cell_bytes_);
+  if (committed_ > initial) {
+    ::madvise(cells_ + initial, committed_ - initial, MADV_DONTNEED);
+    ::mprotect(cells_ + initial, committed_ - initial, PROT_NONE);
+    committed_ = initial;
+  }
+  size_ = options_.size;
+  if (initial <= memset_limit) {
+    std::memset(cells_, 0, size_ * cell_bytes_);
+  } else {
+    ::madvise(cells_, initial, MADV_DONTNEED);  // private anonymous pages read back as zero
+  }
+}
+
+std::size_t Tape::relocate(std::size_t current, std::ptrdiff_t delta) {
+  auto const size = static_cast<std::ptrdiff_t>(size_);
+  auto next = static_cast<std::ptrdiff_t>(current) + delta;
+
+  switch (options_.policy) {
+    case policy_t::wrap:
+      // Pointer moves are far shorter than the tape, so one add or subtract replaces the modulo.
+      if (next < 0 and next >= -size) {
+        return static_cast<std::size_t>(next + size);
+      }
+      if (next >= size and next < 2 * size) {
+        return static_cast<std::size_t>(next - size);
+      }
+      next %= size;
+      return static_cast<std::size_t>(next < 0 ? next + size : next);
+    case policy_t::error:
+      break;
+    case policy_t::grow:
+      if (next >= size) {
+        auto const target = static_cast<std::size_t>(next);
+        if (target >= std::max(options_.size, options_.max_size)) {
+          throw std::runtime_error("Tape exceeded its maximum size of " + std::to_string(options_.max_size) +
+                                   " cells");
+        }
+        auto const grown = std::min(std::max(target + 1, 2 * size_), std::max(options_.size, options_.max_size));
+        commit(grown);
+        size_ = grown;
+        return target;
+      }
+      break;
+  }
+  throw std::runtime_error("Memory pointer moved outside the tape (cell " + std::to_string(next) + " of " +
+                           std::to_string(size_) + ")");
+}
+
+std::size_t Tape::scan_bytes(std::size_t start, std::int32_t stride) {
+  if (options_.policy == policy_t::wrap) {
+    return bfscan::scan_zero(cells_, size_, start, stride);
+  }
+  auto const hit = bfscan::scan_zero_linear(cells_, size_, start, stride);
+  if (hit != bfscan::npos or stride == 0) {
+    return hit;
+  }
+  // First position of the orbit outside the tape: a fresh (zero) cell when growing, an error otherwise.
+  auto const step = static_cast<std::ptrdiff_t>(stride);
+  auto const from = static_cast<std::ptrdiff_t>(start);
+  auto const steps = stride > 0 ? (static_cast<std::ptrdiff_t>(size_) - from + step - 1) / step : from / -step + 1;
+  return relocate(start, steps * step);
+}
+
+} // namespace bftape
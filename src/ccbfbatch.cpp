@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "bfbatch.hpp"
+#include "bftape.hpp"
+
+namespace {
+
+void print_usage(char const* argv0) {
+  std::cout << "Usage " << argv0 << " [--threads=<n>] [--scaling] [--engine=vm|threaded] " << bftape::option_usage
+            << " <manifest> optimization level [0-4] \n";
+}
+
+void report(bfbatch::summary_t const& summary, std::size_t threads) {
+  std::cout << std::fixed << std::setprecision(1) << summary.jobs << " jobs (" << summary.programs
+            << " programs) on " << threads << " threads: " << summary.run_seconds * 1000 << " ms, "
+            << summary.jobs_per_second() << " jobs/s\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+  bfbatch::options_t options;
+  options.threads = std::max(1u, std::thread::hardware_concurrency());
+  bool scaling = false;
+  std::vector<std::string_view> positional;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view const arg{argv[i]};
+      if (bftape::parse_option(arg, options.tape)) {
+        continue;
+      }
+      if (arg.starts_with("--threads=")) {
+        options.threads = static_cast<std::size_t>(std::stoul(std::string{arg.substr(10)}));
+      } else if (arg == "--scaling") {
+        scaling = true;
+      } else if (arg == "--engine=vm") {
+        options.dispatch = BrainFckVMBase::dispatch_t::switch_loop;
+      } else if (arg == "--engine=threaded") {
+        options.dispatch = BrainFckVMBase::dispatch_t::threaded;
+      } else if (arg.starts_with("--")) {
+        std::cerr << "Unknown option: " << arg << '\n';
+        print_usage(argv[0]);
+        return 1;
+      } else {
+        positional.push_back(arg);
+      }
+    }
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  if (positional.size() != 2 or options.threads == 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::filesystem::path const manifest_path{positional[0]};
+  options.optims = static_cast<std::size_t>(std::atoi(std::string{positional[1]}.c_str()));
+
+  std::vector<bfbatch::job_t> jobs;
+  try {
+    std::ifstream manifest{manifest_path};
+    if (!manifest.is_open()) {
+      std::cerr << "Failed to open file: " << manifest_path.string() << '\n';
+      return 1;
+    }
+    jobs = bfbatch::parse_manifest(manifest, manifest_path.parent_path());
+  } catch (std::runtime_error const& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  // --scaling repeats the runs at 1, 2, 4, ... threads up to --threads; the programs are compiled once.
+  std::vector<std::size_t> thread_counts;
+  for (std::size_t n = 1; scaling and n < options.threads; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(options.threads);
+
+  auto const programs = bfbatch::compile_programs(jobs, options.optims);
+  bool failed = false;
+  for (auto const threads : thread_counts) {
+    options.threads = threads;
+    auto const summary = bfbatch::run(jobs, programs, options);
+    if (threads == thread_counts.front()) {
+      // every pass runs the same jobs, so the failures are listed once
+      for (auto const& error : summary.errors) {
+        std::cerr << error << '\n';
+      }
+    }
+    failed = failed or !summary.errors.empty();
+    report(summary, threads);
+  }
+  return failed ? 1 : 0;
+}
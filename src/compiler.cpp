@@ -1,32 +1,475 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <iterator>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "bytecode.hpp"
+#include "bfbytecode.hpp"
 #include "bfcompiler.hpp"
+#include "bfjit.hpp"
+#include "bflimit.hpp"
+#include "bfprofile.hpp"
+#include "bfsnapshot.hpp"
+#include "bfsource.hpp"
+#include "bfsuper.hpp"
+#include "bftape.hpp"
 #include "bfvm.hpp"
 
 namespace rng = std::ranges;
 
-int main(int argc, char* argv[]) {
+namespace {
+
+enum class engine_t { vm, threaded, jit };
+
+void print_usage(char const* argv0) {
+  std::cout << "Usage " << argv0
+            << " [--engine=vm|threaded|jit] " << bftape::option_usage
+            << " [--stream] [--cache-dir=<dir>] [--emit-bytecode=<output>] [--encoding=raw|varint]"
+               " [--profile[=<loops>]] [--precompute[=<steps>]] [--superinstructions]"
+               " [--checkpoint=<file>] [--checkpoint-interval=<steps>] [--restore=<file>]"
+               " [--fuel=<steps>] [--time-limit=<ms>] <file> optimization level [0-5] \n"
+            << "      " << argv0 << " [--engine=vm|threaded|jit] " << bftape::option_usage
+            << " [--profile[=<loops>]] [--precompute[=<steps>]] [--superinstructions]"
+               " [--checkpoint=<file>] [--checkpoint-interval=<steps>] [--restore=<file>]"
+               " [--fuel=<steps>] [--time-limit=<ms>] --load-bytecode <bytecode file>\n";
+}
+
+// Compiled program, either owned or borrowed from a mapped bytecode file.
+struct program_t {
+  std::vector<inst_t> bytecodes;
+  std::optional<bfbytecode::BytecodeFile> file;
+  source_map_t map;  // filled only when profiling a program compiled here
+  bftape::initial_t initial;  // state left by a folded prefix (level 5) or a precomputed one
+
+  std::span<inst_t const> view() const { return file ? file->program() : std::span<inst_t const>{bytecodes}; }
+};
+
+bfbytecode::header_t make_header(std::string_view source, size_t optims, bfbytecode::encoding_t encoding) {
+  bfbytecode::header_t header;
+  header.encoding = encoding;
+  header.optims = static_cast<std::uint8_t>(optims);
+  header.source_size = source.size();
+  header.source_hash = bfbytecode::source_hash(source);
+  return header;
+}
+
+// Compile source, going through the cache directory when one is given. Cache entries use the
+// raw encoding so a hit runs straight from the mapped file. Profiling bypasses the cache, which
+// does not store source maps.
+void compile_cached(program_t& program, std::string_view source, size_t optims, std::string const& cache_dir,
+                    bool profile) {
+  if (cache_dir.empty() or profile) {
+    program.bytecodes = compile(source, optims, profile ? &program.map : nullptr);
+    return;
+  }
+  auto const entry = bfbytecode::cache_entry(cache_dir, source, optims);
+  try {
+    program.file.emplace(entry.string());
+    if (program.file->matches(source, optims)) {
+      return;
+    }
+  } catch (std::runtime_error const&) {
+    // missing or unreadable entry: recompile and replace it
+  }
+  program.file.reset();
+
+  program.bytecodes = compile(source, optims);
+  std::filesystem::create_directories(cache_dir);
+  bfbytecode::write_file(entry, program.bytecodes, make_header(source, optims, bfbytecode::encoding_t::raw));
+}
+
+// Bytecode the program can rewrite, copied out of a mapped file if needed.
+std::vector<inst_t>& owned(program_t& program) {
+  if (program.file) {
+    program.bytecodes.assign(program.file->program().begin(), program.file->program().end());
+    program.file.reset();
+  }
+  return program.bytecodes;
+}
+
+// Level 5 on the VM engines: evaluate the start of the program once and run the rest from the tape
+// state it leaves.
+void fold(program_t& program, bftape::options_t const& tape) {
+  owned(program);
+  auto const size = program.bytecodes.size();
+  program.initial = fold_prefix(program.bytecodes, tape.size, &program.map);
+  std::cout << "Folded prefix: " << size - program.bytecodes.size() << " op codes into " << program.initial.cells.size()
+            << " cells\n";
+}
+
+// Run the program up to its first input once, here, so the engines only replay the output and resume
+// from there. A state stored with the bytecode is used instead when it was computed for this tape.
+// Returns true when a new state was computed.
+bool start_state(program_t& program, bftape::options_t const& tape, std::uint64_t steps) {
+  if (program.file and program.file->initial().applies_to(tape) and !program.file->initial().empty()) {
+    program.initial = program.file->initial();
+    return false;
+  }
+  if (steps == 0) {
+    return false;
+  }
+  auto const view = program.view();
+  switch (tape.cell_bits) {
+    case 16:
+      program.initial = precompute<std::uint16_t>(view, steps, tape);
+      break;
+    case 32:
+      program.initial = precompute<std::uint32_t>(view, steps, tape);
+      break;
+    default:
+      program.initial = precompute<std::uint8_t>(view, steps, tape);
+      break;
+  }
+  auto const pc = program.initial.pc;
+  std::cout << "Precomputed " << program.initial.output.size() << " bytes of output, "
+            << (pc == view.size()                        ? "the whole program"
+                : view[pc].opcode == inst_t::op_code_t::in ? "stopped before input"
+                                                           : "step budget exhausted")
+            << " at instruction " << pc << " of " << view.size() << '\n';
+  return true;
+}
+
+// Applied last, after every pass that only knows plain opcodes.
+void fuse(program_t& program) {
+  auto const fused = bfsuper::fuse(owned(program));
+  std::cout << "Superinstructions: " << fused << '\n';
+}
+
+// Snapshots of the run: written every interval instructions to path, and read back from restore.
+struct checkpoint_t {
+  std::string path;
+  std::uint64_t interval{std::uint64_t{1} << 30};
+  std::string restore;
+};
+
+// Where the run's output starts in stdout when that is a regular file, 0 otherwise. Checkpoints store
+// output offsets from the start of the file, so they cover the compile report printed before the run.
+std::uint64_t output_position() {
+  struct stat st{};
+  if (::fstat(STDOUT_FILENO, &st) != 0 or !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+  auto const position = ::lseek(STDOUT_FILENO, 0, SEEK_CUR);
+  return position < 0 ? 0 : static_cast<std::uint64_t>(position);
+}
+
+// A restored run prints only what follows the snapshot's output offset. When stdout is a file (opened
+// for appending, so the shell keeps its content), cut it there, so output the interrupted run printed
+// after its last checkpoint and the report of this run are not kept.
+void rewind_output(std::uint64_t offset) {
+  struct stat st{};
+  if (::fstat(STDOUT_FILENO, &st) != 0 or !S_ISREG(st.st_mode)) {
+    return;
+  }
+  if (static_cast<std::uint64_t>(st.st_size) < offset) {
+    std::cerr << "Output file is shorter than the snapshot's " << offset << " bytes; continuing at its end\n";
+    return;
+  }
+  if (::ftruncate(STDOUT_FILENO, static_cast<off_t>(offset)) != 0 or
+      ::lseek(STDOUT_FILENO, static_cast<off_t>(offset), SEEK_SET) < 0) {
+    throw std::runtime_error("Failed to rewind the output file");
+  }
+}
+
+// Set by SIGINT when the run has limits, so Ctrl-C stops it at the next check with a report.
+std::atomic<bool> interrupted{false};
 
-  if (argc != 3) {
-    std::cout << "Usage " << argv[0] << "<file>" << "optimization level [0,1,2] \n";
+extern "C" void interrupt_run(int) {
+  interrupted.store(true, std::memory_order_relaxed);
+}
+
+// Without limits the result is always completed.
+template <typename Cell>
+bflimit::result_t run_vm(program_t const& program, BrainFckVMBase::dispatch_t dispatch, bftape::options_t tape,
+                         bfprofile::Counter* profile, checkpoint_t const& checkpoint,
+                         bflimit::limits_t const* limits) {
+  BasicBrainFckVM<Cell> vm{STDIN_FILENO, STDOUT_FILENO, dispatch, tape};
+  vm.set_initial_state(program.initial);
+  if (profile != nullptr) {
+    vm.run(program.view(), *profile);
+    return {};
+  }
+  auto const restored = !checkpoint.restore.empty();
+  auto const start = restored ? 0 : output_position();  // restored offsets are file positions already
+  if (restored) {
+    auto const snapshot = bfsnapshot::read_file(checkpoint.restore, program.view());
+    rewind_output(snapshot.output_offset);
+    vm.restore(snapshot);
+  }
+  if (limits != nullptr) {
+    bflimit::Limited limited{*limits};
+    if (restored) {
+      vm.resume(program.view(), limited);
+    } else {
+      vm.run(program.view(), limited);
+    }
+    return limited.result(vm.pc() == program.view().size());
+  }
+  if (checkpoint.path.empty()) {
+    if (restored) {
+      vm.resume(program.view());
+    } else {
+      vm.run(program.view());
+    }
+    return {};
+  }
+  // The run only stops to copy its dirty cells; the file is written while it continues.
+  bfsnapshot::Checkpointer checkpointer{checkpoint.path, bfsnapshot::program_hash(program.view())};
+  bfsnapshot::Interval interval{checkpoint.interval};
+  if (restored) {
+    vm.resume(program.view(), interval);
   } else {
-    std::ifstream ifs{argv[1], std::ios::in};
-    if (!ifs.is_open()) {
-      std::cerr << "Failed to open file: " << argv[1] << '\n';
+    vm.run(program.view(), interval);
+  }
+  while (vm.pc() < program.view().size()) {
+    auto snapshot = vm.snapshot();
+    snapshot.output_offset += start;
+    checkpointer.submit(std::move(snapshot));
+    vm.resume(program.view(), interval);
+  }
+  checkpointer.wait();
+  return {};
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+  engine_t engine = engine_t::vm;
+  bool stream = false;
+  bool load_bytecode = false;
+  std::string cache_dir;
+  std::string emit_path;
+  auto encoding = bfbytecode::encoding_t::varint;
+  std::size_t profile_loops{0};  // 0: profiling off
+  std::uint64_t precompute_steps{0};  // 0: only use a stored state
+  bool superinstructions = false;
+  checkpoint_t checkpoint;
+  std::optional<bflimit::limits_t> limits;
+  bftape::options_t tape;
+  std::vector<std::string_view> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg{argv[i]};
+    try {
+      if (bftape::parse_option(arg, tape)) {
+        continue;
+      }
+    } catch (std::runtime_error const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+    if (arg == "--engine=vm") {
+      engine = engine_t::vm;
+    } else if (arg == "--engine=threaded") {
+      engine = engine_t::threaded;
+    } else if (arg == "--engine=jit") {
+      engine = engine_t::jit;
+    } else if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--load-bytecode") {
+      load_bytecode = true;
+    } else if (arg.starts_with("--cache-dir=")) {
+      cache_dir = std::string{arg.substr(12)};
+    } else if (arg.starts_with("--emit-bytecode=")) {
+      emit_path = std::string{arg.substr(16)};
+    } else if (arg == "--encoding=raw") {
+      encoding = bfbytecode::encoding_t::raw;
+    } else if (arg == "--encoding=varint") {
+      encoding = bfbytecode::encoding_t::varint;
+    } else if (arg == "--profile") {
+      profile_loops = 10;
+    } else if (arg.starts_with("--profile=")) {
+      profile_loops = static_cast<std::size_t>(std::atoi(std::string{arg.substr(10)}.c_str()));
+      if (profile_loops == 0) {
+        std::cerr << "Invalid loop count: " << arg.substr(10) << '\n';
+        return 1;
+      }
+    } else if (arg == "--superinstructions") {
+      superinstructions = true;
+    } else if (arg == "--precompute") {
+      precompute_steps = std::uint64_t{1} << 32;
+    } else if (arg.starts_with("--precompute=")) {
+      precompute_steps = std::strtoull(std::string{arg.substr(13)}.c_str(), nullptr, 10);
+      if (precompute_steps == 0) {
+        std::cerr << "Invalid step count: " << arg.substr(13) << '\n';
+        return 1;
+      }
+    } else if (arg.starts_with("--checkpoint=")) {
+      checkpoint.path = std::string{arg.substr(13)};
+    } else if (arg.starts_with("--checkpoint-interval=")) {
+      checkpoint.interval = std::strtoull(std::string{arg.substr(22)}.c_str(), nullptr, 10);
+      if (checkpoint.interval == 0) {
+        std::cerr << "Invalid step count: " << arg.substr(22) << '\n';
+        return 1;
+      }
+    } else if (arg.starts_with("--fuel=")) {
+      if (!limits) {
+        limits.emplace();
+      }
+      limits->fuel = std::strtoull(std::string{arg.substr(7)}.c_str(), nullptr, 10);
+      if (limits->fuel == 0) {
+        std::cerr << "Invalid step count: " << arg.substr(7) << '\n';
+        return 1;
+      }
+    } else if (arg.starts_with("--time-limit=")) {
+      auto const ms = std::strtoull(std::string{arg.substr(13)}.c_str(), nullptr, 10);
+      if (ms == 0) {
+        std::cerr << "Invalid time limit: " << arg.substr(13) << '\n';
+        return 1;
+      }
+      if (!limits) {
+        limits.emplace();
+      }
+      limits->time = std::chrono::milliseconds{ms};
+    } else if (arg.starts_with("--restore=")) {
+      checkpoint.restore = std::string{arg.substr(10)};
+    } else if (arg.starts_with("--")) {
+      std::cerr << "Unknown option: " << arg << '\n';
+      print_usage(argv[0]);
       return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  if (positional.size() != (load_bytecode ? 1u : 2u) or (stream and !cache_dir.empty())) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (profile_loops > 0 and engine == engine_t::jit) {
+    std::cerr << "Profiling needs the vm or threaded engine\n";
+    return 1;
+  }
+  if (precompute_steps > 0 and engine == engine_t::jit) {
+    std::cerr << "Precomputing needs the vm or threaded engine\n";
+    return 1;
+  }
+  if (superinstructions and (engine == engine_t::jit or profile_loops > 0)) {
+    std::cerr << "Superinstructions need the vm or threaded engine without profiling\n";
+    return 1;
+  }
+  if ((!checkpoint.path.empty() or !checkpoint.restore.empty()) and
+      (engine == engine_t::jit or profile_loops > 0)) {
+    std::cerr << "Checkpoints need the vm or threaded engine without profiling\n";
+    return 1;
+  }
+  if (limits and (engine == engine_t::jit or profile_loops > 0 or !checkpoint.path.empty())) {
+    std::cerr << "Limits need the vm or threaded engine without profiling or checkpoints\n";
+    return 1;
+  }
+
+  std::string const path{positional[0]};
+  program_t program;
+  std::optional<MappedFile> source;  // kept for the profile report
+  try {
+    if (load_bytecode) {
+      program.file.emplace(path);
+      if (engine != engine_t::jit) {
+        start_state(program, tape, precompute_steps);
+      }
+    } else {
+      auto const optims = static_cast<size_t>(std::atoi(std::string{positional[1]}.c_str()));
+      bfbytecode::header_t header;
+      if (stream) {
+        std::ifstream ifs{path, std::ios::in | std::ios::binary};
+        if (!ifs.is_open()) {
+          std::cerr << "Failed to open file: " << path << '\n';
+          return 1;
+        }
+        auto* const map = profile_loops > 0 ? &program.map : nullptr;
+        program.bytecodes = compile_stream(ifs, optims, std::size_t{1} << 20, map);
+        header.encoding = encoding;
+        header.optims = static_cast<std::uint8_t>(optims);
+      } else {
+        source.emplace(path);
+        compile_cached(program, source->view(), optims, cache_dir, profile_loops > 0);
+        header = make_header(source->view(), optims, encoding);
+      }
+      // The state is stored with the bytecode, so later runs from the cache skip the evaluation too.
+      if (engine != engine_t::jit and start_state(program, tape, precompute_steps) and !cache_dir.empty() and
+          profile_loops == 0) {
+        bfbytecode::write_file(bfbytecode::cache_entry(cache_dir, source->view(), optims), program.view(),
+                               make_header(source->view(), optims, bfbytecode::encoding_t::raw), program.initial);
+      }
+      if (!emit_path.empty()) {
+        bfbytecode::write_file(emit_path, program.view(), header, program.initial);
+        return 0;
+      }
+      if (optims > 4 and engine != engine_t::jit and program.initial.empty()) {
+        fold(program, tape);
+      }
+    }
+    if (superinstructions) {
+      fuse(program);
     }
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  std::cout.flush();  // the engines write straight to the descriptor
 
-    auto const input =
-        rng::subrange(std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{});
+  std::optional<bfprofile::Counter> profile;
+  if (profile_loops > 0) {
+    profile.emplace(program.view().size());
+  }
+  auto* const counter = profile ? &*profile : nullptr;
+  if (limits) {
+    limits->interrupt = &interrupted;
+    std::signal(SIGINT, interrupt_run);
+  }
+  auto const* const limit = limits ? &*limits : nullptr;
+  bflimit::result_t result;
+  auto status = 0;
+  try {
+    if (engine == engine_t::jit) {
+      if (!BrainFckJIT::supported()) {
+        std::cerr << "JIT engine is not supported on this platform\n";
+        return 1;
+      }
+      BrainFckJIT jit{STDIN_FILENO, STDOUT_FILENO, tape};
+      jit.run(program.view());
+    } else {
+      auto const dispatch = (engine == engine_t::threaded) ? BrainFckVMBase::dispatch_t::threaded
+                                                           : BrainFckVMBase::dispatch_t::switch_loop;
+      switch (tape.cell_bits) {
+        case 16:
+          result = run_vm<std::uint16_t>(program, dispatch, tape, counter, checkpoint, limit);
+          break;
+        case 32:
+          result = run_vm<std::uint32_t>(program, dispatch, tape, counter, checkpoint, limit);
+          break;
+        default:
+          result = run_vm<std::uint8_t>(program, dispatch, tape, counter, checkpoint, limit);
+          break;
+      }
+    }
+  } catch (std::runtime_error const& e) {
+    std::cerr << e.what() << '\n';
+    status = 1;
+  }
+
+  if (result.status != bflimit::status_t::completed) {
+    std::cerr << "Stopped: " << bflimit::name(result.status) << " after " << result.steps << " steps\n";
+    status = 2;
+  }
 
-    auto bytecodes = compile(input, atoi(argv[2]));
-        
-    BrainFckVM vm{std::cin, std::cout};
-    vm.run(bytecodes);
-    
+  // Reported on stderr, also when the program stopped on an error.
+  if (profile) {
+    auto const* const map = program.map.size() == 0 ? nullptr : &program.map;
+    bfprofile::report(std::cerr, program.view(), profile->counts(), map, source ? source->view() : std::string_view{},
+                      profile_loops);
   }
+  return status;
 }
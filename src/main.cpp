@@ -1,16 +1,45 @@
+#include "bfrepl.hpp"
+#include "bfsource.hpp"
+#include "bftape.hpp"
 #include "ccbf.hpp"
-#include <fstream>
+#include <cstdint>
 #include <iostream>
-#include <iterator>
 #include <ranges>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
 
 namespace rng = std::ranges;
 
-int main(int argc, char* argv[]) {
-  BFMachine machine{std::cin, std::cout};
+namespace {
 
-  if (argc == 1) {
+// Lines run on one tape, compiled once each and cached.
+template <typename Cell>
+void session(bftape::options_t tape) {
+  bfrepl::BasicSession<Cell> session{std::cin, std::cout, tape};
+  std::string line;
+  while (true) {
+    std::cout << "\nCCBF> ";
+    if (!std::getline(std::cin, line) or line.empty()) {
+      break;
+    }
+    try {
+      session.run(line);
+    } catch (std::runtime_error const& e) {
+      std::cout << '\n' << e.what();
+    }
+  }
+}
+
+// REPL without a file (each line on a fresh tape, or one tape for the whole session), otherwise run
+// the file.
+template <typename Cell>
+int interpret(std::vector<std::string_view> const& positional, bftape::options_t tape, bool persistent) {
+  if (positional.empty() and persistent) {
+    session<Cell>(tape);
+  } else if (positional.empty()) {
+    BasicBFMachine<Cell> machine{std::cin, std::cout, tape};
     std::string program;
     while (true) {
       std::cout << "\nCCBF> ";
@@ -20,20 +49,58 @@ int main(int argc, char* argv[]) {
       if (program.empty()) {
         break;
       }
-      machine.run(program);
+      try {
+        machine.run(program);
+      } catch (std::runtime_error const& e) {
+        std::cout << '\n' << e.what();
+      }
     }
   } else {
-    std::ifstream ifs{argv[1], std::ios::in};
-    if (!ifs.is_open()) {
-      std::cerr << "Failed to open file: " << argv[1] << '\n';
+    try {
+      MappedFile const source{std::string{positional[0]}};
+      BasicBFMachine<Cell> machine{STDIN_FILENO, STDOUT_FILENO, tape};
+      machine.run(source.view());
+    } catch (std::runtime_error const& e) {
+      std::cerr << e.what() << '\n';
       return 1;
     }
-
-    auto const input =
-        rng::subrange(std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{});
-    std::string program{input.begin(), input.end()};
-    machine.run(program);
   }
 
   return 0;
 }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+  bftape::options_t tape;
+  bool persistent = false;
+  std::vector<std::string_view> positional;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view const arg{argv[i]};
+      if (arg == "--session") {
+        persistent = true;
+      } else if (!bftape::parse_option(arg, tape)) {
+        positional.push_back(arg);
+      }
+    }
+  } catch (std::runtime_error const& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  if (positional.size() > 1 or (!positional.empty() and (positional[0].starts_with("--") or persistent))) {
+    std::cout << "Usage " << argv[0] << " " << bftape::option_usage << " [file]\n"
+              << "      " << argv[0] << " " << bftape::option_usage << " --session\n";
+    return 1;
+  }
+
+  switch (tape.cell_bits) {
+    case 16:
+      return interpret<std::uint16_t>(positional, tape, persistent);
+    case 32:
+      return interpret<std::uint32_t>(positional, tape, persistent);
+    default:
+      return interpret<std::uint8_t>(positional, tape, persistent);
+  }
+}
\ No newline at end of file
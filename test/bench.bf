@@ -0,0 +1,6 @@
+Nested counting loops
+Prints the alphabet from Z down to A with a hundred thousand rounds of five nested counters
+and an innermost transfer loop of twenty steps between consecutive letters
+>>++++++++++[-<+++++++++>]<<++++++++++++++++++++++++++[>>++++++++++[>++++++++++[
+>++++++++++[>++++++++++[>++++++++++[>++++++++++++++++++++[->+<]<-]<-]<-]<-]<-]>>
+>>>>[-]<<<<<<<.-<-]>>++++++++++.
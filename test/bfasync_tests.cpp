@@ -0,0 +1,240 @@
+#include "bfasync.hpp"
+#include "bfcompiler.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+void set_nonblocking(int fd) {
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// A connected pair: first for the session (non-blocking), second for the test.
+struct socket_pair_t {
+  std::array<int, 2> fds{-1, -1};
+
+  socket_pair_t() { open(); }
+  ~socket_pair_t() {
+    for (auto const fd : fds) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+  int session() const { return fds[0]; }
+  int client() const { return fds[1]; }
+
+  void open() {
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()), 0) << std::strerror(errno);
+    set_nonblocking(fds[0]);
+  }
+
+  void send(std::string const& bytes) const {
+    ASSERT_EQ(::write(client(), bytes.data(), bytes.size()), static_cast<ssize_t>(bytes.size()));
+  }
+  void close_input() const { ::shutdown(client(), SHUT_WR); }
+
+  // Everything the session sent until it closed its end or nothing is left to read.
+  std::string drain() const {
+    std::string received;
+    std::array<char, 4096> buffer;
+    while (true) {
+      auto const n = ::recv(client(), buffer.data(), buffer.size(), MSG_DONTWAIT);
+      if (n <= 0) {
+        return received;
+      }
+      received.append(buffer.data(), static_cast<std::size_t>(n));
+    }
+  }
+};
+
+// How many of wanted socket pairs the descriptor limit allows, after raising the soft limit toward the
+// hard one (the soft limit is often 1024).
+std::size_t pairs_within_fd_limit(std::size_t wanted) {
+  constexpr rlim_t reserve = 64;  // stdio, gtest, the epoll instance
+  rlimit limit{};
+  ::getrlimit(RLIMIT_NOFILE, &limit);
+  auto const needed = static_cast<rlim_t>(2 * wanted) + reserve;
+  if (limit.rlim_cur < needed) {
+    limit.rlim_cur = std::min(needed, limit.rlim_max);
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+  }
+  return limit.rlim_cur > reserve ? std::min<std::size_t>(wanted, (limit.rlim_cur - reserve) / 2) : 0;
+}
+
+} // namespace
+
+TEST(Async, SuspendPausesAtInputThatIsNotReady) {
+  auto const program = quiet_compile(",.,.");
+  for (auto const dispatch : dispatches) {
+    std::array<int, 2> in{};
+    std::array<int, 2> out{};
+    ASSERT_EQ(::pipe(in.data()), 0);
+    ASSERT_EQ(::pipe(out.data()), 0);
+    set_nonblocking(in[0]);
+    {
+      BrainFckVM vm{in[0], out[1], dispatch};
+      bfasync::Suspend suspend;
+      vm.run(program, suspend);
+      EXPECT_EQ(suspend.take(), bfasync::Suspend::wait_t::input);
+      EXPECT_EQ(vm.pc(), 0u);
+
+      ASSERT_EQ(::write(in[1], "a", 1), 1);
+      vm.resume(program, suspend);
+      EXPECT_EQ(suspend.take(), bfasync::Suspend::wait_t::input);
+      EXPECT_EQ(vm.pc(), 2u);
+
+      ASSERT_EQ(::write(in[1], "b", 1), 1);
+      vm.resume(program, suspend);
+      EXPECT_EQ(suspend.take(), bfasync::Suspend::wait_t::none);
+      EXPECT_EQ(vm.pc(), program.size());
+    }
+    std::array<char, 8> buffer{};
+    EXPECT_EQ(::read(out[0], buffer.data(), buffer.size()), 2);
+    EXPECT_EQ(std::string(buffer.data(), 2), "ab");
+    for (auto const fd : {in[0], in[1], out[0], out[1]}) {
+      ::close(fd);
+    }
+  }
+}
+
+TEST(Async, EchoSessionOverSocketpair) {
+  auto const program = quiet_compile(",[.,]");
+  socket_pair_t pair;
+  bfasync::Session session{program, pair.session(), pair.session()};
+  bfasync::EventLoop loop;
+  loop.spawn(session.run(loop));
+  EXPECT_EQ(loop.size(), 1u);
+
+  std::string received;
+  for (std::string const line : {"hello\n", "world\n"}) {
+    pair.send(line);
+    loop.run_once(1000);
+    received += pair.drain();
+  }
+  EXPECT_EQ(received, "hello\nworld\n");
+  EXPECT_FALSE(session.finished());
+
+  pair.close_input();
+  loop.run();
+  EXPECT_TRUE(session.finished());
+  EXPECT_EQ(session.error(), "");
+  EXPECT_EQ(session.switches(), 3u);
+}
+
+TEST(Async, ThousandSessionsShareOneLoop) {
+  auto const count = pairs_within_fd_limit(1000);
+  ASSERT_GE(count, 100u);
+  auto const program = quiet_compile(",[+.,]");
+  bfasync::EventLoop loop;
+  std::vector<std::unique_ptr<socket_pair_t>> pairs;
+  std::vector<std::unique_ptr<bfasync::Session>> sessions;
+  for (std::size_t i = 0; i < count; ++i) {
+    pairs.push_back(std::make_unique<socket_pair_t>());
+    ASSERT_FALSE(HasFatalFailure());
+    sessions.push_back(std::make_unique<bfasync::Session>(program, pairs.back()->session(), pairs.back()->session()));
+    loop.spawn(sessions.back()->run(loop));
+  }
+  EXPECT_EQ(loop.size(), count);
+  for (std::size_t i = 0; i < count; ++i) {
+    pairs[i]->send("HAL" + std::to_string(i));
+    pairs[i]->close_input();
+  }
+  loop.run();
+  for (std::size_t i = 0; i < count; ++i) {
+    EXPECT_TRUE(sessions[i]->finished());
+    auto expected = "HAL" + std::to_string(i);
+    for (auto& c : expected) {
+      ++c;
+    }
+    EXPECT_EQ(pairs[i]->drain(), expected);
+  }
+}
+
+TEST(Async, SuspendsWhileTheOutputIsFull) {
+  // 255 * 255 copies of 'A', far more than the socket buffer takes at once
+  auto const plain = quiet_compile(std::string(65, '+') + ">-[>-[<<.>>-]<-]", 4);
+  auto const fused = [&] {
+    auto bytecodes = plain;
+    bfsuper::fuse(bytecodes);
+    return bytecodes;
+  }();
+  ASSERT_TRUE(std::ranges::any_of(fused, [](inst_t const& inst) { return bfsuper::is_super(inst.opcode); }));
+  for (auto const* program : {&plain, &fused}) {
+    socket_pair_t pair;
+    int const size = 4096;
+    ::setsockopt(pair.session(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    bfasync::Session session{*program, pair.session(), pair.session(), {}, 1024};
+    bfasync::EventLoop loop;
+    loop.spawn(session.run(loop));
+
+    std::string received;
+    while (!session.finished()) {
+      received += pair.drain();
+      loop.run_once(1000);
+    }
+    received += pair.drain();
+    EXPECT_EQ(received, std::string(255 * 255, 'A'));
+    EXPECT_GT(session.switches(), 10u);
+    EXPECT_EQ(session.error(), "");
+  }
+}
+
+TEST(Async, SendsTheReplyBeforeWaitingForInput) {
+  // 255 * 255 copies of 'A' fit in the session's buffer but not in the socket, so most of them are still
+  // buffered at `,`; the client reads them all before it answers
+  auto const program = quiet_compile(std::string(65, '+') + ">-[>-[<<.>>-]<-],.");
+  socket_pair_t pair;
+  int const size = 4096;
+  ::setsockopt(pair.session(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  bfasync::Session session{program, pair.session(), pair.session(), {}, std::size_t{1} << 16};
+  bfasync::EventLoop loop;
+  loop.spawn(session.run(loop));
+
+  std::string received;
+  for (int i = 0; i < 200 and received.size() < 255 * 255; ++i) {
+    received += pair.drain();
+    loop.run_once(10);
+  }
+  ASSERT_EQ(received, std::string(255 * 255, 'A'));
+  pair.send("z");
+  loop.run();
+  EXPECT_TRUE(session.finished());
+  EXPECT_EQ(pair.drain(), "z");
+}
+
+TEST(Async, SessionErrorsEndOnlyThatSession) {
+  auto const failing = quiet_compile("<+");
+  auto const echo = quiet_compile(",[.,]");
+  socket_pair_t first;
+  socket_pair_t second;
+  bfasync::Session bad{failing, first.session(), first.session(), {.policy = bftape::policy_t::error}};
+  bfasync::Session good{echo, second.session(), second.session()};
+  bfasync::EventLoop loop;
+  loop.spawn(bad.run(loop));
+  loop.spawn(good.run(loop));
+  EXPECT_TRUE(bad.finished());
+  EXPECT_NE(bad.error(), "");
+
+  second.send("ok");
+  second.close_input();
+  loop.run();
+  EXPECT_EQ(second.drain(), "ok");
+}
@@ -0,0 +1,122 @@
+#include "bfbatch.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void write_file(std::filesystem::path const& path, std::string const& contents) {
+  std::ofstream{path, std::ios::binary} << contents;
+}
+
+class BatchTest : public ::testing::Test {
+ protected:
+  std::filesystem::path dir_ = std::filesystem::temp_directory_path() / "ccbf_batch_test";
+
+  void SetUp() override { std::filesystem::create_directories(dir_); }
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+};
+
+} // namespace
+
+TEST(ParallelFor, RunsEveryIndexExactlyOnce) {
+  for (std::size_t threads : {1u, 3u, 8u, 64u}) {
+    std::vector<std::atomic<int>> hits(1000);
+    bfbatch::parallel_for(hits.size(), threads, [&](std::size_t i) { ++hits[i]; });
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+      EXPECT_EQ(hits[i].load(), 1) << "index " << i << " with " << threads << " threads";
+    }
+  }
+}
+
+TEST(ParallelFor, RethrowsTaskExceptionsAfterFinishing) {
+  std::atomic<std::size_t> done{0};
+  EXPECT_THROW(bfbatch::parallel_for(100, 4,
+                                     [&](std::size_t i) {
+                                       ++done;
+                                       if (i == 17) {
+                                         throw std::runtime_error("job failed");
+                                       }
+                                     }),
+               std::runtime_error);
+  EXPECT_EQ(done.load(), 100u);
+}
+
+TEST(Manifest, ParsesJobsRelativeToBase) {
+  std::istringstream manifest{"# program input output\n"
+                              "echo.bf in/a.txt out/a.txt\n"
+                              "\n"
+                              "/abs/hello.bf - out/hello.txt\n"};
+  auto const jobs = bfbatch::parse_manifest(manifest, "/base");
+  ASSERT_EQ(jobs.size(), 2u);
+  EXPECT_EQ(jobs[0].program, "/base/echo.bf");
+  EXPECT_EQ(jobs[0].input, "/base/in/a.txt");
+  EXPECT_EQ(jobs[0].output, "/base/out/a.txt");
+  EXPECT_EQ(jobs[1].program, "/abs/hello.bf");
+  EXPECT_TRUE(jobs[1].input.empty());
+
+  std::istringstream malformed{"echo.bf only-two-fields\n"};
+  EXPECT_THROW(bfbatch::parse_manifest(malformed), std::runtime_error);
+}
+
+TEST_F(BatchTest, RunsJobsAndWritesOutputs) {
+  write_file(dir_ / "echo.bf", ",[.,]");
+  write_file(dir_ / "upper.bf", ",[--------------------------------.,]");
+  write_file(dir_ / "left.bf", "<");
+
+  std::vector<bfbatch::job_t> jobs;
+  for (int i = 0; i < 40; ++i) {
+    auto const input = dir_ / ("in" + std::to_string(i));
+    write_file(input, "job" + std::to_string(i));
+    jobs.push_back({dir_ / (i % 2 == 0 ? "echo.bf" : "upper.bf"), input, dir_ / ("out" + std::to_string(i))});
+  }
+  jobs.push_back({dir_ / "left.bf", {}, dir_ / "out_left"});
+  jobs.push_back({dir_ / "missing.bf", {}, dir_ / "out_missing"});
+
+  bfbatch::options_t options;
+  options.threads = 4;
+  options.tape.policy = bftape::policy_t::error;
+  auto const summary = bfbatch::run(jobs, options);
+
+  EXPECT_EQ(summary.jobs, jobs.size());
+  EXPECT_EQ(summary.programs, 3u);
+  EXPECT_EQ(summary.errors.size(), 2u);
+  for (int i = 0; i < 40; ++i) {
+    auto expected = "job" + std::to_string(i);
+    if (i % 2 != 0) {
+      for (auto& c : expected) {
+        c = static_cast<char>(c - 32);
+      }
+    }
+    EXPECT_EQ(read_file(dir_ / ("out" + std::to_string(i))), expected);
+  }
+  EXPECT_FALSE(std::filesystem::exists(dir_ / "out_missing"));
+}
+
+TEST_F(BatchTest, CompiledProgramsAreReusedAcrossRuns) {
+  write_file(dir_ / "echo.bf", ",[.,]");
+  write_file(dir_ / "in", "abc");
+  std::vector<bfbatch::job_t> const jobs{{dir_ / "echo.bf", dir_ / "in", dir_ / "out"},
+                                         {dir_ / "missing.bf", {}, dir_ / "out_missing"}};
+
+  auto const programs = bfbatch::compile_programs(jobs, 2);
+  EXPECT_EQ(programs.compiled.size(), 1u);
+  EXPECT_EQ(programs.errors.size(), 1u);
+  for (std::size_t threads : {1, 2}) {
+    bfbatch::options_t options;
+    options.threads = threads;
+    auto const summary = bfbatch::run(jobs, programs, options);
+    EXPECT_EQ(summary.programs, 1u);
+    EXPECT_EQ(summary.errors.size(), 1u);
+    EXPECT_EQ(read_file(dir_ / "out"), "abc");
+    std::filesystem::remove(dir_ / "out");
+  }
+}
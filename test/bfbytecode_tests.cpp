@@ -0,0 +1,174 @@
+#include "bfbytecode.hpp"
+#include "bfcompiler.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+void expect_same_program(std::span<inst_t const> actual, std::span<inst_t const> expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(actual[i].opcode, expected[i].opcode) << "at " << i;
+    EXPECT_EQ(actual[i].operand, expected[i].operand) << "at " << i;
+    EXPECT_EQ(actual[i].offset, expected[i].offset) << "at " << i;
+  }
+}
+
+bfbytecode::header_t make_header(std::string const& source, std::size_t optims, bfbytecode::encoding_t encoding) {
+  bfbytecode::header_t header;
+  header.encoding = encoding;
+  header.optims = static_cast<std::uint8_t>(optims);
+  header.source_size = source.size();
+  header.source_hash = bfbytecode::source_hash(source);
+  return header;
+}
+
+// A file name of its own for the running test, so that ctest -j processes do not share files.
+std::filesystem::path temp_path() {
+  auto const* const info = ::testing::UnitTest::GetInstance()->current_test_info();
+  auto name = std::string{info->test_suite_name()} + "." + info->name() + "." + std::to_string(::getpid());
+  std::ranges::replace(name, '/', '_');
+  return std::filesystem::temp_directory_path() / ("ccbf_" + name + ".ccbc");
+}
+
+} // namespace
+
+class BytecodeFileTest : public ::testing::TestWithParam<bfbytecode::encoding_t> {
+ protected:
+  std::filesystem::path path_ = temp_path();
+
+  void TearDown() override { std::filesystem::remove(path_); }
+};
+
+TEST_P(BytecodeFileTest, RoundTripsEveryOptimizationLevel) {
+  auto const source = read_corpus("mandelbrot.bf");
+  for (std::size_t optims = 0; optims <= 4; ++optims) {
+    auto const expected = compile(source, optims);
+    bfbytecode::write_file(path_, expected, make_header(source, optims, GetParam()));
+
+    bfbytecode::BytecodeFile const file{path_.string()};
+    EXPECT_EQ(file.header().encoding, GetParam());
+    EXPECT_EQ(file.header().count, expected.size());
+    EXPECT_TRUE(file.matches(source, optims));
+    EXPECT_FALSE(file.matches(source, optims + 1));
+    EXPECT_FALSE(file.matches(source + "+", optims));
+    expect_same_program(file.program(), expected);
+  }
+}
+
+TEST_P(BytecodeFileTest, RoundTripsStartState) {
+  auto const source = std::string{"++++++++[>++++++++<-]>+.,."};
+  auto const program = compile(source, 4);
+  bftape::initial_t const initial{.cells = {0, 65, 70000},
+                                  .base = 2,
+                                  .pointer = 1,
+                                  .pc = 4,
+                                  .output = std::string("A\0B", 3),
+                                  .cell_bits = 16,
+                                  .tape_size = 300,
+                                  .policy = bftape::policy_t::grow};
+  bfbytecode::write_file(path_, program, make_header(source, 4, GetParam()), initial);
+
+  bfbytecode::BytecodeFile const file{path_.string()};
+  expect_same_program(file.program(), program);
+  EXPECT_EQ(file.initial().cells, initial.cells);
+  EXPECT_EQ(file.initial().base, initial.base);
+  EXPECT_EQ(file.initial().pointer, initial.pointer);
+  EXPECT_EQ(file.initial().pc, initial.pc);
+  EXPECT_EQ(file.initial().output, initial.output);
+  EXPECT_EQ(file.initial().cell_bits, initial.cell_bits);
+  EXPECT_EQ(file.initial().tape_size, initial.tape_size);
+  EXPECT_EQ(file.initial().policy, initial.policy);
+
+  bfbytecode::write_file(path_, program, make_header(source, 4, GetParam()));
+  EXPECT_TRUE(bfbytecode::BytecodeFile{path_.string()}.initial().empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(Encodings, BytecodeFileTest,
+                         ::testing::Values(bfbytecode::encoding_t::raw, bfbytecode::encoding_t::varint));
+
+TEST(BytecodeFile, VarintIsSmallerThanRaw) {
+  auto const source = read_corpus("mandelbrot.bf");
+  auto const program = compile(source, 4);
+  std::ostringstream raw;
+  std::ostringstream varint;
+  bfbytecode::write(raw, program, make_header(source, 4, bfbytecode::encoding_t::raw));
+  bfbytecode::write(varint, program, make_header(source, 4, bfbytecode::encoding_t::varint));
+  EXPECT_EQ(raw.str().size(), bfbytecode::header_size + program.size() * sizeof(inst_t));
+  EXPECT_LT(varint.str().size() * 2, raw.str().size());
+}
+
+TEST(BytecodeFile, RawEncodingIsLittleEndianWithZeroPadding) {
+  using op = inst_t::op_code_t;
+  std::vector<inst_t> const program{{op::add, -3, 7}, {op::mpadd, 70000, -2}, {op::out, 1}};
+  std::ostringstream os;
+  bfbytecode::write(os, program, make_header("+", 2, bfbytecode::encoding_t::raw));
+  std::string const expected{"\x02\x00\x07\x00\xfd\xff\xff\xff"
+                             "\x01\x00\xfe\xff\x70\x11\x01\x00"
+                             "\x06\x00\x00\x00\x01\x00\x00\x00",
+                             24};
+  EXPECT_EQ(os.str().substr(bfbytecode::header_size), expected);
+}
+
+TEST(BytecodeFile, RejectsMalformedFiles) {
+  auto const path = temp_path();
+  auto const source = std::string{"++[>+<-]."};
+  auto const program = compile(source, 2);
+  std::ostringstream os;
+  bfbytecode::write(os, program, make_header(source, 2, bfbytecode::encoding_t::varint));
+  auto const good = os.str();
+
+  auto const expect_rejected = [&](std::string const& contents) {
+    std::ofstream{path, std::ios::binary | std::ios::trunc} << contents;
+    EXPECT_THROW(bfbytecode::BytecodeFile{path.string()}, std::runtime_error);
+  };
+  expect_rejected(source);
+  expect_rejected(good.substr(0, good.size() - 1));
+  expect_rejected(good + '\0');
+  auto wrong_version = good;
+  wrong_version[8] = static_cast<char>(bfbytecode::format_version + 1);
+  expect_rejected(wrong_version);
+
+  // raw files are mapped as they are: a corrupt opcode or jump must not reach the engines
+  std::ostringstream raw_os;
+  bfbytecode::write(raw_os, program, make_header(source, 2, bfbytecode::encoding_t::raw));
+  auto const raw = raw_os.str();
+  auto const at = [&](std::size_t ip) { return bfbytecode::header_size + ip * sizeof(inst_t); };
+  auto const jmpz = static_cast<std::size_t>(std::ranges::find(program, inst_t::op_code_t::jmpz, &inst_t::opcode) -
+                                             program.begin());
+  auto flipped_opcode = raw;
+  flipped_opcode[at(0) + offsetof(inst_t, opcode)] ^= static_cast<char>(0x3f);
+  expect_rejected(flipped_opcode);
+  for (std::int32_t const target : {-1, 0, static_cast<std::int32_t>(program.size()), 1 << 20}) {
+    auto bad_jump = raw;
+    std::memcpy(bad_jump.data() + at(jmpz) + offsetof(inst_t, operand), &target, sizeof(target));
+    expect_rejected(bad_jump);
+  }
+  {
+    std::ofstream{path, std::ios::binary | std::ios::trunc} << raw;
+    EXPECT_NO_THROW(bfbytecode::BytecodeFile{path.string()});
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(BytecodeFile, CacheEntryDependsOnContentAndLevel) {
+  std::filesystem::path const dir{"/cache"};
+  EXPECT_EQ(bfbytecode::cache_entry(dir, "+.", 2), bfbytecode::cache_entry(dir, "+.", 2));
+  EXPECT_NE(bfbytecode::cache_entry(dir, "+.", 2), bfbytecode::cache_entry(dir, "+.", 3));
+  EXPECT_NE(bfbytecode::cache_entry(dir, "+.", 2), bfbytecode::cache_entry(dir, "-.", 2));
+  EXPECT_EQ(bfbytecode::cache_entry(dir, "+.", 2).parent_path(), dir);
+}
@@ -0,0 +1,137 @@
+#include "bfcodegen.hpp"
+#include "bfcompiler.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string run_vm(std::vector<inst_t> const& bytecode, std::string const& input = {}) {
+  std::istringstream in{input};
+  std::ostringstream out;
+  BrainFckVM vm{in, out, BrainFckVM::dispatch_t::threaded};
+  vm.run(bytecode);
+  return out.str();
+}
+
+// Run a shell command with stdin from a file and capture its stdout byte-for-byte.
+std::string run_command(std::string const& command) {
+  std::string output;
+  auto* pipe = popen(command.c_str(), "r");
+  if (pipe == nullptr) {
+    return output;
+  }
+  char buffer[4096];
+  std::size_t n = 0;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+    output.append(buffer, n);
+  }
+  pclose(pipe);
+  return output;
+}
+
+class NativeBuildTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto const probe = bfcodegen::default_c_compiler() + " --version > /dev/null 2>&1";
+    if (std::system(probe.c_str()) != 0) {
+      GTEST_SKIP() << "No C compiler available";
+    }
+    auto const* test = ::testing::UnitTest::GetInstance()->current_test_info();
+    dir_ = std::filesystem::temp_directory_path() / (std::string{"ccbfc_"} + test->name());
+    std::filesystem::create_directories(dir_);
+  }
+
+  void TearDown() override {
+    std::error_code ec;
+    std::filesystem::remove_all(dir_, ec);
+  }
+
+  // Build the bytecode natively and return the binary's stdout for the given stdin.
+  std::string run_native(std::vector<inst_t> const& bytecode, std::string const& input = {}) {
+    auto const binary = (dir_ / "program").string();
+    auto const input_file = (dir_ / "input").string();
+    EXPECT_EQ(bfcodegen::build_native(bytecode, binary), 0);
+    std::ofstream{input_file} << input;
+    return run_command(binary + " < " + input_file);
+  }
+
+  std::filesystem::path dir_;
+};
+
+} // namespace
+
+TEST(BFCodegen, EmitsLoopsAsWhileBlocks) {
+  std::ostringstream os;
+  bfcodegen::emit_c(compile(std::string{"+[->+<]"}, 0), os);
+  auto const c = os.str();
+  EXPECT_NE(c.find("#define TAPE_SIZE 30000u"), std::string::npos);
+  EXPECT_NE(c.find("while (tape[mp]) {"), std::string::npos);
+  EXPECT_NE(c.find("  }\n"), std::string::npos);
+  EXPECT_NE(c.find("int main(void)"), std::string::npos);
+}
+
+TEST(BFCodegen, FlushesBeforeInputOnlyOnATerminal) {
+  std::ostringstream os;
+  bfcodegen::emit_c(compile(std::string{",.,."}, 0), os);
+  auto const c = os.str();
+  auto const check = c.find("isatty(0)");
+  ASSERT_NE(check, std::string::npos);
+  EXPECT_EQ(c.find("isatty(0)", check + 1), std::string::npos);
+  EXPECT_GT(check, c.find("int main(void)"));
+  EXPECT_NE(c.find("if (interactive) {\n    fflush(stdout);"), std::string::npos);
+}
+
+TEST(BFCodegen, ThrowsOnUnbalancedLoops) {
+  std::ostringstream os;
+  std::vector<inst_t> const open{inst_t{inst_t::op_code_t::jmpz, 0}};
+  EXPECT_THROW(bfcodegen::emit_c(open, os), std::runtime_error);
+  std::vector<inst_t> const close{inst_t{inst_t::op_code_t::jmpnz, 0}};
+  EXPECT_THROW(bfcodegen::emit_c(close, os), std::runtime_error);
+}
+
+TEST_F(NativeBuildTest, EchoesInputAndHandlesEOF) {
+  auto const bytecode = compile(std::string{",.>,.<<,."}, 4);
+  EXPECT_EQ(run_native(bytecode, "ab"), run_vm(bytecode, "ab"));
+}
+
+TEST_F(NativeBuildTest, MultipliesWithoutOverflow) {
+  // 200 * 21474837 does not fit in an int; the product wraps like the VM's
+  std::vector<inst_t> const bytecode{{inst_t::op_code_t::add, 200},
+                                     {inst_t::op_code_t::mul, 21474837, 1},
+                                     {inst_t::op_code_t::mul, -3, 2},
+                                     {inst_t::op_code_t::set, 0},
+                                     {inst_t::op_code_t::out, 0, 1},
+                                     {inst_t::op_code_t::out, 0, 2}};
+  std::ostringstream os;
+  bfcodegen::emit_c(bytecode, os);
+  EXPECT_NE(os.str().find("(uint32_t)tape[mp] * (uint32_t)(21474837)"), std::string::npos);
+  EXPECT_EQ(run_native(bytecode), run_vm(bytecode));
+}
+
+TEST_F(NativeBuildTest, MatchesVMOnHelloWorld) {
+  auto const program = read_corpus("helloworld.bf");
+  ASSERT_FALSE(program.empty());
+  for (size_t optims = 0; optims <= 4; ++optims) {
+    auto const bytecode = compile(program, optims);
+    EXPECT_EQ(run_native(bytecode), run_vm(bytecode)) << "optimization level " << optims;
+  }
+}
+
+TEST_F(NativeBuildTest, MatchesVMOnMandelbrot) {
+  auto const program = read_corpus("mandelbrot.bf");
+  ASSERT_FALSE(program.empty());
+  auto const bytecode = compile(program, 4);
+  auto const expected = run_vm(bytecode);
+  ASSERT_FALSE(expected.empty());
+  EXPECT_EQ(run_native(bytecode), expected);
+}
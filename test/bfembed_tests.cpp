@@ -0,0 +1,80 @@
+#include "bfcompiler.hpp"
+#include "bfembed.hpp"
+#include "bfvm.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr char hello[] =
+    "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.";
+
+// Prints every input byte plus one.
+constexpr char shift[] = ",[+.,]";
+
+template <typename Program>
+std::string run_vm(Program const& program, std::string const& input = {}) {
+  std::istringstream in{input};
+  std::ostringstream out;
+  BrainFckVM vm{in, out};
+  vm.run(program);
+  return out.str();
+}
+
+template <auto Source>
+void expect_same_bytecode(std::size_t optims, auto const& embedded) {
+  auto const compiled = compile(std::string_view{Source}, optims);
+  ASSERT_EQ(embedded.size(), compiled.size());
+  for (std::size_t i = 0; i < compiled.size(); ++i) {
+    EXPECT_EQ(embedded[i].opcode, compiled[i].opcode) << "at " << i;
+    EXPECT_EQ(embedded[i].operand, compiled[i].operand) << "at " << i;
+    EXPECT_EQ(embedded[i].offset, compiled[i].offset) << "at " << i;
+  }
+}
+
+} // namespace
+
+TEST(Embed, BytecodeMatchesCompile) {
+  expect_same_bytecode<hello>(0, bfembed::bytecode<hello, 0>);
+  expect_same_bytecode<hello>(1, bfembed::bytecode<hello, 1>);
+  expect_same_bytecode<hello>(2, bfembed::bytecode<hello, 2>);
+  expect_same_bytecode<shift>(2, bfembed::bytecode<shift, 2>);
+}
+
+TEST(Embed, InputFreeProgramsRunAtCompileTime) {
+  static_assert(bfembed::output<hello> == "Hello World!\n");
+  static_assert(bfembed::output<hello, 0> == "Hello World!\n");
+  static_assert(bfembed::output<"++++++++[>++++++++<-]>+."> == "A");
+  static_assert(bfembed::output<"[.]+[-]"> .empty());
+  EXPECT_EQ(bfembed::output<hello>, run_vm(bfembed::bytecode<hello>));
+}
+
+TEST(Embed, EvaluateTakesCellWidths) {
+  // 256 increments wrap an 8-bit cell to zero but not a 16-bit one
+  constexpr auto& program =
+      bfembed::bytecode<"++++++++++++++++[>++++++++++++++++<-]>[[-]>++++++++++++++++++++++++++++++++++.<]">;
+  static_assert(bfembed::evaluate(program).empty());
+  static_assert(bfembed::evaluate<std::uint16_t>(program) == "\"");
+}
+
+TEST(Embed, UnrolledRunMatchesTheVM) {
+  std::ostringstream out;
+  std::istringstream none;
+  bfembed::run<hello>(none, out);
+  EXPECT_EQ(out.str(), "Hello World!\n");
+
+  for (std::string const input : {"HAL", "", "hello, world"}) {
+    std::istringstream in{input};
+    std::ostringstream shifted;
+    bfembed::run<shift>(in, shifted);
+    EXPECT_EQ(shifted.str(), run_vm(bfembed::bytecode<shift>, input)) << input;
+  }
+  std::istringstream in{"HAL"};
+  std::ostringstream shifted;
+  bfembed::run<shift, 0, std::uint16_t>(in, shifted);
+  EXPECT_EQ(shifted.str(), "IBM");
+}
@@ -0,0 +1,82 @@
+#include "bfio.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+TEST(BFIO, OutputIsBufferedUntilFlush) {
+  std::ostringstream os;
+  bfio::Output out{os};
+  out.put('a');
+  out.put('b');
+  EXPECT_TRUE(os.str().empty());
+  out.flush();
+  EXPECT_EQ(os.str(), "ab");
+}
+
+TEST(BFIO, OutputFlushesWhenBufferFills) {
+  std::ostringstream os;
+  {
+    bfio::Output out{os};
+    for (std::size_t i = 0; i <= bfio::Output::buffer_size; ++i) {
+      out.put('x');
+    }
+    EXPECT_EQ(os.str().size(), bfio::Output::buffer_size);
+  }
+  EXPECT_EQ(os.str().size(), bfio::Output::buffer_size + 1);  // destructor flushes the rest
+}
+
+TEST(BFIO, StreamInputFlushesTiedOutputAtEOF) {
+  std::istringstream is{"hi"};
+  std::ostringstream os;
+  bfio::Output out{os};
+  bfio::Input in{is};
+  out.put('>');
+  EXPECT_EQ(in.get(out), 'h');
+  EXPECT_EQ(in.get(out), 'i');
+  EXPECT_EQ(in.get(out), bfio::eof);
+  EXPECT_EQ(os.str(), ">");
+}
+
+TEST(BFIO, DescriptorRoundTrip) {
+  int fds[2];
+  ASSERT_EQ(::pipe(fds), 0);
+  {
+    bfio::Output out{fds[1]};
+    for (char const c : std::string{"pipe"}) {
+      out.put(static_cast<std::uint8_t>(c));
+    }
+  }
+  ::close(fds[1]);
+
+  std::ostringstream os;
+  bfio::Output tie{os};
+  bfio::Input in{fds[0], true};
+  std::string read;
+  for (int c = in.get(tie); c != bfio::eof; c = in.get(tie)) {
+    read.push_back(static_cast<char>(c));
+  }
+  ::close(fds[0]);
+  EXPECT_EQ(read, "pipe");
+}
+
+TEST(BFIO, CountsBytesThroughTheBuffers) {
+  std::istringstream is{"abcdef"};
+  std::ostringstream os;
+  bfio::Output out{os};
+  bfio::Input in{is};
+  EXPECT_EQ(in.get(out), 'a');
+  EXPECT_EQ(in.skip(3, out), 3u);
+  EXPECT_EQ(in.consumed(), 4u);
+  EXPECT_EQ(in.get(out), 'e');
+  EXPECT_EQ(in.skip(10, out), 1u);  // stops at the end of the input
+  EXPECT_EQ(in.consumed(), 6u);
+
+  out.write("xyz");
+  EXPECT_EQ(out.written(), 3u);
+  out.flush();
+  out.put('w');
+  EXPECT_EQ(out.written(), 4u);
+}
@@ -0,0 +1,117 @@
+#include "bfcompiler.hpp"
+#include "bfjit.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::string run_jit(std::string_view program, std::string_view input = {}, size_t optims = 2) {
+  std::istringstream in{std::string{input}};
+  std::ostringstream out;
+
+  auto bytecode = compile(program, optims);
+  BrainFckJIT jit{in, out};
+  jit.run(bytecode);
+  return out.str();
+}
+
+std::string run_vm(std::string_view program, std::string_view input = {}, size_t optims = 2) {
+  std::istringstream in{std::string{input}};
+  std::ostringstream out;
+
+  auto bytecode = compile(program, optims);
+  BrainFckVM vm{in, out};
+  vm.run(bytecode);
+  return out.str();
+}
+
+class BrainFckJITTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    if (!BrainFckJIT::supported()) {
+      GTEST_SKIP() << "JIT backend not supported on this host";
+    }
+  }
+};
+
+} // namespace
+
+TEST_F(BrainFckJITTest, EmitsIncrementedByte) {
+  auto const output = run_jit("+.");
+  ASSERT_EQ(output.size(), 1u);
+  EXPECT_EQ(output[0], static_cast<char>(1));
+}
+
+TEST_F(BrainFckJITTest, EchoesInputByte) {
+  auto const output = run_jit(",.", "Z");
+  ASSERT_EQ(output.size(), 1u);
+  EXPECT_EQ(output[0], 'Z');
+}
+
+TEST_F(BrainFckJITTest, SetsCellToZeroOnEOF) {
+  auto const output = run_jit("+,.");
+  ASSERT_EQ(output.size(), 1u);
+  EXPECT_EQ(output[0], static_cast<char>(0));
+}
+
+TEST_F(BrainFckJITTest, SkipsLoopBodyWhenCellZero) {
+  auto const output = run_jit("[+]+.");
+  ASSERT_EQ(output.size(), 1u);
+  EXPECT_EQ(output[0], static_cast<char>(1));
+}
+
+TEST_F(BrainFckJITTest, ExecutesLoopUntilCellZero) {
+  auto const output = run_jit("++[.-]");
+  std::string expected;
+  expected.push_back(static_cast<char>(2));
+  expected.push_back(static_cast<char>(1));
+  EXPECT_EQ(output, expected);
+}
+
+TEST_F(BrainFckJITTest, WrapsLeftFromTapeOrigin) {
+  auto const output = run_jit("<+.>.<<<<<-.", {}, 1);
+  std::string const expected{static_cast<char>(1), static_cast<char>(0), static_cast<char>(255)};
+  EXPECT_EQ(output, expected);
+}
+
+TEST_F(BrainFckJITTest, HonoursTapeSize) {
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckJIT jit{in, out, {.size = 4}};
+  jit.run(compile("+++>>>>[-]<<<<.", 4));
+  EXPECT_EQ(out.str(), std::string(1, '\0'));
+  EXPECT_THROW((BrainFckJIT{in, out, {.policy = bftape::policy_t::grow}}), std::runtime_error);
+}
+
+TEST_F(BrainFckJITTest, MatchesVMOnHelloWorld) {
+  auto const program = read_corpus("helloworld.bf");
+  ASSERT_FALSE(program.empty());
+  for (size_t optims = 0; optims <= 4; ++optims) {
+    EXPECT_EQ(run_jit(program, {}, optims), run_vm(program, {}, optims)) << "optimization level " << optims;
+  }
+}
+
+TEST_F(BrainFckJITTest, RunsMultiplyLoops) {
+  auto const program = "+++++[->+++>++<<]>.>.<<<+++[-<++>>+<]<.>>.";
+  EXPECT_EQ(run_jit(program, {}, 3), run_vm(program, {}, 0));
+}
+
+TEST_F(BrainFckJITTest, RunsOffsetAddressedInstructions) {
+  auto const program = "<<+<+>>>,<.>>.<<<<.>+>++<<-.>.>.+++[->>+<<]>>.";
+  for (size_t optims = 3; optims <= 4; ++optims) {
+    EXPECT_EQ(run_jit(program, "x", optims), run_vm(program, "x", 0)) << "optimization level " << optims;
+  }
+}
+
+TEST_F(BrainFckJITTest, RunsScans) {
+  auto const program = "+>+>+>+>>+<<<<<[>]>.<<[<]>.>+>>+>>+<<<<<[>>]+.<<[<<]<.";
+  EXPECT_EQ(run_jit(program, {}, 4), run_vm(program, {}, 0));
+}
@@ -0,0 +1,111 @@
+#include "bfcompiler.hpp"
+#include "bflimit.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(Limits, CompletedRunsMatchUnlimitedOnes) {
+  auto const bytecodes = compile(std::string_view{"++++++++[>++++++++<-]>+."}, 2);  // level 3 drops the loop
+  std::vector<std::uint64_t> steps;
+  for (auto const dispatch : dispatches) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, dispatch};
+    auto const result = vm.run_limited(bytecodes, {.fuel = 1000000});
+    EXPECT_EQ(result.status, bflimit::status_t::completed);
+    EXPECT_EQ(out.str(), "A");
+    steps.push_back(result.steps);
+  }
+  EXPECT_EQ(steps[0], 7u * 5u);  // seven back-edges over the five instructions of the loop
+  EXPECT_EQ(steps[0], steps[1]);
+}
+
+TEST(Limits, FuelStopsInfiniteLoops) {
+  // an empty loop, a loop with a body, and a scan that never finds a zero on an 8-cell tape
+  bftape::options_t tape;
+  tape.size = 8;
+  for (auto const source : {"+[]", "+[>+<]", "+>+>+>+>+>+>+>+[>]"}) {
+    auto const bytecodes = compile(std::string_view{source}, 2);
+    for (auto const dispatch : dispatches) {
+      std::istringstream in;
+      std::ostringstream out;
+      BrainFckVM vm{in, out, dispatch, tape};
+      auto const result = vm.run_limited(bytecodes, {.fuel = 100000});
+      EXPECT_EQ(result.status, bflimit::status_t::out_of_fuel) << source;
+      EXPECT_LE(result.steps, 100000u) << source;
+      EXPECT_GT(result.steps, 90000u) << source;
+      EXPECT_LT(vm.pc(), bytecodes.size()) << source;
+    }
+  }
+}
+
+TEST(Limits, StoppedRunsResumeWithMoreFuel) {
+  auto bytecodes = compile(read_corpus("fib.bf"), 4);
+  std::string expected;
+  {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out};
+    vm.run(bytecodes);
+    expected = out.str();
+  }
+  bfsuper::fuse(bytecodes);  // fused sequences end in back-edges too
+  for (auto const dispatch : dispatches) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, dispatch};
+    auto result = vm.run_limited(bytecodes, {.fuel = 50000});
+    std::uint64_t steps = result.steps;
+    int stops = 0;
+    while (result.status == bflimit::status_t::out_of_fuel) {
+      ++stops;
+      bflimit::Limited more{{.fuel = 50000}};
+      vm.resume(bytecodes, more);
+      result = more.result(vm.pc() == bytecodes.size());
+      steps += result.steps;
+    }
+    EXPECT_EQ(result.status, bflimit::status_t::completed);
+    EXPECT_GT(stops, 10);
+    EXPECT_EQ(out.str(), expected);
+    EXPECT_LE(steps, 50000u * (stops + 1u));
+  }
+}
+
+TEST(Limits, InterruptAndDeadlineStopLongRuns) {
+  auto const bytecodes = compile(std::string_view{"+[>+<]"}, 2);
+  for (auto const dispatch : dispatches) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, dispatch};
+    std::atomic<bool> interrupt{false};
+    std::jthread const stopper{[&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds{20});
+      interrupt = true;
+    }};
+    auto const result = vm.run_limited(bytecodes, {.interrupt = &interrupt});
+    EXPECT_EQ(result.status, bflimit::status_t::interrupted);
+    EXPECT_GT(result.steps, 0u);
+  }
+
+  for (auto const dispatch : dispatches) {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, dispatch};
+    auto const start = std::chrono::steady_clock::now();
+    auto const result = vm.run_limited(bytecodes, {.time = std::chrono::milliseconds{30}});
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(result.status, bflimit::status_t::out_of_time);
+    EXPECT_GE(elapsed, std::chrono::milliseconds{30});
+    EXPECT_LT(elapsed, std::chrono::seconds{5});
+  }
+  EXPECT_EQ(bflimit::name(bflimit::status_t::out_of_time), "out of time");
+}
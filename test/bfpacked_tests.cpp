@@ -0,0 +1,84 @@
+#include "bfcompiler.hpp"
+#include "bfpacked.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void expect_same_program(std::span<inst_t const> actual, std::span<inst_t const> expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(actual[i].opcode, expected[i].opcode) << "at " << i;
+    EXPECT_EQ(actual[i].operand, expected[i].operand) << "at " << i;
+    EXPECT_EQ(actual[i].offset, expected[i].offset) << "at " << i;
+  }
+}
+
+template <typename Program>
+std::string run(Program const& program, dispatch_t dispatch) {
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM vm{in, out, dispatch};
+  vm.run(program);
+  return out.str();
+}
+
+} // namespace
+
+TEST(Packed, RoundTripsCompiledPrograms) {
+  for (std::size_t optims = 0; optims <= 4; ++optims) {
+    auto const bytecodes = compile(read_corpus("hanoi.bf"), optims);
+    bfpacked::Program const packed{bytecodes};
+    SCOPED_TRACE(optims);
+    expect_same_program(packed.unpack(), bytecodes);
+    EXPECT_EQ(packed.escaped(), 0u);
+    EXPECT_EQ(packed.bytes(), bytecodes.size() * 4);
+  }
+}
+
+TEST(Packed, EscapesWhatDoesNotFit) {
+  std::vector<inst_t> bytecodes{
+      {inst_t::op_code_t::mpadd, 1 << 20},
+      {inst_t::op_code_t::add, 1, -128},
+      {inst_t::op_code_t::mul, -(1 << 18), 127},
+      {inst_t::op_code_t::set, 0, 200},
+  };
+  bfpacked::Program const packed{bytecodes};
+  expect_same_program(packed.unpack(), bytecodes);
+  EXPECT_EQ(packed.escaped(), 3u);
+}
+
+TEST(Packed, EscapesFarJumps) {
+  // a loop body too long for the 19-bit distance
+  std::vector<inst_t> bytecodes;
+  bytecodes.push_back({inst_t::op_code_t::jmpz, 300001});
+  for (int i = 0; i < 300000; ++i) {
+    bytecodes.push_back({inst_t::op_code_t::add, 1, static_cast<std::int16_t>(i % 7)});
+  }
+  bytecodes.push_back({inst_t::op_code_t::jmpnz, 0});
+  bfpacked::Program const packed{bytecodes};
+  expect_same_program(packed.unpack(), bytecodes);
+  EXPECT_EQ(packed.escaped(), 2u);
+}
+
+TEST(Packed, RunsLikeTheUnpackedProgram) {
+  auto const source = read_corpus("hanoi.bf");
+  for (std::size_t optims : {2, 4}) {
+    auto bytecodes = compile(source, optims);
+    if (optims == 4) {
+      bfsuper::fuse(bytecodes);
+    }
+    bfpacked::Program const packed{bytecodes};
+    auto const expected = run(bytecodes, dispatch_t::switch_loop);
+    EXPECT_EQ(run(packed.view(), dispatch_t::switch_loop), expected) << "level " << optims;
+    EXPECT_EQ(run(packed.view(), dispatch_t::threaded), expected) << "level " << optims;
+  }
+}
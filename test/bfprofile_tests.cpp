@@ -0,0 +1,89 @@
+#include "bfcompiler.hpp"
+#include "bfprofile.hpp"
+#include "bfvm.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::uint64_t> profile(std::vector<inst_t> const& bytecodes, BrainFckVM::dispatch_t dispatch) {
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM vm{in, out, dispatch};
+  bfprofile::Counter counter{bytecodes.size()};
+  vm.run(bytecodes, counter);
+  return {counter.counts().begin(), counter.counts().end()};
+}
+
+} // namespace
+
+TEST(Profile, CountsEveryExecutedInstruction) {
+  auto const bytecodes = compile(std::string_view{"++[->+<]>."}, 1);
+  // add 2, jmpz, add -1, mpadd 1, add 1, mpadd -1, jmpnz, mpadd 1, out
+  std::vector<std::uint64_t> const expected{1, 1, 2, 2, 2, 2, 2, 1, 1};
+  EXPECT_EQ(profile(bytecodes, BrainFckVM::dispatch_t::switch_loop), expected);
+  EXPECT_EQ(profile(bytecodes, BrainFckVM::dispatch_t::threaded), expected);
+}
+
+TEST(Profile, SourceMapPointsAtBrackets) {
+  std::string const program = "[>] +++ [>++ [-] <-] comment";
+  source_map_t map;
+  auto const bytecodes = compile(program, 4, &map);
+  ASSERT_EQ(map.size(), bytecodes.size());
+  for (std::size_t i = 0; i < bytecodes.size(); ++i) {
+    if (bytecodes[i].opcode == inst_t::op_code_t::jmpz) {
+      EXPECT_EQ(program[map.begin[i]], '[') << "instruction " << i;
+    } else if (bytecodes[i].opcode == inst_t::op_code_t::jmpnz) {
+      EXPECT_EQ(program[map.begin[i]], ']') << "instruction " << i;
+    }
+  }
+  // [-] became a set and [>] a scan; only the outer loop is left
+  auto const loops = bfprofile::loops(bytecodes, std::vector<std::uint64_t>(bytecodes.size(), 1), &map);
+  ASSERT_EQ(loops.size(), 1u);
+  EXPECT_EQ(loops[0].source_begin, 8u);
+  EXPECT_EQ(loops[0].source_end, 19u);
+  EXPECT_EQ(bytecodes[0].opcode, inst_t::op_code_t::scan);
+  EXPECT_EQ(map.begin[0], 0u);  // the scan spans the whole [>]
+  EXPECT_EQ(map.end[0], 3u);
+
+  std::istringstream is{program};
+  source_map_t streamed;
+  compile_stream(is, 4, 5, &streamed);
+  EXPECT_EQ(streamed.begin, map.begin);
+  EXPECT_EQ(streamed.end, map.end);
+}
+
+TEST(Profile, RanksLoopsByExecutedInstructions) {
+  std::string const program = "++[>+++[>+<-]<-]>>.";
+  source_map_t map;
+  auto const bytecodes = compile(program, 2, &map);
+  auto const counts = profile(bytecodes, BrainFckVM::dispatch_t::threaded);
+  auto const loops = bfprofile::loops(bytecodes, counts, &map);
+  ASSERT_EQ(loops.size(), 2u);
+
+  // the inner loop does most of the work; the outer one only includes it
+  auto const& inner = loops[0];
+  auto const& outer = loops[1];
+  EXPECT_EQ(inner.depth, 1u);
+  EXPECT_EQ(inner.entries, 2u);
+  EXPECT_EQ(inner.iterations, 6u);
+  EXPECT_EQ(inner.source_begin, 7u);
+  EXPECT_EQ(inner.self, 2u + 6 * 4 + 6);  // jmpz twice, four body instructions and a jmpnz per iteration
+  EXPECT_EQ(inner.executed, inner.self);
+  EXPECT_EQ(outer.depth, 0u);
+  EXPECT_EQ(outer.entries, 1u);
+  EXPECT_EQ(outer.iterations, 2u);
+  EXPECT_EQ(outer.source_begin, 2u);
+  EXPECT_EQ(outer.executed, outer.self + inner.executed);
+
+  std::ostringstream report;
+  bfprofile::report(report, bytecodes, counts, &map, program);
+  EXPECT_NE(report.str().find("Hot loops"), std::string::npos);
+  EXPECT_NE(report.str().find("[>+++[>+<-]<-]"), std::string::npos);
+  EXPECT_NE(report.str().find("jmpnz"), std::string::npos);
+}
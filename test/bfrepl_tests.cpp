@@ -0,0 +1,75 @@
+#include "bfrepl.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST(Session, KeepsTapeAndPointerAcrossLines) {
+  std::istringstream in;
+  std::ostringstream out;
+  bfrepl::Session session{in, out};
+  session.run("++++++++[>++++++++<-]>");  // 64 in cell 1
+  session.run("+.");
+  session.run("+.>");
+  EXPECT_EQ(out.str(), "AB");
+  auto const state = session.state();
+  EXPECT_EQ(state.pointer, 2u);
+  EXPECT_EQ(state.base, 1u);
+  EXPECT_EQ(state.cells, std::vector<std::uint32_t>{66});
+}
+
+TEST(Session, CachesFragmentsByTheirCommands) {
+  std::istringstream in;
+  std::ostringstream out;
+  bfrepl::Session session{in, out};
+  session.run("+++.");
+  session.run("+++ . add three and print");
+  session.run("+++.");
+  EXPECT_EQ(session.misses(), 1u);
+  EXPECT_EQ(session.hits(), 2u);
+  EXPECT_EQ(session.cached(), 1u);
+  EXPECT_EQ(out.str(), std::string("\x03\x06\x09"));
+
+  session.run("comments only");
+  EXPECT_EQ(session.cached(), 2u);  // as an empty fragment
+}
+
+TEST(Session, ReadsInputAcrossLines) {
+  std::istringstream in{"ab"};
+  std::ostringstream out;
+  bfrepl::Session session{in, out};
+  session.run(",>,");
+  session.run("<.>.");
+  EXPECT_EQ(out.str(), "ab");
+}
+
+TEST(Session, ErrorsLeaveTheSessionUsable) {
+  std::istringstream in;
+  std::ostringstream out;
+  bftape::options_t tape;
+  tape.size = 8;
+  tape.policy = bftape::policy_t::error;
+  bfrepl::Session session{in, out, tape, 2};
+  session.run(">>+");
+
+  try {
+    session.run("  [+");
+    FAIL() << "unmatched bracket compiled";
+  } catch (std::runtime_error const& e) {
+    EXPECT_NE(std::string{e.what()}.find("column 3"), std::string::npos) << e.what();
+  }
+  EXPECT_EQ(session.cached(), 1u);
+
+  EXPECT_THROW(session.run("+<<<"), std::runtime_error);
+  auto const state = session.state();
+  EXPECT_EQ(state.pointer, 2u);  // back where the failed line started
+  EXPECT_EQ(state.cells, std::vector<std::uint32_t>{2});  // its + stays
+
+  EXPECT_EQ(session.cached(), 2u);  // the failed line compiled
+  session.run("+.");  // a third fragment starts the cache over
+  EXPECT_EQ(out.str(), std::string("\x03"));
+  EXPECT_EQ(session.cached(), 1u);
+}
@@ -0,0 +1,74 @@
+#include "bfscan.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Step-by-step reference with the same wraparound as BrainFckVM::wrap_pointer.
+std::size_t reference_scan(std::vector<std::uint8_t> const& tape, std::size_t start, std::int32_t stride) {
+  auto const size = static_cast<std::ptrdiff_t>(tape.size());
+  auto p = static_cast<std::ptrdiff_t>(start);
+  for (std::ptrdiff_t steps = 0; steps <= size; ++steps) {
+    if (tape[static_cast<std::size_t>(p)] == 0) {
+      return static_cast<std::size_t>(p);
+    }
+    p = ((p + stride) % size + size) % size;
+  }
+  return bfscan::npos;
+}
+
+} // namespace
+
+TEST(BFScan, ReturnsStartWhenCellIsZero) {
+  std::vector<std::uint8_t> tape(64, 1);
+  tape[10] = 0;
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 10, 1), 10u);
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 10, -3), 10u);
+}
+
+TEST(BFScan, WrapsAroundTheTapeEnds) {
+  std::vector<std::uint8_t> tape(100, 1);
+  tape[3] = 0;
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 90, 1), 3u);
+  tape[3] = 1;
+  tape[97] = 0;
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 5, -1), 97u);
+}
+
+TEST(BFScan, ReportsOrbitWithoutZero) {
+  std::vector<std::uint8_t> tape(30000, 1);
+  tape[1] = 0;  // odd position, unreachable with an even stride from an even start
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 0, 2), bfscan::npos);
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 0, -4), bfscan::npos);
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 0, 0), bfscan::npos);
+  EXPECT_EQ(bfscan::scan_zero(tape.data(), tape.size(), 0, 7), 1u);  // stride coprime with the size visits every cell
+}
+
+TEST(BFScan, MatchesReferenceForRandomTapes) {
+  std::mt19937 rng{42};
+  std::int32_t const strides[] = {1, -1, 2, -2, 3, -3, 4, -4, 5, 8, -8, 16, -16, 17, 29999, -30001};
+  for (std::size_t size : {37u, 256u, 1000u, 30000u}) {
+    std::vector<std::uint8_t> tape(size);
+    for (int round = 0; round < 20; ++round) {
+      std::uniform_int_distribution<int> value{1, 255};
+      for (auto& cell : tape) {
+        cell = static_cast<std::uint8_t>(value(rng));
+      }
+      std::uniform_int_distribution<std::size_t> position{0, size - 1};
+      auto const zeros = round % 4;  // also exercises tapes without any zero
+      for (int z = 0; z < zeros; ++z) {
+        tape[position(rng)] = 0;
+      }
+      for (auto const stride : strides) {
+        auto const start = position(rng);
+        EXPECT_EQ(bfscan::scan_zero(tape.data(), size, start, stride), reference_scan(tape, start, stride))
+            << "size " << size << " start " << start << " stride " << stride;
+      }
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#include "bfcompiler.hpp"
+#include "bfsnapshot.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::string run(std::vector<inst_t> const& bytecodes, std::string const& input, dispatch_t dispatch) {
+  std::istringstream in{input};
+  std::ostringstream out;
+  BrainFckVM vm{in, out, dispatch};
+  vm.run(bytecodes);
+  return out.str();
+}
+
+// Prints every input byte plus one until the input ends.
+constexpr std::string_view shift = ",[+.,]";
+
+} // namespace
+
+TEST(Snapshot, EncodingRoundTrips) {
+  bfsnapshot::snapshot_t snapshot;
+  snapshot.state.cells = {0, 3, 0, 70000};
+  snapshot.state.base = 12;
+  snapshot.state.pointer = 14;
+  snapshot.state.pc = 5;
+  snapshot.state.cell_bits = 32;
+  snapshot.state.tape_size = 1024;
+  snapshot.state.policy = bftape::policy_t::grow;
+  snapshot.program_hash = 0x0123456789abcdefull;
+  snapshot.input_offset = 7;
+  snapshot.output_offset = std::uint64_t{1} << 40;
+
+  auto const bytes = bfsnapshot::encode(snapshot);
+  auto const decoded = bfsnapshot::decode(bytes);
+  EXPECT_EQ(decoded.state.cells, snapshot.state.cells);
+  EXPECT_EQ(decoded.state.base, 12u);
+  EXPECT_EQ(decoded.state.pointer, 14u);
+  EXPECT_EQ(decoded.state.pc, 5u);
+  EXPECT_EQ(decoded.state.cell_bits, 32u);
+  EXPECT_EQ(decoded.state.tape_size, 1024u);
+  EXPECT_EQ(decoded.state.policy, bftape::policy_t::grow);
+  EXPECT_EQ(decoded.program_hash, snapshot.program_hash);
+  EXPECT_EQ(decoded.input_offset, 7u);
+  EXPECT_EQ(decoded.output_offset, snapshot.output_offset);
+
+  EXPECT_THROW(bfsnapshot::decode(bytes.substr(0, bytes.size() - 1)), std::runtime_error);
+  EXPECT_THROW(bfsnapshot::decode(bytes + "x"), std::runtime_error);
+  EXPECT_THROW(bfsnapshot::decode("CCBFBC"), std::runtime_error);
+}
+
+TEST(Snapshot, StoresOnlyTheDirtyTapeRange) {
+  auto const bytecodes = compile(std::string_view{">>>>>>>>>>+++>>+<"}, 2);
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM vm{in, out};
+  vm.run(bytecodes);
+  auto const snapshot = vm.snapshot();
+  EXPECT_EQ(snapshot.state.base, 10u);
+  EXPECT_EQ(snapshot.state.cells, (std::vector<std::uint32_t>{3, 0, 1}));
+  EXPECT_LT(bfsnapshot::encode(snapshot).size(), bfsnapshot::header_size + 16);
+}
+
+TEST(Snapshot, RestoredRunsProduceTheSameOutput) {
+  std::string input;
+  for (int i = 0; i < 300; ++i) {
+    input += static_cast<char>('a' + i % 26);
+  }
+  struct case_t {
+    std::vector<inst_t> bytecodes;
+    std::string input;
+  };
+  std::vector<case_t> cases{{compile(shift, 2), input}, {compile(read_corpus("fib.bf"), 4), ""}};
+  bfsuper::fuse(cases.back().bytecodes);
+
+  for (auto const& [bytecodes, input] : cases) {
+    auto const expected = run(bytecodes, input, dispatch_t::switch_loop);
+    for (auto const dispatch : dispatches) {
+      for (auto const every : {1u, 7u, 100u, 4099u}) {
+        std::istringstream in{input};
+        std::ostringstream out;
+        BrainFckVM vm{in, out, dispatch};
+        bfsnapshot::Interval interval{every};
+        vm.run(bytecodes, interval);
+        for (int pauses = 0; vm.pc() < bytecodes.size() and pauses < 50; ++pauses) {
+          // each restore starts from fresh streams, holding only what the original had not yet printed
+          auto const snapshot = bfsnapshot::decode(bfsnapshot::encode(vm.snapshot()));
+          std::istringstream restored_in{input};
+          std::ostringstream restored_out;
+          BrainFckVM restored{restored_in, restored_out, dispatch};
+          restored.restore(snapshot);
+          restored.resume(bytecodes);
+          EXPECT_EQ(out.str() + restored_out.str(), expected) << "every " << every << " pause " << pauses;
+          vm.resume(bytecodes, interval);
+        }
+      }
+    }
+  }
+}
+
+TEST(Snapshot, ForksRunsFromAWarmedUpState) {
+  // a 10000-step countdown before the program reads its first byte
+  auto const bytecodes = compile(std::string_view{"++++++++++[>++++++++++[>++++++++++[-]<-]<-]>>,[+.,]"}, 2);
+  auto const warm = [&] {
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out};
+    struct until_input_t {
+      std::vector<inst_t> const& program;
+      bool count(std::size_t pc) const { return program[pc].opcode != inst_t::op_code_t::in; }
+    } policy{bytecodes};
+    vm.run(bytecodes, policy);
+    return vm.snapshot();
+  }();
+  EXPECT_EQ(bytecodes[warm.state.pc].opcode, inst_t::op_code_t::in);
+
+  for (auto const input : {"abc", "HAL", "", "xyzzy"}) {
+    std::istringstream in{input};
+    std::ostringstream out;
+    BrainFckVM fork{in, out, dispatch_t::threaded};
+    fork.restore(warm);
+    fork.resume(bytecodes);
+    EXPECT_EQ(out.str(), run(bytecodes, input, dispatch_t::threaded)) << input;
+  }
+
+  std::istringstream in;
+  std::ostringstream out;
+  BasicBrainFckVM<std::uint16_t> wide{in, out};
+  EXPECT_THROW(wide.restore(warm), std::runtime_error);
+}
+
+TEST(Snapshot, CheckpointerWritesInTheBackground) {
+  auto bytecodes = compile(read_corpus("fib.bf"), 4);
+  auto const expected = run(bytecodes, "", dispatch_t::threaded);
+  auto const path = std::filesystem::temp_directory_path() / ("ccbf_snapshot_" + std::to_string(::getpid()));
+
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM vm{in, out, dispatch_t::threaded};
+  {
+    bfsnapshot::Checkpointer checkpointer{path, bfsnapshot::program_hash(bytecodes)};
+    bfsnapshot::Interval interval{10000};
+    vm.run(bytecodes, interval);
+    ASSERT_LT(vm.pc(), bytecodes.size());
+    checkpointer.submit(vm.snapshot());
+    checkpointer.wait();
+    EXPECT_EQ(checkpointer.written(), 1u);
+  }
+  auto const printed = out.str().size();
+
+  auto const snapshot = bfsnapshot::read_file(path, bytecodes);
+  EXPECT_EQ(snapshot.output_offset, printed);
+  std::istringstream restored_in;
+  std::ostringstream restored_out;
+  BrainFckVM restored{restored_in, restored_out};
+  restored.restore(snapshot);
+  restored.resume(bytecodes);
+  EXPECT_EQ(expected.substr(0, printed) + restored_out.str(), expected);
+
+  bfsuper::fuse(bytecodes);  // superinstructions keep the program hash
+  EXPECT_NO_THROW(bfsnapshot::read_file(path, bytecodes));
+  bytecodes.pop_back();
+  EXPECT_THROW(bfsnapshot::read_file(path, bytecodes), std::runtime_error);
+  std::filesystem::remove(path);
+
+  bfsnapshot::Checkpointer failing{path / "missing" / "dir", 0};
+  failing.submit(snapshot);
+  EXPECT_THROW(failing.wait(), std::runtime_error);
+}
@@ -0,0 +1,47 @@
+#include "bfsource.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace {
+
+std::filesystem::path write_temp(std::string const& name, std::string const& contents) {
+  auto const path = std::filesystem::temp_directory_path() / name;
+  std::ofstream{path, std::ios::binary} << contents;
+  return path;
+}
+
+} // namespace
+
+TEST(MappedFile, MapsRegularFiles) {
+  auto const path = write_temp("ccbf_mapped_file.bf", "++[>+<-]");
+  {
+    MappedFile const file{path.string()};
+    EXPECT_TRUE(file.is_mapped());
+    EXPECT_EQ(file.view(), "++[>+<-]");
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFile, EmptyFileGivesEmptyView) {
+  auto const path = write_temp("ccbf_empty_file.bf", "");
+  {
+    MappedFile const file{path.string()};
+    EXPECT_TRUE(file.view().empty());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFile, ThrowsOnMissingFile) {
+  EXPECT_THROW(MappedFile{"/nonexistent/ccbf/program.bf"}, std::runtime_error);
+}
+
+TEST(MappedFile, ThrowsOnReadError) {
+  // a directory opens read-only but fails to read (EISDIR), which must not pass for an empty file
+  EXPECT_THROW(MappedFile{std::filesystem::temp_directory_path().string()}, std::system_error);
+}
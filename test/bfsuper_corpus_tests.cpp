@@ -0,0 +1,32 @@
+#include "bfcompiler.hpp"
+#include "bfprofile.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+// Profiles every corpus program, mandelbrot.bf included (about 1.8 G counted dispatches), so it is built
+// into ccbf_slow_tests and labelled slow: ctest -LE slow skips it.
+TEST(SuperinstructionsCorpus, TableIsSelectedFromCorpus) {
+  bfsuper::Ngrams ngrams;
+  for (auto const name : {"helloworld.bf", "bench.bf", "hanoi.bf", "fib.bf", "mandelbrot.bf"}) {
+    auto const source = read_corpus(name);
+    auto const bytecodes = compile(source, 4);
+    bfprofile::Counter counter{bytecodes.size()};
+    std::istringstream in;
+    std::ostringstream out;
+    BrainFckVM vm{in, out, BrainFckVM::dispatch_t::threaded};
+    vm.run(bytecodes, counter);
+    ngrams.add(bytecodes, counter.counts());
+  }
+  auto const selected = ngrams.select(bfsuper::count);
+  ASSERT_EQ(selected.size(), bfsuper::count);
+  for (std::size_t k = 0; k < bfsuper::count; ++k) {
+    EXPECT_TRUE(std::ranges::equal(selected[k], bfsuper::patterns[k])) << "superinstruction " << k;
+  }
+}
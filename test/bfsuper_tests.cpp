@@ -0,0 +1,158 @@
+#include "bfcompiler.hpp"
+#include "bfjit.hpp"
+#include "bfsuper.hpp"
+#include "bfvm.hpp"
+#include "test_support.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using op = inst_t::op_code_t;
+
+std::string run(std::vector<inst_t> const& bytecodes, BrainFckVM::dispatch_t dispatch,
+                bfprofile::Counter* counter = nullptr) {
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM vm{in, out, dispatch};
+  if (counter != nullptr) {
+    vm.run(bytecodes, *counter);
+  } else {
+    vm.run(bytecodes);
+  }
+  return out.str();
+}
+
+} // namespace
+
+TEST(Superinstructions, FuseRewritesOnlyTheFirstOpcode) {
+  auto const plain = compile(read_corpus("fib.bf"), 4);
+  auto fused = plain;
+  auto const count = bfsuper::fuse(fused);
+  EXPECT_GT(count, 0u);
+  ASSERT_EQ(fused.size(), plain.size());
+  std::size_t heads = 0;
+  for (std::size_t i = 0; i < fused.size(); ++i) {
+    EXPECT_EQ(fused[i].operand, plain[i].operand);
+    EXPECT_EQ(fused[i].offset, plain[i].offset);
+    if (bfsuper::is_super(fused[i].opcode)) {
+      ++heads;
+      auto const pattern = bfsuper::patterns[bfsuper::index(fused[i].opcode)];
+      for (std::size_t j = 0; j < pattern.size(); ++j) {
+        EXPECT_EQ(plain[i + j].opcode, pattern[j]) << "at " << i + j;
+      }
+    } else {
+      EXPECT_EQ(fused[i].opcode, plain[i].opcode);
+    }
+  }
+  EXPECT_EQ(heads, count);
+
+  bfsuper::unfuse(fused);
+  for (std::size_t i = 0; i < fused.size(); ++i) {
+    EXPECT_EQ(fused[i].opcode, plain[i].opcode);
+  }
+}
+
+TEST(Superinstructions, FusedProgramsRunLikePlainOnes) {
+  for (auto const name : {"helloworld.bf", "bench.bf", "fib.bf", "hanoi.bf"}) {
+    auto const plain = compile(read_corpus(name), 4);
+    auto fused = plain;
+    bfsuper::fuse(fused);
+    for (auto const dispatch : {BrainFckVM::dispatch_t::switch_loop, BrainFckVM::dispatch_t::threaded}) {
+      bfprofile::Counter plain_dispatches{plain.size()};
+      bfprofile::Counter fused_dispatches{fused.size()};
+      EXPECT_EQ(run(fused, dispatch, &fused_dispatches), run(plain, dispatch, &plain_dispatches)) << name;
+      EXPECT_LT(fused_dispatches.total(), plain_dispatches.total()) << name;
+    }
+  }
+}
+
+TEST(Superinstructions, ResumesInsideSequences) {
+  auto bytecodes = compile(read_corpus("fib.bf"), 4);
+  auto const expected = run(bytecodes, BrainFckVM::dispatch_t::switch_loop);
+  bfsuper::fuse(bytecodes);
+  // plain and fused precomputations stop at different instructions; either state resumes on fused code
+  for (auto const budget : {3u, 40u, 1001u, 250000u}) {
+    auto const initial = precompute(bytecodes, budget);
+    for (auto const dispatch : {BrainFckVM::dispatch_t::switch_loop, BrainFckVM::dispatch_t::threaded}) {
+      std::istringstream in;
+      std::ostringstream out;
+      BrainFckVM vm{in, out, dispatch};
+      vm.set_initial_state(initial);
+      vm.run(bytecodes);
+      EXPECT_EQ(out.str(), expected) << "budget " << budget;
+    }
+  }
+}
+
+TEST(Superinstructions, NgramsWeighSequencesByExecutions) {
+  // add 2, jmpz, add -1, mpadd 1, add 1, mpadd -1, jmpnz
+  auto const bytecodes = compile(std::string_view{"++[->+<]"}, 1);
+  std::vector<std::uint64_t> const counts{1, 1, 2, 2, 2, 2, 2};
+  bfsuper::Ngrams ngrams{3};
+  ngrams.add(bytecodes, counts);
+  auto const all = ngrams.top(100);
+  auto const count_of = [&](std::vector<op> const& ops) -> std::uint64_t {
+    auto const it = std::ranges::find(all, ops, &bfsuper::ngram_t::ops);
+    return it == all.end() ? 0 : it->count;
+  };
+  EXPECT_EQ(count_of({op::add, op::mpadd}), 4u);
+  EXPECT_EQ(count_of({op::add, op::jmpz}), 1u);
+  EXPECT_EQ(count_of({op::add, op::mpadd, op::jmpnz}), 2u);
+  EXPECT_EQ(count_of({op::jmpz, op::add}), 0u);  // jumps only end a sequence
+  EXPECT_EQ(count_of({op::add, op::mpadd, op::add, op::mpadd}), 0u);  // longer than 3
+  for (std::size_t i = 1; i < all.size(); ++i) {
+    EXPECT_GE(all[i - 1].count * (all[i - 1].ops.size() - 1), all[i].count * (all[i].ops.size() - 1));
+  }
+}
+
+TEST(Superinstructions, SelectsFusableSequencesFromProfiles) {
+  // the small corpus programs; the shipped table comes from the whole corpus (ccbf_slow_tests)
+  bfsuper::Ngrams ngrams;
+  for (auto const name : {"helloworld.bf", "bench.bf", "fib.bf"}) {
+    auto const bytecodes = compile(read_corpus(name), 4);
+    bfprofile::Counter counter{bytecodes.size()};
+    run(bytecodes, BrainFckVM::dispatch_t::threaded, &counter);
+    ngrams.add(bytecodes, counter.counts());
+  }
+  auto const selected = ngrams.select(bfsuper::count);
+  ASSERT_EQ(selected.size(), bfsuper::count);
+  for (std::size_t k = 0; k < selected.size(); ++k) {
+    auto const& ops = selected[k];
+    EXPECT_GE(ops.size(), 2u) << "superinstruction " << k;
+    EXPECT_LE(ops.size(), 5u) << "superinstruction " << k;
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+      EXPECT_TRUE(bfsuper::fusable(ops[i], i, ops.size())) << "superinstruction " << k << " at " << i;
+    }
+    if (k > 0) {
+      EXPECT_GE(selected[k - 1].size(), ops.size()) << "longest first";
+    }
+    EXPECT_EQ(std::ranges::count(selected, ops), 1) << "superinstruction " << k;
+  }
+}
+
+TEST(Superinstructions, PlainEnginesRunFusedBytecode) {
+  auto bytecodes = compile(read_corpus("fib.bf"), 4);
+  auto const expected = run(bytecodes, BrainFckVM::dispatch_t::switch_loop);
+  bfsuper::fuse(bytecodes);
+
+  std::ostringstream listing;
+  bfcompiler_internal::print_bytecodes(bytecodes, listing);
+  EXPECT_NE(listing.str().find("(super "), std::string::npos);
+  EXPECT_EQ(listing.str().find("super "), listing.str().find("(super ") + 1);
+
+  if (!BrainFckJIT::supported()) {
+    GTEST_SKIP() << "JIT backend not supported on this host";
+  }
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckJIT jit{in, out};
+  jit.run(bytecodes);
+  EXPECT_EQ(out.str(), expected);
+}
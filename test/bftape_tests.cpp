@@ -0,0 +1,122 @@
+#include "bfcompiler.hpp"
+#include "bfscan.hpp"
+#include "bftape.hpp"
+#include "bfvm.hpp"
+#include "ccbf.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+std::string run_vm(std::string_view program, bftape::options_t tape, BrainFckVM::dispatch_t dispatch,
+                   std::size_t optims = 4) {
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM vm{in, out, dispatch, tape};
+  vm.run(compile(program, optims));
+  return out.str();
+}
+
+class TapePolicyTest : public ::testing::TestWithParam<BrainFckVM::dispatch_t> {};
+
+} // namespace
+
+TEST(Tape, WrapMatchesModulo) {
+  bftape::Tape tape{{.size = 100}};
+  EXPECT_EQ(tape.move(0, -1), 99u);
+  EXPECT_EQ(tape.move(99, 1), 0u);
+  EXPECT_EQ(tape.move(10, -250), 60u);
+  EXPECT_EQ(tape.move(90, 1234), 24u);
+  EXPECT_EQ(tape.move(50, 25), 75u);
+}
+
+TEST(Tape, ErrorPolicyThrowsAtEitherEnd) {
+  bftape::Tape tape{{.size = 100, .policy = bftape::policy_t::error}};
+  EXPECT_EQ(tape.move(99, 0), 99u);
+  EXPECT_THROW(tape.move(0, -1), std::runtime_error);
+  EXPECT_THROW(tape.move(99, 1), std::runtime_error);
+}
+
+TEST(Tape, GrowPolicyExtendsToTheRight) {
+  bftape::Tape tape{{.size = 16, .policy = bftape::policy_t::grow, .max_size = 1 << 20}};
+  auto* const base = tape.data();
+  auto const far = tape.move(0, 100000);
+  EXPECT_EQ(far, 100000u);
+  EXPECT_GT(tape.size(), far);
+  EXPECT_EQ(tape.data(), base);
+  EXPECT_EQ(tape.data()[far], 0);
+  tape.data()[far] = 7;
+
+  EXPECT_THROW(tape.move(0, -1), std::runtime_error);
+  EXPECT_THROW(tape.move(0, 1 << 20), std::runtime_error);
+
+  tape.clear();
+  EXPECT_EQ(tape.size(), 16u);
+  EXPECT_EQ(tape.move(0, 100000), 100000u);
+  EXPECT_EQ(tape.data()[100000], 0);
+}
+
+TEST(Tape, ScanStopsAtTheEdgeUnlessWrapping) {
+  bftape::Tape wrap{{.size = 64}};
+  bftape::Tape error{{.size = 64, .policy = bftape::policy_t::error}};
+  bftape::Tape grow{{.size = 64, .policy = bftape::policy_t::grow, .max_size = 1 << 16}};
+  for (auto* tape : {&wrap, &error, &grow}) {
+    for (std::size_t i = 1; i < 64; ++i) {
+      tape->data()[i] = 1;
+    }
+  }
+  EXPECT_EQ(wrap.scan(1, 1), 0u);
+  EXPECT_THROW(error.scan(1, 1), std::runtime_error);
+  EXPECT_EQ(grow.scan(1, 1), 64u);
+  EXPECT_EQ(grow.scan(3, 5), 68u);
+  EXPECT_THROW(grow.scan(63, -2), std::runtime_error);
+}
+
+TEST(Tape, ParsesCommandLineOptions) {
+  bftape::options_t options;
+  EXPECT_TRUE(bftape::parse_option("--tape=grow", options));
+  EXPECT_TRUE(bftape::parse_option("--tape-size=65536", options));
+  EXPECT_FALSE(bftape::parse_option("--engine=jit", options));
+  EXPECT_EQ(options.policy, bftape::policy_t::grow);
+  EXPECT_EQ(options.size, 65536u);
+  EXPECT_THROW(bftape::parse_option("--tape=sideways", options), std::runtime_error);
+  EXPECT_THROW(bftape::parse_option("--tape-size=12k", options), std::runtime_error);
+  EXPECT_THROW(bftape::parse_option("--tape-size=0", options), std::runtime_error);
+}
+
+TEST_P(TapePolicyTest, SmallWrappingTapeRevisitsCells) {
+  EXPECT_EQ(run_vm("+++>>>>[-]<<<<.", {.size = 4}, GetParam()), std::string(1, '\0'));
+}
+
+TEST_P(TapePolicyTest, ErrorPolicyRejectsMovesOffTheTape) {
+  EXPECT_THROW(run_vm("+<.", {.policy = bftape::policy_t::error}, GetParam()), std::runtime_error);
+  EXPECT_THROW(run_vm("+[>+]", {.size = 128, .policy = bftape::policy_t::error}, GetParam()), std::runtime_error);
+}
+
+TEST_P(TapePolicyTest, GrowPolicyRunsPastTheInitialSize) {
+  // Lay 200 nonzero cells on a 16-cell tape, then scan back to the start and print the length.
+  std::string const program = "++++++++++[->++++++++++++++++++++<]>[[->+<]+>-]<[<]>[-<+>]<.";
+  bftape::options_t const tape{.size = 16, .policy = bftape::policy_t::grow, .max_size = 1 << 16};
+  for (std::size_t optims = 0; optims <= 4; ++optims) {
+    EXPECT_EQ(run_vm(program, tape, GetParam(), optims), run_vm(program, {}, GetParam(), optims)) << optims;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Dispatch, TapePolicyTest,
+                         ::testing::Values(BrainFckVM::dispatch_t::switch_loop, BrainFckVM::dispatch_t::threaded));
+
+TEST(BFMachineTape, HonoursTapeOptions) {
+  std::istringstream in;
+  std::ostringstream out;
+  BFMachine small{in, out, {.size = 2}};
+  small.run(std::string{"+>>+."});
+  EXPECT_EQ(out.str(), "\x02");
+
+  BFMachine strict{in, out, {.policy = bftape::policy_t::error}};
+  EXPECT_THROW(strict.run(std::string{"<"}), std::runtime_error);
+}
@@ -1,9 +1,11 @@
 #include "bfcompiler.hpp"
 #include "bfvm.hpp"
+#include "test_support.hpp"
 
 #include <gtest/gtest.h>
 
-#include <iterator>
+#include <algorithm>
+#include <cstdint>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -11,16 +13,21 @@
 
 namespace {
 
-std::string run_vm(std::string_view program, std::string_view input = {}) {
+std::string run_vm(std::string_view program, std::string_view input = {},
+                   BrainFckVM::dispatch_t dispatch = BrainFckVM::dispatch_t::switch_loop, size_t optims = 2) {
   std::istringstream in{std::string{input}};
   std::ostringstream out;
 
-  auto bytecode = compile(program);
-  BrainFckVM vm{in, out};
+  auto bytecode = compile(program, optims);
+  BrainFckVM vm{in, out, dispatch};
   vm.run(bytecode);
   return out.str();
 }
 
+std::string run_threaded(std::string_view program, std::string_view input = {}, size_t optims = 2) {
+  return run_vm(program, input, BrainFckVM::dispatch_t::threaded, optims);
+}
+
 } // namespace
 
 TEST(BrainFckVM, EmitsIncrementedByte) {
@@ -66,3 +73,273 @@ TEST(BrainFckVM, WrapsLeftFromTapeOrigin) {
   ASSERT_EQ(output.size(), 1u);
   EXPECT_EQ(output[0], static_cast<char>(1));
 }
+
+TEST(BrainFckVM, ThreadedEchoesInputAndHandlesEOF) {
+  auto const output = run_threaded(",.,.", "Z");
+  std::string const expected{'Z', static_cast<char>(0)};
+  EXPECT_EQ(output, expected);
+}
+
+TEST(BrainFckVM, ThreadedExecutesNestedLoops) {
+  auto const output = run_threaded("++[>+++[>++<-]<-]>>.");
+  ASSERT_EQ(output.size(), 1u);
+  EXPECT_EQ(output[0], static_cast<char>(12));
+}
+
+TEST(BrainFckVM, ThreadedWrapsLeftFromTapeOrigin) {
+  auto const output = run_threaded("<+.");
+  ASSERT_EQ(output.size(), 1u);
+  EXPECT_EQ(output[0], static_cast<char>(1));
+}
+
+TEST(BrainFckVM, ThreadedMatchesSwitchOnHelloWorld) {
+  auto const program = read_corpus("helloworld.bf");
+  ASSERT_FALSE(program.empty());
+  for (size_t optims = 0; optims <= 2; ++optims) {
+    EXPECT_EQ(run_threaded(program, {}, optims), run_vm(program, {}, BrainFckVM::dispatch_t::switch_loop, optims))
+        << "optimization level " << optims;
+  }
+}
+
+TEST(BrainFckVM, OptimizedLevelsMatchOpt0) {
+  std::string_view const programs[] = {
+      "+++++[->+++>++<<]>.>.",         // 5*3, 5*2
+      "++++++++[>++++++++<-]>[-<+>>+<]<.>>.",  // copy 64 into two cells
+      "-[->+<]>.",                     // 255 iterations with 8-bit wrap
+      "<+++[-<++>>+<]<.>>.",           // negative offsets across the tape origin
+      "++[>+++[->++<]<-]>>.",          // multiply loop nested in a regular loop
+      ">+>++<<-.>.>.",                 // offsets within a block
+      "<<+<+>>>,<.>>.<<<<.",           // offsets across the tape origin, input at an offset
+      "+>+>+>+>>+<<<<<[>]>.<<[<]>.",   // scans in both directions
+      ">+>>+>>+<<<<<[>>]+.<<[<<]<.",   // strided scans wrapping across the tape origin
+  };
+  for (auto const program : programs) {
+    auto const expected = run_vm(program, "x", BrainFckVM::dispatch_t::switch_loop, 0);
+    for (size_t optims = 1; optims <= 5; ++optims) {
+      EXPECT_EQ(run_vm(program, "x", BrainFckVM::dispatch_t::switch_loop, optims), expected)
+          << program << " at optimization level " << optims;
+      EXPECT_EQ(run_threaded(program, "x", optims), expected) << program << " at optimization level " << optims;
+    }
+  }
+}
+
+TEST(BrainFckVM, OptimizedLevelsMatchOpt0OnHelloWorld) {
+  auto const program = read_corpus("helloworld.bf");
+  auto const expected = run_vm(program, {}, BrainFckVM::dispatch_t::switch_loop, 0);
+  for (size_t optims = 3; optims <= 4; ++optims) {
+    EXPECT_EQ(run_vm(program, {}, BrainFckVM::dispatch_t::switch_loop, optims), expected);
+    EXPECT_EQ(run_threaded(program, {}, optims), expected);
+  }
+}
+
+TEST(BrainFckVM, StartsFromFoldedPrefix) {
+  for (auto const& program :
+       {read_corpus("helloworld.bf"), read_corpus("bench.bf"), std::string{"++++++++[>++++++++<-]>+.<,."}}) {
+    auto const expected = run_vm(program, "x", BrainFckVM::dispatch_t::switch_loop, 4);
+    auto bytecodes = compile(program, 5);
+    auto initial = fold_prefix(bytecodes);
+    for (auto const dispatch : {BrainFckVM::dispatch_t::switch_loop, BrainFckVM::dispatch_t::threaded}) {
+      std::istringstream in{"x"};
+      std::ostringstream out;
+      BrainFckVM vm{in, out, dispatch};
+      vm.set_initial_state(initial);
+      vm.run(bytecodes);
+      EXPECT_EQ(out.str(), expected);
+      // every run starts from the state again
+      in.clear();
+      in.str("x");
+      out.str({});
+      vm.run(bytecodes);
+      EXPECT_EQ(out.str(), expected);
+    }
+  }
+
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM small{in, out, BrainFckVM::dispatch_t::switch_loop, {.size = 4}};
+  EXPECT_THROW(small.set_initial_state({.cells = {1, 2, 3, 4, 5}}), std::runtime_error);
+  EXPECT_THROW(small.set_initial_state({.cells = {}, .pointer = 4}), std::runtime_error);
+}
+
+TEST(BrainFckVM, ResumesFromPrecomputedState) {
+  for (auto const& program :
+       {read_corpus("helloworld.bf"), read_corpus("bench.bf"), std::string{"++++++++[>++++++++<-]>+.<,.[.-]"}}) {
+    auto const expected = run_vm(program, "x", BrainFckVM::dispatch_t::switch_loop, 4);
+    auto const bytecodes = compile(program, 4);
+    // the budget can run out anywhere, inside loops too
+    for (auto const budget : {0u, 1u, 5u, 37u, 1000u, 100000000u}) {
+      auto const initial = precompute(bytecodes, budget);
+      EXPECT_LE(initial.pc, bytecodes.size());
+      for (auto const dispatch : {BrainFckVM::dispatch_t::switch_loop, BrainFckVM::dispatch_t::threaded}) {
+        std::istringstream in{"x"};
+        std::ostringstream out;
+        BrainFckVM vm{in, out, dispatch};
+        vm.set_initial_state(initial);
+        vm.run(bytecodes);
+        EXPECT_EQ(out.str(), expected) << "budget " << budget;
+        EXPECT_EQ(vm.pc(), bytecodes.size());
+      }
+    }
+  }
+
+  auto const hello = compile(read_corpus("helloworld.bf"), 4);
+  auto const finished = precompute(hello, 100000000);
+  EXPECT_EQ(finished.pc, hello.size());
+  EXPECT_EQ(finished.output, run_vm(read_corpus("helloworld.bf"), {}, BrainFckVM::dispatch_t::switch_loop, 4));
+
+  auto const echo = compile("+++.,.", 4);
+  auto const before_input = precompute(echo, 100);
+  EXPECT_EQ(before_input.output, "\x03");
+  EXPECT_EQ(echo[before_input.pc].opcode, inst_t::op_code_t::in);
+}
+
+TEST(BrainFckVM, PrecomputedStateOnlyFitsItsTape) {
+  auto const bytecodes = compile("+>+.", 4);
+  auto const initial = precompute(bytecodes, 100, {.size = 8});
+  std::istringstream in;
+  std::ostringstream out;
+  BrainFckVM same{in, out, BrainFckVM::dispatch_t::switch_loop, {.size = 8}};
+  EXPECT_NO_THROW(same.set_initial_state(initial));
+  BrainFckVM larger{in, out, BrainFckVM::dispatch_t::switch_loop, {.size = 9}};
+  EXPECT_THROW(larger.set_initial_state(initial), std::runtime_error);
+  BrainFckVM erroring{in, out, BrainFckVM::dispatch_t::switch_loop, {.size = 8, .policy = bftape::policy_t::error}};
+  EXPECT_THROW(erroring.set_initial_state(initial), std::runtime_error);
+  BasicBrainFckVM<std::uint16_t> wider{in, out, BrainFckVMBase::dispatch_t::switch_loop, {.size = 8}};
+  EXPECT_THROW(wider.set_initial_state(initial), std::runtime_error);
+
+  // a grown tape is grown again before the run resumes
+  auto const grow = bftape::options_t{.size = 4, .policy = bftape::policy_t::grow};
+  auto const grown = precompute(compile(">>>>>>>>>>+.<<,.", 4), 1000, grow);
+  EXPECT_EQ(grown.base + grown.cells.size(), 11u);
+  BrainFckVM resumed{in, out, BrainFckVM::dispatch_t::threaded, grow};
+  resumed.set_initial_state(grown);
+  resumed.run(compile(">>>>>>>>>>+.<<,.", 4));
+  EXPECT_EQ(out.str(), std::string("\x01\x00", 2));
+}
+
+TEST(BrainFckVM, RunsBenchmarkCorpus) {
+  EXPECT_EQ(run_threaded(read_corpus("bench.bf"), {}, 4), "ZYXWVUTSRQPONMLKJIHGFEDCBA\n");
+
+  // 2^20 - 1 moves; with an even number of disks the smallest one starts towards B.
+  auto const hanoi = run_threaded(read_corpus("hanoi.bf"), {}, 4);
+  EXPECT_EQ(std::count(hanoi.begin(), hanoi.end(), '\n'), (1 << 20) - 1);
+  EXPECT_TRUE(hanoi.starts_with("aAB\nbAC\naBC\n"));
+  EXPECT_TRUE(hanoi.ends_with("aAB\nbAC\naBC\n"));
+
+  auto const fib = run_threaded(read_corpus("fib.bf"), {}, 4);
+  EXPECT_EQ(std::count(fib.begin(), fib.end(), '\n'), 3000);
+  EXPECT_TRUE(fib.starts_with("1\n2\n3\n5\n8\n13\n"));
+  EXPECT_TRUE(fib.ends_with("9144173304364898001\n"));  // F(3001), 627 digits
+}
+
+namespace {
+
+// Prints 1 when 16^levels is nonzero in the cell width, i.e. the value has not wrapped to 0.
+std::string power_of_16_survives(int levels) {
+  std::string const sixteen(16, '+');
+  std::string program = sixteen;
+  for (int i = 1; i < levels; ++i) {
+    program += "[>" + sixteen + "<-]>";
+  }
+  program += "[[-]" + std::string(static_cast<std::size_t>(levels - 1), '<') + "+" +
+             std::string(static_cast<std::size_t>(levels - 1), '>') + "]" +
+             std::string(static_cast<std::size_t>(levels - 1), '<') + ".";
+  return program;
+}
+
+template <typename Cell>
+std::string run_width(std::string_view program, BrainFckVMBase::dispatch_t dispatch, size_t optims) {
+  std::istringstream in;
+  std::ostringstream out;
+  BasicBrainFckVM<Cell> vm{in, out, dispatch};
+  vm.run(compile(program, optims));
+  return out.str();
+}
+
+template <typename Cell>
+class CellWidthTest : public ::testing::Test {};
+
+using CellTypes = ::testing::Types<std::uint8_t, std::uint16_t, std::uint32_t>;
+TYPED_TEST_SUITE(CellWidthTest, CellTypes);
+
+} // namespace
+
+TYPED_TEST(CellWidthTest, FoldedPrefixWrapsAtTheCellWidth) {
+  constexpr auto bits = 8 * sizeof(TypeParam);
+  for (auto const levels : {2, 4}) {
+    auto bytecodes = compile(power_of_16_survives(levels), 5);
+    auto const initial = fold_prefix(bytecodes);
+    EXPECT_FALSE(initial.empty());
+    std::istringstream in;
+    std::ostringstream out;
+    BasicBrainFckVM<TypeParam> vm{in, out, BrainFckVMBase::dispatch_t::threaded};
+    vm.set_initial_state(initial);
+    vm.run(bytecodes);
+    EXPECT_EQ(out.str(), std::string(1, bits > 4u * static_cast<unsigned>(levels) ? 1 : 0)) << "16^" << levels;
+  }
+}
+
+TYPED_TEST(CellWidthTest, FoldedScanStopsAtTheCellWidth) {
+  auto const run = [](std::vector<inst_t> const& bytecodes, bftape::initial_t const& initial) {
+    std::istringstream in;
+    std::ostringstream out;
+    BasicBrainFckVM<TypeParam> vm{in, out, BrainFckVMBase::dispatch_t::threaded};
+    vm.set_initial_state(initial);
+    vm.run(bytecodes);
+    return out.str();
+  };
+  // cell 1 holds 256 (and then 65536): narrower cells stop the [>] on it, wider ones walk on to cell 2
+  for (std::size_t const factor : {16, 4096}) {
+    std::string const program = std::string(16, '+') + "[->" + std::string(factor, '+') + "<]+[>]<.";
+    auto const expected = run(compile(program, 4), {});
+    EXPECT_EQ(expected, std::string(1, 16 * factor % (std::size_t{1} << (8 * sizeof(TypeParam))) == 0 ? 1 : 0));
+    auto bytecodes = compile(program, 5);
+    auto const initial = fold_prefix(bytecodes);
+    EXPECT_EQ(run(bytecodes, initial), expected) << "x" << factor;
+  }
+}
+
+TYPED_TEST(CellWidthTest, PrecomputedStateKeepsTheCellWidth) {
+  constexpr auto bits = 8 * sizeof(TypeParam);
+  auto const bytecodes = compile(power_of_16_survives(2) + ",.", 4);
+  auto const initial = precompute<TypeParam>(bytecodes, 1000, bftape::for_cell<TypeParam>({}));
+  EXPECT_EQ(initial.cell_bits, bits);
+  EXPECT_EQ(initial.output, std::string(1, bits > 8 ? 1 : 0));
+  std::istringstream in{"y"};
+  std::ostringstream out;
+  BasicBrainFckVM<TypeParam> vm{in, out, BrainFckVMBase::dispatch_t::threaded};
+  vm.set_initial_state(initial);
+  vm.run(bytecodes);
+  EXPECT_EQ(out.str(), initial.output + "y");
+}
+
+TYPED_TEST(CellWidthTest, ArithmeticWrapsAtTheCellWidth) {
+  constexpr auto bits = 8 * sizeof(TypeParam);
+  for (auto const dispatch : {BrainFckVMBase::dispatch_t::switch_loop, BrainFckVMBase::dispatch_t::threaded}) {
+    for (size_t optims = 0; optims <= 5; ++optims) {
+      EXPECT_EQ(run_width<TypeParam>(power_of_16_survives(2), dispatch, optims), std::string(1, bits > 8 ? 1 : 0))
+          << "level " << optims;
+      EXPECT_EQ(run_width<TypeParam>(power_of_16_survives(4), dispatch, optims), std::string(1, bits > 16 ? 1 : 0))
+          << "level " << optims;
+      // Decrementing zero yields the maximum value; output keeps its low byte.
+      EXPECT_EQ(run_width<TypeParam>("-.", dispatch, optims), "\xff");
+    }
+  }
+}
+
+TYPED_TEST(CellWidthTest, OptimizedLevelsMatchOpt0) {
+  std::string_view const programs[] = {
+      "++++++++[>++++++++<-]>[>++++<-]>[-<++>>+<]<.>>.",  // 512 and 256 in 16/32-bit cells
+      "++++++++[->++++++++<]>[->++++++++<]<.",  // 512 folded back into cell 0
+      "++++++++++++++++[>++++++++++++++++>++++++++++++++++>++++++++++++++++<<<-]>[>]++++[<]>+.",  // scans over 256s
+  };
+  for (auto const program : programs) {
+    auto const expected = run_width<TypeParam>(program, BrainFckVMBase::dispatch_t::switch_loop, 0);
+    for (size_t optims = 1; optims <= 4; ++optims) {
+      EXPECT_EQ(run_width<TypeParam>(program, BrainFckVMBase::dispatch_t::switch_loop, optims), expected)
+          << program << " at optimization level " << optims;
+      EXPECT_EQ(run_width<TypeParam>(program, BrainFckVMBase::dispatch_t::threaded, optims), expected)
+          << program << " at optimization level " << optims;
+    }
+  }
+}
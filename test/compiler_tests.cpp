@@ -1,8 +1,9 @@
 #include "bfcompiler.hpp"
+#include "test_support.hpp"
 
 #include <gtest/gtest.h>
 
-#include <iterator>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -78,3 +79,301 @@ TEST(BFCompiler, OptimizesZeroingLoopToSet) {
   EXPECT_EQ(bytecode[0].opcode, inst_t::op_code_t::set);
   EXPECT_EQ(bytecode[0].operand, 0);
 }
+
+TEST(BFCompiler, Opt3RewritesMultiplyLoop) {
+  auto const bytecode = compile("[->+>++<<]", 3);
+  ASSERT_EQ(bytecode.size(), 3u);
+
+  EXPECT_EQ(bytecode[0].opcode, inst_t::op_code_t::mul);
+  EXPECT_EQ(bytecode[0].offset, 1);
+  EXPECT_EQ(bytecode[0].operand, 1);
+
+  EXPECT_EQ(bytecode[1].opcode, inst_t::op_code_t::mul);
+  EXPECT_EQ(bytecode[1].offset, 2);
+  EXPECT_EQ(bytecode[1].operand, 2);
+
+  EXPECT_EQ(bytecode[2].opcode, inst_t::op_code_t::set);
+  EXPECT_EQ(bytecode[2].operand, 0);
+}
+
+TEST(BFCompiler, Opt3HandlesNegativeOffsets) {
+  auto const bytecode = compile("[<<++>->-]", 3);
+  ASSERT_EQ(bytecode.size(), 3u);
+
+  EXPECT_EQ(bytecode[0].opcode, inst_t::op_code_t::mul);
+  EXPECT_EQ(bytecode[0].offset, -2);
+  EXPECT_EQ(bytecode[0].operand, 2);
+
+  EXPECT_EQ(bytecode[1].opcode, inst_t::op_code_t::mul);
+  EXPECT_EQ(bytecode[1].offset, -1);
+  EXPECT_EQ(bytecode[1].operand, -1);
+
+  EXPECT_EQ(bytecode[2].opcode, inst_t::op_code_t::set);
+}
+
+TEST(BFCompiler, Opt3KeepsUnbalancedAndIOLoops) {
+  EXPECT_EQ(compile("[->+]", 3).size(), compile("[->+]", 2).size());
+  EXPECT_EQ(compile("[->+<.]", 3).size(), compile("[->+<.]", 2).size());
+  EXPECT_EQ(compile("[-->+<]", 3).size(), compile("[-->+<]", 2).size());
+  EXPECT_EQ(compile("[>[->+<]<-]", 3).size(), 7u);
+}
+
+TEST(BFCompiler, Opt4FoldsPointerMovesIntoOffsets) {
+  auto const bytecode = compile(">+>++<<-", 4);
+  ASSERT_EQ(bytecode.size(), 3u);
+
+  EXPECT_EQ(bytecode[0].opcode, inst_t::op_code_t::add);
+  EXPECT_EQ(bytecode[0].offset, 1);
+  EXPECT_EQ(bytecode[0].operand, 1);
+
+  EXPECT_EQ(bytecode[1].opcode, inst_t::op_code_t::add);
+  EXPECT_EQ(bytecode[1].offset, 2);
+  EXPECT_EQ(bytecode[1].operand, 2);
+
+  EXPECT_EQ(bytecode[2].opcode, inst_t::op_code_t::add);
+  EXPECT_EQ(bytecode[2].offset, 0);
+  EXPECT_EQ(bytecode[2].operand, -1);
+}
+
+TEST(BFCompiler, Opt4FlushesPointerBeforeJumps) {
+  auto const bytecode = compile(">>+.[<-]", 4);
+  ASSERT_EQ(bytecode.size(), 7u);
+
+  EXPECT_EQ(bytecode[0].opcode, inst_t::op_code_t::add);
+  EXPECT_EQ(bytecode[0].offset, 2);
+
+  EXPECT_EQ(bytecode[1].opcode, inst_t::op_code_t::out);
+  EXPECT_EQ(bytecode[1].offset, 2);
+
+  EXPECT_EQ(bytecode[2].opcode, inst_t::op_code_t::mpadd);
+  EXPECT_EQ(bytecode[2].operand, 2);
+
+  EXPECT_EQ(bytecode[3].opcode, inst_t::op_code_t::jmpz);
+  EXPECT_EQ(bytecode[3].operand, 6);
+
+  EXPECT_EQ(bytecode[4].opcode, inst_t::op_code_t::add);
+  EXPECT_EQ(bytecode[4].offset, -1);
+  EXPECT_EQ(bytecode[4].operand, -1);
+
+  EXPECT_EQ(bytecode[5].opcode, inst_t::op_code_t::mpadd);
+  EXPECT_EQ(bytecode[5].operand, -1);
+
+  EXPECT_EQ(bytecode[6].opcode, inst_t::op_code_t::jmpnz);
+  EXPECT_EQ(bytecode[6].operand, 3);
+}
+
+TEST(BFCompiler, OptimizesPointerLoopsToScan) {
+  auto const right = compile_program("[>]");
+  ASSERT_EQ(right.size(), 1u);
+  EXPECT_EQ(right[0].opcode, inst_t::op_code_t::scan);
+  EXPECT_EQ(right[0].operand, 1);
+
+  auto const left = compile_program("[<<<<]");
+  ASSERT_EQ(left.size(), 1u);
+  EXPECT_EQ(left[0].opcode, inst_t::op_code_t::scan);
+  EXPECT_EQ(left[0].operand, -4);
+}
+
+TEST(BFCompiler, StreamingCompileMatchesWholeSourceCompile) {
+  std::string program;
+  for (int i = 0; i < 50; ++i) {
+    program += "++++[>+++<-]>[->>+<<]>>[<]<<.comment>>>---<<<,[>]";
+  }
+  for (size_t optims = 0; optims <= 4; ++optims) {
+    auto const expected = compile(program, optims);
+    for (std::size_t chunk_size : {1u, 7u, 64u, 4096u}) {
+      std::istringstream is{program};
+      auto const streamed = compile_stream(is, optims, chunk_size);
+      ASSERT_EQ(streamed.size(), expected.size()) << "optimization level " << optims << " chunk " << chunk_size;
+      for (std::size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(streamed[i].opcode, expected[i].opcode);
+        EXPECT_EQ(streamed[i].operand, expected[i].operand);
+        EXPECT_EQ(streamed[i].offset, expected[i].offset);
+      }
+    }
+  }
+}
+
+TEST(BFCompiler, CollapsingTranslationMatchesOpt1) {
+  std::string const program = ">>>+++--<<.[->+<]++++>>,<<";
+  std::vector<inst_t> raw;
+  bfcompiler_internal::translate(program, raw, false);
+  auto const expected = bfcompiler_internal::optimize_bytecodes_opt1(raw);
+
+  std::vector<inst_t> collapsed;
+  EXPECT_EQ(bfcompiler_internal::translate(program, collapsed, true), raw.size());
+  ASSERT_EQ(collapsed.size(), expected.size());
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(collapsed[i].opcode, expected[i].opcode);
+    EXPECT_EQ(collapsed[i].operand, expected[i].operand);
+  }
+}
+
+TEST(BFCompiler, CollapsingTranslationMatchesOpt1Spans) {
+  std::string const program = ">>>+++--<<.[->+<]++++>>,<<";
+  std::vector<inst_t> raw;
+  source_map_t raw_map;
+  bfcompiler_internal::translate(program, raw, false, 0, &raw_map);
+  ASSERT_EQ(raw_map.size(), raw.size());
+  auto const expected = bfcompiler_internal::optimize_bytecodes_opt1(raw, &raw_map);
+
+  std::vector<inst_t> collapsed;
+  source_map_t map;
+  bfcompiler_internal::translate(program, collapsed, true, 0, &map);
+  ASSERT_EQ(collapsed.size(), expected.size());
+  EXPECT_EQ(map.begin, raw_map.begin);
+  EXPECT_EQ(map.end, raw_map.end);
+  EXPECT_EQ(map.begin[1], 3u);  // +++-- collapsed into one add
+  EXPECT_EQ(map.end[1], 8u);
+}
+
+TEST(BFCompiler, SourceSpansFollowEveryPass) {
+  std::string const program = "++ comment\n[->+<]\n>[-]>[>]";
+  for (std::size_t optims = 0; optims <= 4; ++optims) {
+    source_map_t map;
+    auto const bytecodes = compile(program, optims, &map);
+    ASSERT_EQ(map.size(), bytecodes.size()) << "optimization level " << optims;
+    for (std::size_t i = 0; i < bytecodes.size(); ++i) {
+      EXPECT_LT(map.begin[i], map.end[i]);
+      if (bytecodes[i].opcode == inst_t::op_code_t::jmpz) {
+        EXPECT_EQ(program[map.begin[i]], '[');
+      }
+    }
+    EXPECT_EQ(map.lines, (std::vector<std::uint32_t>{11, 18}));
+  }
+
+  source_map_t map;
+  auto const bytecodes = compile(program, 3, &map);
+  // add 2, mul, set, mpadd, set, mpadd, scan
+  ASSERT_EQ(bytecodes.size(), 7u);
+  EXPECT_EQ(bytecodes[1].opcode, inst_t::op_code_t::mul);
+  EXPECT_EQ(map.begin[1], 11u);  // the mul and set cover the loop they replaced
+  EXPECT_EQ(map.end[2], 17u);
+  EXPECT_EQ(bytecodes[6].opcode, inst_t::op_code_t::scan);
+  EXPECT_EQ(map.begin[6], 23u);
+  EXPECT_EQ(map.position(map.begin[6]).line, 3u);
+  EXPECT_EQ(map.position(map.begin[6]).column, 6u);
+}
+
+TEST(BFCompiler, ReportsUnmatchedBracketsByLineAndColumn) {
+  auto const error = [](std::string const& program, std::size_t chunk_size) -> std::string {
+    try {
+      std::istringstream is{program};
+      compile_stream(is, 2, chunk_size);
+    } catch (std::runtime_error const& e) {
+      return e.what();
+    }
+    return {};
+  };
+  for (std::size_t chunk_size : {1u, 4096u}) {
+    EXPECT_EQ(error("+\n++]", chunk_size), "Unmatched closing bracket at line 2, column 3");
+    EXPECT_EQ(error("+[[\n-", chunk_size), "Unmatched opening bracket at line 1, column 2 (2 unmatched)");
+    EXPECT_EQ(error("\n\n  [-", chunk_size), "Unmatched opening bracket at line 3, column 3");
+  }
+  // compile keeps no spans without a map and reads the source again to locate the bracket
+  auto const compile_error = [](std::string const& program, std::size_t optims) -> std::string {
+    try {
+      testing::internal::CaptureStdout();
+      compile(program, optims);
+    } catch (std::runtime_error const& e) {
+      testing::internal::GetCapturedStdout();
+      return e.what();
+    }
+    testing::internal::GetCapturedStdout();
+    return {};
+  };
+  for (std::size_t optims : {0u, 2u, 5u}) {
+    EXPECT_EQ(compile_error("+\n[-]\n++]", optims), "Unmatched closing bracket at line 3, column 3");
+    EXPECT_EQ(compile_error("+[[\n-]", optims), "Unmatched opening bracket at line 1, column 2");
+  }
+  std::vector<inst_t> bytecodes{{inst_t::op_code_t::jmpnz, 0}};
+  EXPECT_THROW(bfcompiler_internal::resolve_jumps(bytecodes), std::runtime_error);
+}
+
+TEST(BFCompiler, FusedOptimizerMatchesChainedPasses) {
+  std::vector<std::string> programs{
+      "[-][-]+[-]>[>][<<]+[-]", "[[-]]+[[>]]", "[-]",  "+[->+>++<<]>[->>+<<<+>]<[-<->+]",
+      "++[>+<--]+[-+-]>[<]>>[>>>]+[><]", "+[->" + std::string(40000, '>') + "+" + std::string(40000, '<') + "<]",
+      std::string(40000, '>') + "+" + std::string(40000, '<') + "[-]++>>[-]" + std::string(40000, '<') + ".,",
+      "+[-" + std::string(20, '>') + "+" + std::string(20, '<') + "]>>>.<<<[-]+++,[>+<-]",
+  };
+  for (auto const* name : {"helloworld.bf", "bench.bf", "hanoi.bf", "fib.bf", "mandelbrot.bf"}) {
+    programs.push_back(read_corpus(name));
+  }
+
+  for (auto const& program : programs) {
+    for (std::size_t optims = 0; optims <= 4; ++optims) {
+      std::vector<inst_t> translated;
+      source_map_t translated_map;
+      bfcompiler_internal::translate(program, translated, optims > 0, 0, &translated_map);
+
+      auto chained_map = translated_map;
+      auto const chained = bfcompiler_internal::optimize_chained(translated, optims, &chained_map);
+      auto fused = translated;
+      auto fused_map = translated_map;
+      bfcompiler_internal::optimize_fused(fused, optims, &fused_map);
+
+      ASSERT_EQ(fused.size(), chained.size()) << "optimization level " << optims << "\n" << program.substr(0, 80);
+      for (std::size_t i = 0; i < chained.size(); ++i) {
+        ASSERT_EQ(fused[i].opcode, chained[i].opcode) << "instruction " << i;
+        ASSERT_EQ(fused[i].operand, chained[i].operand) << "instruction " << i;
+        ASSERT_EQ(fused[i].offset, chained[i].offset) << "instruction " << i;
+      }
+      EXPECT_EQ(fused_map.begin, chained_map.begin);
+      EXPECT_EQ(fused_map.end, chained_map.end);
+    }
+  }
+}
+
+TEST(BFCompiler, Opt5DropsLoopsThatCannotRun) {
+  // [.] on the zero tape, [>.<] after the set left by the multiply loop
+  auto const bytecodes = compile(std::string_view{"[.]+[->+<][>.<]"}, 5);
+  ASSERT_EQ(bytecodes.size(), 3u);
+  EXPECT_EQ(bytecodes[0].opcode, inst_t::op_code_t::add);
+  EXPECT_EQ(bytecodes[1].opcode, inst_t::op_code_t::mul);
+  EXPECT_EQ(bytecodes[2].opcode, inst_t::op_code_t::set);
+
+  // a loop right after another one, and after a scan
+  auto const after_loop = compile(std::string_view{",[.,][-.][>]>[<]"}, 5);
+  ASSERT_EQ(after_loop.size(), 7u);  // in, jmpz, out, in, jmpnz, mpadd, scan
+  EXPECT_EQ(after_loop[6].opcode, inst_t::op_code_t::scan);
+  EXPECT_EQ(after_loop[1].operand, 4);
+  EXPECT_EQ(after_loop[4].operand, 1);
+}
+
+TEST(BFCompiler, Opt5KeepsLoopsWhoseCellIsUnknown) {
+  // input, a mul from an unknown cell, and 256, which is zero only with 8-bit cells
+  for (std::string_view const program : {",[.]", ",[->+<]>[.]", "+[>++<-]>-[.]", "++>[-]<[.]"}) {
+    auto const bytecodes = compile(program, 5);
+    EXPECT_EQ(rng::count(bytecodes, inst_t::op_code_t::jmpz, &inst_t::opcode), 1) << program;
+  }
+  auto const wide = compile(std::string(256, '+') + "[.]", 5);
+  EXPECT_EQ(rng::count(wide, inst_t::op_code_t::jmpz, &inst_t::opcode), 1);
+}
+
+TEST(BFCompiler, FoldPrefixEvaluatesInitialization) {
+  auto bytecodes = compile(std::string_view{"++++++++[>++++++++<-]>+[>]<.[-]>,"}, 5);
+  auto const initial = fold_prefix(bytecodes);
+  EXPECT_EQ(initial.cells, (std::vector<std::uint32_t>{0, 65}));
+  EXPECT_EQ(initial.pointer, 2u);  // after the scan; the output is at offset -1
+  ASSERT_FALSE(bytecodes.empty());
+  EXPECT_EQ(bytecodes[0].opcode, inst_t::op_code_t::out);
+  EXPECT_EQ(bytecodes[0].offset, -1);
+
+  // stops before the pointer leaves the tape and at a cell that is zero only at some widths
+  auto left = compile(std::string_view{"+<+."}, 5);
+  EXPECT_EQ(fold_prefix(left).cells, (std::vector<std::uint32_t>{1}));
+  EXPECT_EQ(left.size(), 3u);
+  auto right = compile(std::string_view{"+>>>+."}, 5);
+  EXPECT_EQ(fold_prefix(right, 2).pointer, 0u);
+  auto wide = compile(std::string(256, '+') + "[.-]", 5);
+  EXPECT_EQ(fold_prefix(wide).cells, (std::vector<std::uint32_t>{256}));
+  EXPECT_EQ(wide[0].opcode, inst_t::op_code_t::jmpz);
+
+  // jumps of the remaining program are resolved again
+  auto loop = compile(std::string_view{"+++[-.]"}, 5);
+  fold_prefix(loop);
+  ASSERT_EQ(loop.size(), 4u);
+  EXPECT_EQ(loop[0].operand, 3);
+  EXPECT_EQ(loop[3].operand, 0);
+}
@@ -0,0 +1,9 @@
+Fibonacci numbers in decimal
+Prints the first 3000 terms after 0 and 1 one per line
+The numbers are kept as arrays of decimal digits interleaved in records of ten cells
+with the least significant digit first; each term is added digit by digit with carry
+>>>>>>>>>>+>>+<<<<<<<++++++++++++[>>++++++++++[-<+++++++++++++++++++++++++>]<[>>
+>>[>[->>>+<<<]>[->>+<<<+>]>[->+<]>>++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<<]>[-]
+>[-<<<<+>>>>]>[->>>>>>+<<<<<<]>>>]>>>[-<<<+>>+>]<<<<<<<<<<<<<[<<<<<<<<<<]>>>>>>>
+>>>[>>>>>>>>>>]<<<<<<<<<<[>>>>++++++++[-<<++++++>>]<<.>>++++++++[-<<------>>]<<<
+<<<<<<<<<<<]>>>>>>>++++++++++.[-]<-]<-]
@@ -0,0 +1,24 @@
+Towers of Hanoi with 20 disks
+Prints one line per move: the disk (a is the smallest) then the source and target pegs
+Every disk is a record of ten cells holding a counter bit and its peg; each move
+increments the binary counter across the records and moves the disk whose bit turned on
+>>>>>>>>>>>>+>>+>>>+>>++++++++++[-<+++++++++>]<+++++++>>>+>>>+>>>>>++++++++++[-<
++++++++++>]<++++++++>>>+>>>+>>>+>>++++++++++[-<+++++++++>]<+++++++++>>>+>>>+>>>>
+>++++++++++[-<++++++++++>]<>>>+>>>+>>>+>>++++++++++[-<++++++++++>]<+>>>+>>>+>>>>
+>++++++++++[-<++++++++++>]<++>>>+>>>+>>>+>>++++++++++[-<++++++++++>]<+++>>>+>>>+
+>>>>>++++++++++[-<++++++++++>]<++++>>>+>>>+>>>+>>++++++++++[-<++++++++++>]<+++++
+>>>+>>>+>>>>>++++++++++[-<++++++++++>]<++++++>>>+>>>+>>>+>>++++++++++[-<++++++++
+++>]<+++++++>>>+>>>+>>>>>++++++++++[-<++++++++++>]<++++++++>>>+>>>+>>>+>>+++++++
++++[-<++++++++++>]<+++++++++>>>+>>>+>>>>>++++++++++[-<+++++++++++>]<>>>+>>>+>>>+
+>>++++++++++[-<+++++++++++>]<+>>>+>>>+>>>>>++++++++++[-<+++++++++++>]<++>>>+>>>+
+>>>+>>++++++++++[-<+++++++++++>]<+++>>>+>>>+>>>>>++++++++++[-<+++++++++++>]<++++
+>>>+>>>+>>>+>>++++++++++[-<+++++++++++>]<+++++>>>+>>>+>>>>>++++++++++[-<++++++++
++++>]<++++++<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[-<+[<<<<<<<<<<]>>>>>>>>>[->>>>>
+>>>>>]+>[>>>>>>>.>++++++++++[-<<<<<<++++++>>>>>>]<<<<<<+++++>>[-<<+>>>>>>+<<<<]>
+>>>[-<<<<+>>>>]<<<[-<<<++>>>>>>+<<<]>>>[-<<<+>>>]<<<<<<.[-]+>>>>[->>+<<<[-<<<<+>
+>>>]<[->+<]<[->+<]<<[->>+<<]>->>>>]>>[-<<+>>]<<<<<<[->[-<<+>>]>[-<+>]>[-<+>]<<<<
+[->>>>+<<<<]>]>>>>>>++++++++++[-<<<<<<++++++>>>>>>]<<<<<<+++++>>[-<<+>>>>>>+<<<<
+]>>>>[-<<<<+>>>>]<<<[-<<<++>>>>>>+<<<]>>>[-<<<+>>>]<<<<<<.[-]++++++++++.[-]<+<-]
+>]
@@ -0,0 +1,38 @@
+#pragma once
+#include "bfcompiler.hpp"
+#include "bfvm.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Helpers shared by the test files.
+
+// Contents of a file, empty when it cannot be read.
+inline std::string read_file(std::filesystem::path const& path) {
+  std::ifstream ifs{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+}
+
+// A program of the test corpus (test/*.bf).
+inline std::string read_corpus(std::string const& name) {
+  return read_file(std::filesystem::path{CCBF_TEST_DIR} / name);
+}
+
+using dispatch_t = BrainFckVM::dispatch_t;
+
+// The VM dispatches that tests run every program on.
+inline constexpr dispatch_t dispatches[] = {dispatch_t::switch_loop, dispatch_t::threaded};
+
+// compile() without the statistics it prints.
+inline std::vector<inst_t> quiet_compile(std::string const& source, std::size_t optims = 2) {
+  testing::internal::CaptureStdout();
+  auto bytecodes = compile(source, optims);
+  testing::internal::GetCapturedStdout();
+  return bytecodes;
+}
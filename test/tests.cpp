@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -90,3 +91,11 @@ TEST(BFMachine, Step2Test) {
   ASSERT_EQ(output.size(), 24u);
   EXPECT_EQ(output, "Hello, Coding Challenges");
 }
+
+TEST(BFMachine, WideCellsDoNotWrapAtAByte) {
+  std::istringstream in;
+  std::ostringstream out;
+  BasicBFMachine<std::uint16_t> machine{in, out};
+  machine.run(std::string{"++++++++++++++++[>++++++++++++++++<-]>[[-]<+>]<.-."});
+  EXPECT_EQ(out.str(), std::string("\x01\x00", 2));
+}